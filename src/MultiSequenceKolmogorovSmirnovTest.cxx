@@ -0,0 +1,105 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#include "imageHelpers.h"
+#include "itkNeighborhoodMultiSequenceKSImageFilter.h"
+#include "itkNeighborhoodQuantileSketchCalculator.h"
+
+#include <vector>
+namespace CU = cascade::util;
+
+int main(int argc, char *argv[])
+{
+  if (argc < 8 || (argc - 5) % 3 != 0)
+  {
+    std::cerr << "Missing Parameters " << std::endl;
+    std::cerr << "Usage: " << argv[0];
+    std::cerr << " InclusionArea TestArea Radius Output";
+    std::cerr << " Input1 pos/neg Output1 [Input2 pos/neg Output2 ...]";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string trainMask(argv[1]);
+  std::string testMask(argv[2]);
+  double R = atof(argv[3]);
+  std::string combinedOutput(argv[4]);
+  const unsigned int numberOfSequences = (argc - 5) / 3;
+
+  const unsigned int ImageDimension = 3;
+  typedef float PixelType;
+  typedef unsigned char LabelType;
+  typedef float ProbabilityType;
+
+  typedef itk::Image< PixelType, ImageDimension > ImageType;
+  typedef itk::NeighborhoodMultiSequenceKSImageFilter< ImageType, ProbabilityType, LabelType > KSFilter;
+
+  typedef KSFilter::OutputImageType ProbabilityImageType;
+  typedef KSFilter::LabelImageType LabelImageType;
+  typedef itk::NeighborhoodQuantileSketchCalculator< ImageType, LabelImageType > SketchCalculatorType;
+  const unsigned int ReferenceSize = 2000;
+
+  LabelImageType::Pointer trainMaskImg = CU::LoadImage< LabelImageType >(
+      trainMask);
+  LabelImageType::Pointer testMaskImg = CU::LoadImage< LabelImageType >(
+      testMask);
+
+  std::vector< ImageType::Pointer > images;
+  std::vector< bool > positive;
+  std::vector< std::string > outputs;
+  for (unsigned int s = 0; s < numberOfSequences; s++)
+  {
+    images.push_back(CU::LoadImage< ImageType >(argv[5 + 3 * s]));
+    positive.push_back(std::string(argv[6 + 3 * s]) != "neg");
+    outputs.push_back(argv[7 + 3 * s]);
+  }
+
+  ImageType::SizeType radius;
+  ImageType::SpacingType spacing = images[0]->GetSpacing();
+  for (unsigned int i = 0; i < ImageDimension; i++)
+  {
+    radius[i] = R / spacing[i];
+  }
+
+  std::cerr << "Radius is: " << radius << std::endl;
+  const size_t num_train = CU::CountNEq< LabelImageType >(trainMaskImg, 0);
+  std::cerr << "Number of train: " << num_train << std::endl;
+
+  /*
+   * The training neighborhoods are pooled once for all sequences, each of
+   * which gets the reference a separate OneSampleKolmogorovSmirnovTest run
+   * would build.
+   */
+  std::cerr << "Start setting up reference CDFs" << std::endl;
+  SketchCalculatorType::Pointer sketchCalculator = SketchCalculatorType::New();
+  sketchCalculator->SetMask(trainMaskImg);
+  sketchCalculator->SetRadius(radius);
+  for (unsigned int s = 0; s < numberOfSequences; s++)
+  {
+    sketchCalculator->AddImage(images[s]);
+  }
+  sketchCalculator->Compute();
+  std::vector< KSFilter::DistributionType > refrence(numberOfSequences);
+  for (unsigned int s = 0; s < numberOfSequences; s++)
+  {
+    refrence[s] = sketchCalculator->GetDistribution(ReferenceSize, s);
+  }
+  std::cerr << "Done setting up reference CDFs" << std::endl;
+
+  KSFilter::Pointer ks = KSFilter::New();
+  ks->SetMask(testMaskImg);
+  ks->SetRadius(radius);
+  for (unsigned int s = 0; s < numberOfSequences; s++)
+  {
+    ks->AddSequence(images[s], refrence[s], positive[s]);
+    std::cerr << "Sequence " << s << ": " << (positive[s] ? "positive" : "negative")
+              << " direction" << std::endl;
+  }
+  std::cerr << "Start searching" << std::endl;
+  ks->Update();
+  for (unsigned int s = 0; s < numberOfSequences; s++)
+  {
+    CU::WriteImage< ProbabilityImageType >(outputs[s], ks->GetSequenceOutput(s));
+  }
+  CU::WriteImage< ProbabilityImageType >(combinedOutput, ks->GetOutput());
+  std::cerr << "Done searching" << std::endl;
+  return EXIT_SUCCESS;
+}
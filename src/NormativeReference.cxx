@@ -0,0 +1,237 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+
+#include "itkImageUtil.h"
+#include "itkImageToWeightedHistogramFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkReferenceDistributionCache.h"
+
+#include "vcl_cmath.h"
+
+#include "itksys/CommandLineArguments.hxx"
+
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <algorithm>
+
+/*
+ * Builds a normative reference histogram of a cohort: the intensities of
+ * every subject within its mask, rescaled by ImageUtil::NormalizeExtent, are
+ * added to one histogram with fixed bins. References of sub-cohorts built
+ * with the same bins are merged by adding them. The result is read by
+ * StatisticTest --reference, with --normalize set to the same quantile.
+ *
+ * With --distribution the output is instead a sorted sample of quantiles of
+ * the histogram, which OneSampleKolmogorovSmirnovTest reads as InclusionArea
+ * with its NormalizeQuantile set to the same quantile. Only histograms can be
+ * merged, so sub-cohorts are built without --distribution.
+ */
+int main(int argc, const char **argv)
+{
+  std::string output;
+  std::string subjectList;
+  double quantile = 0.01;
+  unsigned int numberOfBins = 400;
+  std::string rangeList("-0.5,1.5");
+  unsigned int distributionSize = 0;
+
+  typedef itksys::CommandLineArguments argT;
+  argT argParser;
+  argParser.Initialize(argc, argv);
+
+  argParser.AddArgument("--output", argT::SPACE_ARGUMENT, &output,
+                        "Output reference file");
+  argParser.AddArgument(
+      "--list", argT::SPACE_ARGUMENT, &subjectList,
+      "Text file, one entry per line: 'image mask' for a subject or a reference file to merge");
+  argParser.AddArgument(
+      "--quantile", argT::SPACE_ARGUMENT, &quantile,
+      "Quantile of the intensity extent mapped to 0 and 1 [default=0.01]");
+  argParser.AddArgument("--bins", argT::SPACE_ARGUMENT, &numberOfBins,
+                        "Number of histogram bins [default=400]");
+  argParser.AddArgument(
+      "--range", argT::SPACE_ARGUMENT, &rangeList,
+      "Normalized intensity range of the bins as low,high; values outside go to the end bins [default=-0.5,1.5]");
+  argParser.AddArgument(
+      "--distribution", argT::SPACE_ARGUMENT, &distributionSize,
+      "Write this many quantiles of the reference as a sorted sample for OneSampleKolmogorovSmirnovTest instead of the histogram; name the output *.ref");
+
+  if (!argParser.Parse() || output.empty() || subjectList.empty()
+      || numberOfBins == 0)
+  {
+    std::cerr << "Error parsing arguments." << std::endl;
+    std::cerr << argParser.GetArgv0() << " [OPTIONS]" << std::endl;
+    std::cerr << "Options: " << argParser.GetHelp() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const std::string::size_type comma = rangeList.find(',');
+  if (comma == std::string::npos)
+  {
+    std::cerr << "--range needs low,high" << std::endl;
+    return EXIT_FAILURE;
+  }
+  const double low = atof(rangeList.substr(0, comma).c_str());
+  const double high = atof(rangeList.substr(comma + 1).c_str());
+  if (!(high > low))
+  {
+    std::cerr << "Empty range " << rangeList << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const unsigned int ImageDimension = 3;
+  typedef double PixelType;
+  typedef itk::Image< PixelType, ImageDimension > ImageType;
+  typedef itk::ImageUtil< ImageType > ImageUtil;
+
+  /* The histogram type StatisticTest reads with --reference. */
+  typedef itk::Statistics::ImageToWeightedHistogramFilter< ImageType > HistogramFilterType;
+  typedef HistogramFilterType::HistogramType HistogramType;
+  typedef itk::Statistics::ReferenceDistributionCache ReferenceCacheType;
+
+  HistogramType::Pointer reference = HistogramType::New();
+  {
+    HistogramType::SizeType size(1);
+    size.Fill(numberOfBins);
+    HistogramType::MeasurementVectorType lowerBound(1);
+    HistogramType::MeasurementVectorType upperBound(1);
+    lowerBound.Fill(low);
+    upperBound.Fill(high);
+    reference->SetMeasurementVectorSize(1);
+    reference->Initialize(size, lowerBound, upperBound);
+  }
+  const double binsPerUnit = numberOfBins / (high - low);
+
+  std::ifstream list(subjectList.c_str());
+  if (!list)
+  {
+    std::cerr << "Can not read " << subjectList << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  unsigned int numberOfSubjects = 0;
+  unsigned int numberOfMerged = 0;
+  std::string line;
+  while (std::getline(list, line))
+  {
+    std::stringstream ss(line);
+    std::string first;
+    std::string second;
+    ss >> first >> second;
+    if (first.empty() || first[0] == '#')
+    {
+      continue;
+    }
+
+    if (second.empty())
+    {
+      /*
+       * A partial reference: only the frequencies are added, so its bins
+       * must be the same.
+       */
+      HistogramType::Pointer partial = HistogramType::New();
+      if (!ReferenceCacheType::ReadHistogram(first, 0, partial.GetPointer()))
+      {
+        std::cerr << "Can not read reference " << first << std::endl;
+        return EXIT_FAILURE;
+      }
+      bool sameBins = partial->GetMeasurementVectorSize() == 1
+          && partial->Size() == reference->Size();
+      for (unsigned int n = 0; sameBins && n < numberOfBins; n++)
+      {
+        sameBins = vcl_fabs(partial->GetBinMin(0, n) - reference->GetBinMin(0, n)) < 1e-9
+            && vcl_fabs(partial->GetBinMax(0, n) - reference->GetBinMax(0, n)) < 1e-9;
+      }
+      if (!sameBins)
+      {
+        std::cerr << "Bins of " << first << " differ from --bins/--range"
+                  << std::endl;
+        return EXIT_FAILURE;
+      }
+      for (unsigned int n = 0; n < numberOfBins; n++)
+      {
+        reference->IncreaseFrequency(n, partial->GetFrequency(n));
+      }
+      ++numberOfMerged;
+      continue;
+    }
+
+    ImageType::Pointer img = ImageUtil::NormalizeExtent(
+        ImageUtil::ReadImage(first), quantile);
+    ImageType::Pointer mask = ImageUtil::ReadImage(second);
+
+    itk::ImageRegionConstIterator< ImageType > it(img,
+                                                  img->GetBufferedRegion());
+    itk::ImageRegionConstIterator< ImageType > mit(mask,
+                                                   img->GetBufferedRegion());
+    for (; !it.IsAtEnd(); ++it, ++mit)
+    {
+      if (mit.Get() > 0)
+      {
+        const double bin = vcl_floor((it.Get() - low) * binsPerUnit);
+        const unsigned int n =
+            bin < 0 ? 0 : (bin >= numberOfBins ? numberOfBins - 1 :
+                static_cast< unsigned int >(bin));
+        reference->IncreaseFrequency(n, 1);
+      }
+    }
+    ++numberOfSubjects;
+    std::cout << "Subject " << numberOfSubjects << ": " << first << std::endl;
+  }
+
+  std::cout << "Added " << numberOfSubjects << " subjects and merged "
+            << numberOfMerged << " references, total frequency "
+            << reference->GetTotalFrequency() << std::endl;
+
+  if (distributionSize == 0)
+  {
+    if (!ReferenceCacheType::WriteHistogram(output, 0, reference.GetPointer()))
+    {
+      std::cerr << "Can not write " << output << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cout << "Use with StatisticTest --reference " << output
+              << " --normalize " << quantile << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  const double total = reference->GetTotalFrequency();
+  if (!(total > 0))
+  {
+    std::cerr << "Empty reference, no distribution written" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  /*
+   * Quantiles at (k + 0.5) / N of the reference, interpolated linearly
+   * within a bin. OneSampleKolmogorovSmirnovTest runs on float when it
+   * normalizes, so the sample is stored as float.
+   */
+  std::vector< float > distribution(distributionSize);
+  unsigned int n = 0;
+  double below = 0;
+  for (unsigned int k = 0; k < distributionSize; k++)
+  {
+    const double target = (k + 0.5) / distributionSize * total;
+    while (n + 1 < numberOfBins && below + reference->GetFrequency(n) < target)
+    {
+      below += reference->GetFrequency(n);
+      ++n;
+    }
+    const double frequency = reference->GetFrequency(n);
+    const double fraction = frequency > 0 ?
+        std::min(1.0, std::max(0.0, (target - below) / frequency)) : 0.5;
+    distribution[k] = static_cast< float >(reference->GetBinMin(0, n)
+        + fraction * (reference->GetBinMax(0, n) - reference->GetBinMin(0, n)));
+  }
+
+  if (!ReferenceCacheType::WriteDistribution(output, 0, distribution))
+  {
+    std::cerr << "Can not write " << output << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << "Use " << output
+            << " as InclusionArea of OneSampleKolmogorovSmirnovTest with"
+            << " NormalizeQuantile " << quantile << std::endl;
+  return EXIT_SUCCESS;
+}
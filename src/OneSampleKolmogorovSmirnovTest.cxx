@@ -1,99 +1,159 @@
 /* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
-#include "itkConstNeighborhoodIterator.h"
 #include "imageHelpers.h"
+#include "itkImageRegionIterator.h"
+#include "itkImageUtil.h"
 #include "itkNeighborhoodOneSampleKSImageFilter.h"
+#include "itkNeighborhoodQuantileSketchCalculator.h"
+#include "itkReferenceDistributionCache.h"
 namespace CU = cascade::util;
 
-int main(int argc, char *argv[])
+namespace
+{
+/*
+ * The test runs on the pixel type of the input, so the reference and the
+ * sorted neighborhoods hold the scanner values as they are stored. With a
+ * normalize quantile the input is rescaled by ImageUtil::NormalizeExtent,
+ * as for a NormativeReference distribution, and the test runs on float.
+ */
+template< typename TPixel >
+int RunOneSampleKS(const std::string & trainMask, const std::string & testMask,
+                   const std::string & input, const std::string & pvalueOutput,
+                   double R, const std::string & directionFlag,
+                   const std::string & modeFlag, double coarseR,
+                   double bandLow, double bandHigh,
+                   const std::string & referenceCache,
+                   bool trainIsReference, double normalizeQuantile)
 {
-  if (argc < 5)
-  {
-    std::cerr << "Missing Parameters " << std::endl;
-    std::cerr << "Usage: " << argv[0];
-    std::cerr << " InclusionArea TestArea Input Output Radius [pos/neg]";
-    std::cerr << std::endl;
-    return EXIT_FAILURE;
-  }
-
-  std::string trainMask(argv[1]);
-  std::string testMask(argv[2]);
-  std::string input(argv[3]);
-  std::string pvalueOutput(argv[4]);
-  double R = 1;
-  std::string directionFlag("pos");
-  if (argc > 5) R = atof(argv[5]);
-  if (argc > 6) directionFlag = argv[6];
-
   const unsigned int ImageDimension = 3;
   const unsigned int SpaceDimension = ImageDimension;
-  typedef float PixelType;
+  typedef TPixel PixelType;
   typedef unsigned char LabelType;
   typedef float ProbabilityType;
 
   typedef itk::Image< PixelType, ImageDimension > ImageType;
   typedef itk::NeighborhoodOneSampleKSImageFilter< ImageType, ProbabilityType, LabelType > KSFilter;
 
-  typedef KSFilter::OutputImageType ProbabilityImageType;
-  typedef KSFilter::LabelImageType LabelImageType;
+  typedef typename KSFilter::OutputImageType ProbabilityImageType;
+  typedef typename KSFilter::LabelImageType LabelImageType;
+  typedef itk::NeighborhoodQuantileSketchCalculator< ImageType, LabelImageType > SketchCalculatorType;
+  const unsigned int ReferenceSize = 2000;
 
-  LabelImageType::Pointer trainMaskImg = CU::LoadImage< LabelImageType >(
-      trainMask);
-  LabelImageType::Pointer testMaskImg = CU::LoadImage< LabelImageType >(
+  typename LabelImageType::Pointer testMaskImg = CU::LoadImage< LabelImageType >(
       testMask);
 
-  ImageType::Pointer image = CU::LoadImage< ImageType >(input);
+  typename ImageType::Pointer image = CU::LoadImage< ImageType >(input);
+  if (normalizeQuantile > 0)
+  {
+    image = itk::ImageUtil< ImageType >::NormalizeExtent(image,
+                                                         normalizeQuantile);
+  }
 
-  ImageType::RegionType region = image->GetLargestPossibleRegion();
-  ImageType::SizeType radius;
-  ImageType::SpacingType spacing = image->GetSpacing();
+  typename ImageType::SizeType radius;
+  typename ImageType::SpacingType spacing = image->GetSpacing();
   for (unsigned int i = 0; i < ImageDimension; i++)
   {
     radius[i] = R / spacing[i];
   }
 
   std::cerr << "Radius is: " << radius << std::endl;
-  const size_t num_train = CU::CountNEq< LabelImageType >(trainMaskImg, 0);
-  std::cerr << "Number of train: " << num_train << std::endl;
-
-  std::cerr << "Start setting up reference CDF" << std::endl;
-  KSFilter::DistributionType refrence;
-  size_t testLength = 0;
-  {
-    itk::ConstNeighborhoodIterator< LabelImageType > trainMaskIterator(
-        radius, trainMaskImg, region);
-    itk::ConstNeighborhoodIterator< ImageType > imgIterator(radius, image,
-                                                            region);
-    testLength = imgIterator.Size();
-    while (!imgIterator.IsAtEnd())
+
+  /*
+   * The reference depends on the input, the training mask, the radius and
+   * the sketch; a cached one is used when its key matches all of them. The
+   * images are keyed by their files, see ReferenceDistributionKey.
+   */
+  typedef itk::Statistics::ReferenceDistributionCache ReferenceCacheType;
+  typename KSFilter::DistributionType refrence;
+  if (trainIsReference)
+  {
+    if (!ReferenceCacheType::ReadDistribution(trainMask, 0, refrence)
+        || refrence.empty())
     {
-      if (trainMaskIterator.GetCenterPixel() > itk::NumericTraits< LabelType >::Zero)
+      std::cerr << "Can not read reference " << trainMask << std::endl;
+      return EXIT_FAILURE;
+    }
+    std::cerr << "Reference loaded from " << trainMask << std::endl;
+  }
+  else
+  {
+    typename LabelImageType::Pointer trainMaskImg = CU::LoadImage< LabelImageType >(
+        trainMask);
+    typename SketchCalculatorType::Pointer sketchCalculator = SketchCalculatorType::New();
+
+    itk::Statistics::ReferenceDistributionKey key;
+    key.AddString("OneSampleKolmogorovSmirnovTest quantile sketch");
+    key.AddFile(input);
+    key.AddFile(trainMask);
+    key.AddImageInformation(image.GetPointer());
+    key.AddImageInformation(trainMaskImg.GetPointer());
+    for (unsigned int i = 0; i < ImageDimension; i++)
+    {
+      key.Add< uint64_t >(radius[i]);
+    }
+    key.Add< uint32_t >(sketchCalculator->GetSketchSize());
+    key.Add< uint32_t >(sketchCalculator->GetSeed());
+    key.Add< uint32_t >(ReferenceSize);
+    if (normalizeQuantile > 0)
+    {
+      key.Add< double >(normalizeQuantile);
+    }
+    std::string cacheFile;
+    if (!referenceCache.empty())
+    {
+      cacheFile = referenceCache + "/" + key.GetHexDigest() + ".ref";
+    }
+
+    if (!cacheFile.empty()
+        && ReferenceCacheType::ReadDistribution(cacheFile, key.GetDigest(),
+                                                refrence))
+    {
+      std::cerr << "Reference loaded from " << cacheFile << std::endl;
+    }
+    else
+    {
+      const size_t num_train = CU::CountNEq< LabelImageType >(trainMaskImg, 0);
+      std::cerr << "Number of train: " << num_train << std::endl;
+
+      /*
+       * The pooled training neighborhoods are summarized by a quantile
+       * sketch; its quantiles are the reference sample.
+       */
+      std::cerr << "Start setting up reference CDF" << std::endl;
+      sketchCalculator->SetMask(trainMaskImg);
+      sketchCalculator->SetRadius(radius);
+      sketchCalculator->AddImage(image);
+      sketchCalculator->Compute();
+      refrence = sketchCalculator->GetDistribution(ReferenceSize);
+      std::cerr << "Done setting up reference CDF" << std::endl;
+      if (!cacheFile.empty()
+          && !ReferenceCacheType::WriteDistribution(cacheFile, key.GetDigest(),
+                                                    refrence))
       {
-        if (rand() % (num_train / 100) == 0)
-        {
-          for (size_t i = 0; i < testLength; i++)
-          {
-            if (trainMaskIterator.GetPixel(i) > itk::NumericTraits< LabelType >::Zero)
-            {
-              refrence.push_back(imgIterator.GetPixel(i));
-            }
-          }
-        }
+        std::cerr << "Can not write reference cache " << cacheFile
+                  << std::endl;
       }
-      ++trainMaskIterator;
-      ++imgIterator;
     }
   }
-  std::sort(refrence.begin(), refrence.end());
-  std::cerr << "Done setting up reference CDF" << std::endl;
 
   std::cerr << "["<< refrence.front() << ", " << refrence.back() << "]" << std::endl;
 
   //return 0;
-  KSFilter::Pointer ks = KSFilter::New();
+  typename KSFilter::Pointer ks = KSFilter::New();
   ks->SetRefrenceDistribution(refrence);
   ks->SetInput(image);
   ks->SetMask(testMaskImg);
   ks->SetRadius(radius);
+  if (modeFlag == "fast")
+  {
+    ks->UseCDFTransformOn();
+    std::cerr << "Using CDF transform" << std::endl;
+  }
+  else if (modeFlag == "pvalue" || modeFlag == "exactpvalue")
+  {
+    ks->ComputePValueOn();
+    ks->SetExactPValue(modeFlag == "exactpvalue");
+    std::cerr << "Computing p-values" << std::endl;
+  }
   if (directionFlag == "neg")
   {
     ks->PositiveOff();
@@ -103,10 +163,155 @@ int main(int argc, char *argv[])
   {
     ks->PositiveOn();
   }
+  if (coarseR <= 0)
+  {
+    std::cerr << "Start searching" << std::endl;
+    ks->Update();
+    CU::WriteImage< ProbabilityImageType >(pvalueOutput, ks->GetOutput());
+    std::cerr << "Done searching" << std::endl;
+    return EXIT_SUCCESS;
+  }
+
+  /*
+   * Coarse pass with the small radius; only voxels whose statistic falls in
+   * the ambiguity band are searched again with the full radius.
+   */
+  typename ImageType::SizeType coarseRadius;
+  for (unsigned int i = 0; i < ImageDimension; i++)
+  {
+    coarseRadius[i] = coarseR / spacing[i];
+  }
+  std::cerr << "Coarse radius is: " << coarseRadius << std::endl;
+  typename KSFilter::Pointer coarseKS = KSFilter::New();
+  coarseKS->SetRefrenceDistribution(refrence);
+  coarseKS->SetInput(image);
+  coarseKS->SetMask(testMaskImg);
+  coarseKS->SetRadius(coarseRadius);
+  coarseKS->SetUseCDFTransform(ks->GetUseCDFTransform());
+  coarseKS->SetComputePValue(ks->GetComputePValue());
+  coarseKS->SetExactPValue(ks->GetExactPValue());
+  coarseKS->SetPositive(ks->GetPositive());
+  std::cerr << "Start coarse searching" << std::endl;
+  coarseKS->Update();
+  typename ProbabilityImageType::Pointer coarse = coarseKS->GetOutput();
+  coarse->DisconnectPipeline();
+
+  typedef typename KSFilter::ActiveMaskImageType BandImageType;
+  typename BandImageType::Pointer band = BandImageType::New();
+  band->CopyInformation(coarse);
+  band->SetRegions(coarse->GetBufferedRegion());
+  band->Allocate();
+  {
+    itk::ImageRegionConstIterator< ProbabilityImageType > cit(
+        coarse, coarse->GetBufferedRegion());
+    itk::ImageRegionConstIterator< LabelImageType > mit(
+        testMaskImg, coarse->GetBufferedRegion());
+    itk::ImageRegionIterator< BandImageType > bit(band,
+                                                  coarse->GetBufferedRegion());
+    for (; !cit.IsAtEnd(); ++cit, ++mit, ++bit)
+    {
+      bit.Set(mit.Get() > 0 && cit.Get() >= bandLow && cit.Get() <= bandHigh);
+    }
+  }
+  ks->SetActiveMask(band);
+
   std::cerr << "Start searching" << std::endl;
   ks->Update();
-  CU::WriteImage< ProbabilityImageType >(pvalueOutput, ks->GetOutput());
+  typename ProbabilityImageType::Pointer fine = ks->GetOutput();
+  {
+    itk::ImageRegionConstIterator< ProbabilityImageType > cit(
+        coarse, coarse->GetBufferedRegion());
+    itk::ImageRegionConstIterator< BandImageType > bit(
+        band, coarse->GetBufferedRegion());
+    itk::ImageRegionIterator< ProbabilityImageType > fit(
+        fine, coarse->GetBufferedRegion());
+    for (; !cit.IsAtEnd(); ++cit, ++bit, ++fit)
+    {
+      if (!bit.Get())
+      {
+        fit.Set(cit.Get());
+      }
+    }
+  }
+  std::cerr << "Re-evaluated " << ks->GetNumberOfActiveVoxels() << " of "
+            << coarseKS->GetNumberOfActiveVoxels()
+            << " voxels with the full radius" << std::endl;
+  CU::WriteImage< ProbabilityImageType >(pvalueOutput, fine);
   std::cerr << "Done searching" << std::endl;
   return EXIT_SUCCESS;
 }
+} // end namespace
 
+int main(int argc, char *argv[])
+{
+  /* CoarseRadius, BandLow and BandHigh are given together or not at all. */
+  if (argc < 5 || argc == 9 || argc == 10)
+  {
+    std::cerr << "Missing Parameters " << std::endl;
+    std::cerr << "Usage: " << argv[0];
+    std::cerr << " InclusionArea TestArea Input Output Radius [pos/neg] [exact/fast/pvalue/exactpvalue]";
+    std::cerr << " [CoarseRadius BandLow BandHigh] [ReferenceCacheDir] [NormalizeQuantile]";
+    std::cerr << std::endl;
+    std::cerr << "exactpvalue is exact only while neighborhood size x reference";
+    std::cerr << " size (2000) <= 2500, asymptotic otherwise" << std::endl;
+    std::cerr << "InclusionArea may also be a reference file (.ref), e.g. from";
+    std::cerr << " ReferenceCacheDir or NormativeReference --distribution; the";
+    std::cerr << " latter needs the NormalizeQuantile it was built with" << std::endl;
+    std::cerr << "CoarseRadius 0 and an empty ReferenceCacheDir skip those steps";
+    std::cerr << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::string trainMask(argv[1]);
+  std::string testMask(argv[2]);
+  std::string input(argv[3]);
+  std::string pvalueOutput(argv[4]);
+  double R = 1;
+  std::string directionFlag("pos");
+  std::string modeFlag("exact");
+  if (argc > 5) R = atof(argv[5]);
+  if (argc > 6) directionFlag = argv[6];
+  if (argc > 7) modeFlag = argv[7];
+  double coarseR = 0;
+  double bandLow = 0;
+  double bandHigh = 0;
+  if (argc > 10)
+  {
+    coarseR = atof(argv[8]);
+    bandLow = atof(argv[9]);
+    bandHigh = atof(argv[10]);
+  }
+  std::string referenceCache;
+  if (argc > 11) referenceCache = argv[11];
+  double normalizeQuantile = 0;
+  if (argc > 12) normalizeQuantile = atof(argv[12]);
+  const bool trainIsReference = trainMask.size() > 4
+      && trainMask.compare(trainMask.size() - 4, 4, ".ref") == 0;
+
+  if (normalizeQuantile > 0)
+  {
+    return RunOneSampleKS< float >(trainMask, testMask, input, pvalueOutput,
+                                   R, directionFlag, modeFlag, coarseR,
+                                   bandLow, bandHigh, referenceCache,
+                                   trainIsReference, normalizeQuantile);
+  }
+  switch (CU::ReadComponentType(input))
+  {
+    case itk::ImageIOBase::SHORT:
+      return RunOneSampleKS< short >(trainMask, testMask, input, pvalueOutput,
+                                     R, directionFlag, modeFlag, coarseR,
+                                     bandLow, bandHigh, referenceCache,
+                                     trainIsReference, 0);
+    case itk::ImageIOBase::USHORT:
+      return RunOneSampleKS< unsigned short >(trainMask, testMask, input,
+                                              pvalueOutput, R, directionFlag,
+                                              modeFlag, coarseR, bandLow,
+                                              bandHigh, referenceCache,
+                                              trainIsReference, 0);
+    default:
+      return RunOneSampleKS< float >(trainMask, testMask, input, pvalueOutput,
+                                     R, directionFlag, modeFlag, coarseR,
+                                     bandLow, bandHigh, referenceCache,
+                                     trainIsReference, 0);
+  }
+}
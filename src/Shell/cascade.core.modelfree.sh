@@ -47,6 +47,7 @@ fi
 # Model Free implementation of the CASCADE definition                        #
 ##############################################################################
 
+SEQUENCE_ARGS=
 for sequence in $ALL_SEQUENCES
 do
 	eval image=\$${sequence}
@@ -55,16 +56,11 @@ do
 	
 	pval=${OUTPUT_DIR}${pval}
 	
-	EXEC ${CASCADE_BIN}OneSampleKolmogorovSmirnovTest \
-			${INCLUSION} ${POSSIBLE_MASK} \
-			${image} ${pval} ${RADIUS} ${direction}
-	if [ -z "${populate}" ]
-	then
-		populate=$pval
-	else
-		populate="$populate -max $pval"
-	fi
+	SEQUENCE_ARGS="${SEQUENCE_ARGS} ${image} ${direction:-pos} ${pval}"
 	unset -v image pval direction
 done
 
-EXEC fslmaths $populate $OUTPUT 
\ No newline at end of file
+# All sequences are searched in one pass which also writes their maximum.
+EXEC ${CASCADE_BIN}MultiSequenceKolmogorovSmirnovTest \
+		${INCLUSION} ${POSSIBLE_MASK} ${RADIUS} ${OUTPUT} \
+		${SEQUENCE_ARGS}
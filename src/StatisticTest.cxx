@@ -3,13 +3,20 @@
 #include "itkImageToNeighborhoodSampleAdaptor.h"
 
 #include "itkImageUtil.h"
+#include "imageHelpers.h"
 #include "itkImageToWeightedHistogramFilter.h"
+#include "itkReferenceDistributionCache.h"
 
 #include "itkCovarianceSampleFilter.h"
 #include "itkListSample.h"
 #include "itkSubsample.h"
 
 #include "itkNeighborhoodOneSampleStatisticalTestImageFilter.h"
+#include "itkNeighborhoodMultiRadiusStatisticalTestImageFilter.h"
+#include "itkNeighborhoodMultiStatisticalTestImageFilter.h"
+#include "itkMaskImageFilter.h"
+#include "itkImageFileWriter.h"
+#include "itkImageRegionIterator.h"
 
 #include "itkAPTest.h"
 #include "itkKSTest.h"
@@ -21,21 +28,33 @@
 
 #include "itksys/CommandLineArguments.hxx"
 
-int main(int argc, const char **argv)
+#include <sstream>
+#include <algorithm>
+
+namespace CU = cascade::util;
+
+namespace
 {
-  if (false)
+/** Parsed command line; a run is instantiated for the pixel type of the
+ * input. */
+struct StatisticTestArguments
+{
+  StatisticTestArguments()
   {
-    std::cerr << "Missing Parameters " << std::endl;
-    std::cerr << "Usage: " << argv[0];
-    std::cerr << " InclusionArea TestArea Input Output Radius [pos/neg]";
-    std::cerr << std::endl;
-    std::cerr << "InclusionArea, TestArea: 1/0 mask" << std::endl;
-    std::cerr << "Input: Input image" << std::endl;
-    std::cerr << "Output: P-value image" << std::endl;
-    std::cerr << "Radius: Neighborhood radius in millimeter" << std::endl;
-    std::cerr << "[pos/neg]: Right tail or left tail. Default: pos"
-              << std::endl;
-    return EXIT_FAILURE;
+    R = 1;
+    directionFlag = "pos";
+    testType = "AP";
+    useCDFTransform = false;
+    useHistogram = false;
+    useBall = false;
+    coarseR = 0;
+    computePValue = false;
+    decisionThreshold = 0;
+    exactPValue = false;
+    normalizeQuantile = 0;
+    multiTest = false;
+    bandLow = 0;
+    bandHigh = 0;
   }
 
   std::string trainMask;
@@ -43,74 +62,81 @@ int main(int argc, const char **argv)
   std::string input;
   std::string pvalueOutput;
 
-  double R = 1;
-  std::string directionFlag("pos");
-  std::string testType("AP");
-
-  typedef itksys::CommandLineArguments argT;
-  argT argParser;
-  argParser.Initialize(argc, argv);
-
-  argParser.AddArgument("--direction", argT::SPACE_ARGUMENT, &directionFlag,
-                        "Direction of statistical test pos/neg [default=pos]");
-  argParser.AddArgument("--radius", argT::SPACE_ARGUMENT, &R,
-                        "Neighborhood radius in millimeter [default=1]");
-  argParser.AddArgument("--output", argT::SPACE_ARGUMENT, &pvalueOutput,
-                        "Output p-value image");
-  argParser.AddArgument("--input", argT::SPACE_ARGUMENT, &input, "Input image");
-  argParser.AddArgument("--train", argT::SPACE_ARGUMENT, &trainMask,
-                        "0/1 mask to create the reference sample");
-  argParser.AddArgument("--test", argT::SPACE_ARGUMENT, &testMask,
-                        "0/1 mask of the area to be tested");
-  argParser.AddArgument("--type", argT::SPACE_ARGUMENT, &testType,
-                        "Type of statistical test. AP/KS/KKS [default=AP]");
-
-  argParser.StoreUnusedArguments(true);
-
-  if (!argParser.Parse() || input.empty() || trainMask.empty()
-      || testMask.empty() || pvalueOutput.empty())
-  {
-    std::cerr << "Error parsing arguments." << std::endl;
-    std::cerr << argParser.GetArgv0() << " [OPTIONS]" << std::endl;
-    std::cerr << "Options: " << argParser.GetHelp() << std::endl;
-    return EXIT_FAILURE;
-  }
-
+  double R;
+  std::string directionFlag;
+  std::string testType;
+  bool useCDFTransform;
+  bool useHistogram;
+  bool useBall;
+  double coarseR;
+  bool computePValue;
+  std::string decisionMode;
+  double decisionThreshold;
+  bool exactPValue;
+  std::string referenceFile;
+  std::string referenceCache;
+  std::string saveReference;
+  double normalizeQuantile;
+
+  std::vector< double > radii;
+  std::vector< std::pair< std::string, std::string > > testList;
+  bool multiTest;
+  double bandLow;
+  double bandHigh;
+};
+
+template< typename TPixel >
+int RunStatisticTest(const StatisticTestArguments & args)
+{
   const unsigned int ImageDimension = 3;
-  const unsigned int SpaceDimension = ImageDimension;
 
-  typedef double ProbabilityType;
-  typedef itk::Image< ProbabilityType, ImageDimension > ImageType;
+  typedef TPixel PixelType;
+  typedef float ProbabilityType;
+  typedef itk::Image< PixelType, ImageDimension > ImageType;
+  typedef itk::Image< ProbabilityType, ImageDimension > ProbabilityImageType;
+  typedef itk::Image< unsigned char, ImageDimension > LabelImageType;
   typedef itk::ImageUtil< ImageType > ImageUtil;
+  typedef itk::ImageUtil< ProbabilityImageType > ProbabilityImageUtil;
+  typedef itk::ImageUtil< LabelImageType > LabelImageUtil;
 
-  typedef itk::Statistics::ImageToWeightedHistogramFilter< ImageType > HistogramFilterType;
-  typedef HistogramFilterType::HistogramType HistogramType;
+  typedef itk::Statistics::ImageToWeightedHistogramFilter< ImageType,
+      LabelImageType > HistogramFilterType;
+  typedef typename HistogramFilterType::HistogramType HistogramType;
   typedef itk::Statistics::Subsample< HistogramType > ReferenceSubsampleType;
 
   typedef itk::NeighborhoodOneSampleStatisticalTestImageFilter< ImageType,
-      ImageType, ReferenceSubsampleType > OneSampleStatisticsType;
+      ProbabilityImageType, ReferenceSubsampleType > OneSampleStatisticsType;
+
+  typedef itk::VectorImage< ProbabilityType, ImageDimension > VectorImageType;
+  typedef itk::NeighborhoodMultiRadiusStatisticalTestImageFilter< ImageType,
+      VectorImageType, ReferenceSubsampleType > MultiRadiusStatisticsType;
+  typedef itk::NeighborhoodMultiStatisticalTestImageFilter< ImageType,
+      VectorImageType, ReferenceSubsampleType > MultiStatisticsType;
 
   typedef itk::Statistics::StatisticalTestBase<
-      OneSampleStatisticsType::ReferenceSampleType,
-      OneSampleStatisticsType::InternalSampleType > StatisticalTestType;
+      typename OneSampleStatisticsType::ReferenceSampleType,
+      typename OneSampleStatisticsType::InternalSampleType > StatisticalTestType;
 
-  typedef itk::Statistics::KSTest< OneSampleStatisticsType::ReferenceSampleType,
-      OneSampleStatisticsType::InternalSampleType > KSTestType;
+  typedef itk::Statistics::KSTest< typename OneSampleStatisticsType::ReferenceSampleType,
+      typename OneSampleStatisticsType::InternalSampleType > KSTestType;
 
   typedef itk::Statistics::KernelKSTest<
-      OneSampleStatisticsType::ReferenceSampleType,
-      OneSampleStatisticsType::InternalSampleType > KernelKSTestType;
+      typename OneSampleStatisticsType::ReferenceSampleType,
+      typename OneSampleStatisticsType::InternalSampleType > KernelKSTestType;
 
-  typedef itk::Statistics::APTest< OneSampleStatisticsType::ReferenceSampleType,
-      OneSampleStatisticsType::InternalSampleType > APTestType;
+  typedef itk::Statistics::APTest< typename OneSampleStatisticsType::ReferenceSampleType,
+      typename OneSampleStatisticsType::InternalSampleType > APTestType;
 
   /*
    * Begin: Load Images and calculate the corresponding physical radius
    */
-  ImageType::Pointer img = ImageUtil::ReadImage(input);
-  ImageType::Pointer trainImg = ImageUtil::ReadImage(trainMask);
-  ImageType::Pointer testImg = ImageUtil::ReadImage(testMask);
-  ImageType::SizeType radius = ImageUtil::GetRadiusFromPhysicalSize(img, R);
+  typename ImageType::Pointer img = ImageUtil::ReadImage(args.input);
+  if (args.normalizeQuantile > 0)
+  {
+    img = ImageUtil::NormalizeExtent(img, args.normalizeQuantile);
+  }
+  LabelImageType::Pointer testImg = LabelImageUtil::ReadImage(args.testMask);
+  typename ImageType::SizeType radius = ImageUtil::GetRadiusFromPhysicalSize(img, args.R);
 
   /*
    * End: Load Images and calculate the corresponding physical radius
@@ -119,18 +145,83 @@ int main(int argc, const char **argv)
   /*
    * Start: Calculate histogram for the training mask as a sorted sample
    */
-  HistogramFilterType::Pointer histogramFilter = HistogramFilterType::New();
-  typedef HistogramFilterType::HistogramSizeType SizeType;
+  typedef typename HistogramFilterType::HistogramSizeType SizeType;
   SizeType size(img->GetNumberOfComponentsPerPixel());
   size.Fill(255);
-  histogramFilter->SetHistogramSize(size);
 
-  histogramFilter->SetInput(img);
-  histogramFilter->SetWeightImage(trainImg);
-  histogramFilter->Update();
-  HistogramType* hist = histogramFilter->GetOutput();
+  /*
+   * A reference given with --reference is used whatever it was built from;
+   * a cached one only if its key matches the input and training mask files
+   * (path, length and modification time), their geometry, the normalization
+   * and the histogram size.
+   */
+  typedef itk::Statistics::ReferenceDistributionCache ReferenceCacheType;
+  typename HistogramType::Pointer hist;
+  std::string cacheFile = args.referenceFile;
+  itk::Statistics::ReferenceDistributionKey key;
+  LabelImageType::Pointer trainImg;
+  if (args.referenceFile.empty())
+  {
+    trainImg = LabelImageUtil::ReadImage(args.trainMask);
+    key.AddString("StatisticTest weighted histogram");
+    key.AddFile(args.input);
+    key.AddFile(args.trainMask);
+    key.AddImageInformation(img.GetPointer());
+    key.AddImageInformation(trainImg.GetPointer());
+    key.Add< double >(args.normalizeQuantile);
+    for (unsigned int i = 0; i < size.Size(); i++)
+    {
+      key.Add< uint64_t >(size[i]);
+    }
+    if (!args.referenceCache.empty())
+    {
+      cacheFile = args.referenceCache + "/" + key.GetHexDigest() + ".ref";
+    }
+  }
+  if (!cacheFile.empty())
+  {
+    hist = HistogramType::New();
+    const uint64_t expectedKey = args.referenceFile.empty() ? key.GetDigest() : 0;
+    if (ReferenceCacheType::ReadHistogram(cacheFile, expectedKey,
+                                          hist.GetPointer()))
+    {
+      std::cout << "Reference loaded from " << cacheFile << std::endl;
+    }
+    else if (!args.referenceFile.empty())
+    {
+      std::cerr << "Can not read reference " << args.referenceFile << std::endl;
+      return EXIT_FAILURE;
+    }
+    else
+    {
+      hist = 0;
+    }
+  }
+  if (!hist)
+  {
+    typename HistogramFilterType::Pointer histogramFilter = HistogramFilterType::New();
+    histogramFilter->SetHistogramSize(size);
+
+    histogramFilter->SetInput(img);
+    histogramFilter->SetWeightImage(trainImg);
+    histogramFilter->Update();
+    hist = histogramFilter->GetOutput();
+    if (!cacheFile.empty()
+        && !ReferenceCacheType::WriteHistogram(cacheFile, key.GetDigest(),
+                                               hist.GetPointer()))
+    {
+      std::cerr << "Can not write reference cache " << cacheFile << std::endl;
+    }
+  }
+  if (!args.saveReference.empty()
+      && !ReferenceCacheType::WriteHistogram(args.saveReference, key.GetDigest(),
+                                             hist.GetPointer()))
+  {
+    std::cerr << "Can not write reference " << args.saveReference << std::endl;
+    return EXIT_FAILURE;
+  }
 
-  ReferenceSubsampleType::Pointer refSorted = ReferenceSubsampleType::New();
+  typename ReferenceSubsampleType::Pointer refSorted = ReferenceSubsampleType::New();
   refSorted->SetSample(hist);
   refSorted->InitializeWithAllInstances();
   itk::Statistics::Algorithm::HeapSort< ReferenceSubsampleType >(
@@ -139,54 +230,101 @@ int main(int argc, const char **argv)
    * End: Calculate histogram for the training mask as a sorted sample
    */
 
-  OneSampleStatisticsType::Pointer oneSampleTest =
+  typename OneSampleStatisticsType::Pointer oneSampleTest =
       OneSampleStatisticsType::New();
 
-  StatisticalTestType::Pointer statTest;
+  std::vector< typename StatisticalTestType::Pointer > statTests;
 
   /*
    * Begin: Plugging the statistics
    */
 
-  if (testType == "AP")
-  {
-    APTestType::Pointer apTest = APTestType::New();
-    apTest->SortedFirstOn();
-    statTest = apTest;
-  }
-  else if (testType == "KS")
-  {
-    KSTestType::Pointer ksTest = KSTestType::New();
-    ksTest->SortedFirstOn();
-    statTest = ksTest;
-  }
-  else if (testType == "KKS")
-  {
-    typedef itk::Statistics::CovarianceSampleFilter< ReferenceSubsampleType > CovarianceAlgorithmType;
-    CovarianceAlgorithmType::Pointer covarianceAlgorithm =
-        CovarianceAlgorithmType::New();
-    covarianceAlgorithm->SetInput(refSorted);
-    covarianceAlgorithm->Update();
-
-    const double sigma = vcl_sqrt(covarianceAlgorithm->GetCovarianceMatrix().operator ()(0, 0));
-    std::cout << "Sigma = " << std::endl;
-    std::cout << sigma << std::endl;
-
-    KernelKSTestType::Pointer kksTest = KernelKSTestType::New();
-    kksTest->SortedFirstOn();
-    kksTest->SetSigma(sigma);
-    statTest = kksTest;
-  }
-
-  if (directionFlag == "neg")
-  {
-    statTest->LeftTailOn();
-    std::cout << "Negative direction" << std::endl;
-  }
-  else
+  /* Several tests and nested radii hand their neighborhoods sorted. */
+  const bool sortedSecond = args.multiTest || !args.radii.empty();
+  double sigma = -1;
+  for (size_t t = 0; t < args.testList.size(); t++)
   {
-    statTest->RightTailOn();
+    const std::string & type = args.testList[t].first;
+    typename StatisticalTestType::Pointer statTest;
+    if (type == "AP")
+    {
+      typename APTestType::Pointer apTest = APTestType::New();
+      apTest->SortedFirstOn();
+      apTest->SetSortedSecond(sortedSecond);
+      statTest = apTest;
+    }
+    else if (type == "KS")
+    {
+      typename KSTestType::Pointer ksTest = KSTestType::New();
+      ksTest->SortedFirstOn();
+      ksTest->SetSortedSecond(sortedSecond);
+      ksTest->SetComputePValue(args.computePValue);
+      ksTest->SetExactPValue(args.exactPValue);
+      statTest = ksTest;
+    }
+    else if (type == "KKS")
+    {
+      if (sigma < 0)
+      {
+        typedef itk::Statistics::CovarianceSampleFilter< ReferenceSubsampleType > CovarianceAlgorithmType;
+        typename CovarianceAlgorithmType::Pointer covarianceAlgorithm =
+            CovarianceAlgorithmType::New();
+        covarianceAlgorithm->SetInput(refSorted);
+        covarianceAlgorithm->Update();
+
+        sigma = vcl_sqrt(covarianceAlgorithm->GetCovarianceMatrix().operator ()(0, 0));
+        std::cout << "Sigma = " << std::endl;
+        std::cout << sigma << std::endl;
+      }
+
+      typename KernelKSTestType::Pointer kksTest = KernelKSTestType::New();
+      kksTest->SortedFirstOn();
+      kksTest->SetSortedSecond(sortedSecond);
+      kksTest->SetSigma(sigma);
+      statTest = kksTest;
+    }
+    else
+    {
+      std::cerr << "Unknown test type " << type << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    /* With --types, every entry of the output vector must be a p-value. */
+    if (args.computePValue && type != "KS")
+    {
+      std::cerr << "--pvalue is not supported by test type " << type
+                << (args.multiTest ? " in --types" : "") << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (args.decisionMode == "binary")
+    {
+      statTest->SetDecisionMode(StatisticalTestType::BinaryDecision);
+      statTest->SetDecisionThreshold(args.decisionThreshold);
+    }
+    else if (args.decisionMode == "clamped")
+    {
+      statTest->SetDecisionMode(StatisticalTestType::ClampedDecision);
+      statTest->SetDecisionThreshold(args.decisionThreshold);
+    }
+    else if (!args.decisionMode.empty())
+    {
+      std::cerr << "Unknown decision mode " << args.decisionMode << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (args.testList[t].second == "neg")
+    {
+      statTest->LeftTailOn();
+      std::cout << type << ": negative direction" << std::endl;
+    }
+    else
+    {
+      statTest->RightTailOn();
+    }
+    statTests.push_back(statTest);
   }
+  typename StatisticalTestType::Pointer statTest = statTests.front();
 
   std::cout << "Radius = " << std::endl;
   std::cout << radius << std::endl;
@@ -198,22 +336,195 @@ int main(int argc, const char **argv)
   /*
    * Begin: Prepare input image
    */
-  oneSampleTest->SetInput(
-      ImageUtil::Mask(img, ImageUtil::Dilate(testImg, R, 1), 0));
+  typename ImageType::Pointer maskedImg = ImageUtil::MaskWithLabel(
+      img, LabelImageUtil::Dilate(testImg, args.R, 1), 0);
   /*
    * Begin: End input image
    */
 
+  if (args.multiTest)
+  {
+    /*
+     * One neighborhood pass; the statistic of every test is written as one
+     * component of a vector image. The filter hands every test a sorted
+     * neighborhood, hence SortedSecond above.
+     */
+    typename MultiStatisticsType::Pointer multiTestFilter = MultiStatisticsType::New();
+    multiTestFilter->SetInput(maskedImg);
+    multiTestFilter->SetRadius(radius);
+    if (args.useBall)
+    {
+      multiTestFilter->SetBallRadius(
+          ImageUtil::GetBallRadiusFromPhysicalSize(img, args.R));
+    }
+    for (size_t t = 0; t < statTests.size(); t++)
+    {
+      multiTestFilter->AddStatistics(statTests[t]);
+    }
+    multiTestFilter->SetRefrenceSample(refSorted);
+
+    typedef itk::MaskImageFilter< VectorImageType, LabelImageType, VectorImageType > VectorMaskType;
+    VectorMaskType::Pointer vectorMask = VectorMaskType::New();
+    vectorMask->SetInput(multiTestFilter->GetOutput());
+    vectorMask->SetMaskImage(testImg);
+
+    typedef itk::ImageFileWriter< VectorImageType > VectorWriterType;
+    VectorWriterType::Pointer writer = VectorWriterType::New();
+    writer->SetFileName(args.pvalueOutput);
+    writer->SetInput(vectorMask->GetOutput());
+
+    itk::SimpleFilterWatcher watcher(multiTestFilter,
+                                     "Multi statistical test.");
+    watcher.QuietOn();
+
+    try
+    {
+      writer->Update();
+    }
+    catch (itk::ExceptionObject & err)
+    {
+      std::cerr << "ExceptionObject caught !" << std::endl;
+      std::cerr << err << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  if (!args.radii.empty())
+  {
+    /*
+     * Nested neighborhoods share one traversal; the statistic of every
+     * radius is written as one component of a vector image.
+     */
+    typename MultiRadiusStatisticsType::RadiusListType indexRadii;
+    for (size_t k = 0; k < args.radii.size(); k++)
+    {
+      indexRadii.push_back(ImageUtil::GetRadiusFromPhysicalSize(img, args.radii[k]));
+      std::cout << "Radius " << args.radii[k] << " = " << indexRadii.back()
+                << std::endl;
+    }
+
+    typename MultiRadiusStatisticsType::Pointer multiRadiusTest =
+        MultiRadiusStatisticsType::New();
+    multiRadiusTest->SetInput(maskedImg);
+    multiRadiusTest->SetRadii(indexRadii);
+    multiRadiusTest->SetStatistics(statTest);
+    multiRadiusTest->SetRefrenceSample(refSorted);
+
+    typedef itk::MaskImageFilter< VectorImageType, LabelImageType, VectorImageType > VectorMaskType;
+    VectorMaskType::Pointer vectorMask = VectorMaskType::New();
+    vectorMask->SetInput(multiRadiusTest->GetOutput());
+    vectorMask->SetMaskImage(testImg);
+
+    typedef itk::ImageFileWriter< VectorImageType > VectorWriterType;
+    VectorWriterType::Pointer writer = VectorWriterType::New();
+    writer->SetFileName(args.pvalueOutput);
+    writer->SetInput(vectorMask->GetOutput());
+
+    itk::SimpleFilterWatcher watcher(multiRadiusTest,
+                                     "Multi radius statistical test.");
+    watcher.QuietOn();
+
+    try
+    {
+      writer->Update();
+    }
+    catch (itk::ExceptionObject & err)
+    {
+      std::cerr << "ExceptionObject caught !" << std::endl;
+      std::cerr << err << std::endl;
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  oneSampleTest->SetInput(maskedImg);
+
   oneSampleTest->SetRadius(radius);
+  if (args.useBall)
+  {
+    oneSampleTest->SetBallRadius(
+        ImageUtil::GetBallRadiusFromPhysicalSize(img, args.R));
+  }
   oneSampleTest->SetStatistics(statTest);
   oneSampleTest->SetRefrenceSample(refSorted);
+  if (args.useCDFTransform)
+  {
+    if (!statTest->SupportsMeanCDF())
+    {
+      std::cerr << "--fast is not supported by test type " << args.testType
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    oneSampleTest->UseCDFTransformOn();
+  }
+  if (args.useHistogram)
+  {
+    if (!statTest->SupportsHistogram() || args.useCDFTransform)
+    {
+      std::cerr << "--histogram is not supported by test type " << args.testType
+                << (args.useCDFTransform ? " with --fast" : "") << std::endl;
+      return EXIT_FAILURE;
+    }
+    oneSampleTest->UseHistogramOn();
+  }
 
   itk::SimpleFilterWatcher watcher(oneSampleTest,
                                    "One sample statistical test.");
   watcher.QuietOn();
 
+  typedef typename OneSampleStatisticsType::ActiveMaskImageType BandImageType;
+  ProbabilityImageType::Pointer coarse;
+  typename BandImageType::Pointer band;
+
   try
   {
+    if (args.coarseR > 0)
+    {
+      /*
+       * Coarse pass over the whole test area; the full radius is only used
+       * where the coarse statistic falls in the ambiguity band.
+       */
+      typename OneSampleStatisticsType::Pointer coarseTest =
+          OneSampleStatisticsType::New();
+      coarseTest->SetInput(maskedImg);
+      coarseTest->SetActiveMask(testImg);
+      coarseTest->SetRadius(ImageUtil::GetRadiusFromPhysicalSize(img, args.coarseR));
+      if (args.useBall)
+      {
+        coarseTest->SetBallRadius(
+            ImageUtil::GetBallRadiusFromPhysicalSize(img, args.coarseR));
+      }
+      coarseTest->SetStatistics(statTest);
+      coarseTest->SetRefrenceSample(refSorted);
+      coarseTest->SetUseCDFTransform(args.useCDFTransform);
+      coarseTest->SetUseHistogram(args.useHistogram);
+      coarseTest->Update();
+      coarse = coarseTest->GetOutput();
+      coarse->DisconnectPipeline();
+
+      band = BandImageType::New();
+      band->CopyInformation(coarse);
+      band->SetRegions(coarse->GetBufferedRegion());
+      band->Allocate();
+      itk::ImageRegionConstIterator< ProbabilityImageType > cit(
+          coarse, coarse->GetBufferedRegion());
+      itk::ImageRegionConstIterator< LabelImageType > tit(
+          testImg, coarse->GetBufferedRegion());
+      itk::ImageRegionIterator< BandImageType > bit(band,
+                                                    coarse->GetBufferedRegion());
+      for (; !cit.IsAtEnd(); ++cit, ++tit, ++bit)
+      {
+        bit.Set(tit.Get() > 0 && cit.Get() >= args.bandLow
+                && cit.Get() <= args.bandHigh);
+      }
+      oneSampleTest->SetActiveMask(band);
+
+      std::cout << "Coarse pass tested "
+                << coarseTest->GetNumberOfActiveVoxels() << " voxels"
+                << std::endl;
+    }
+
     oneSampleTest->Update();
   }
   catch (itk::ExceptionObject & err)
@@ -223,9 +534,228 @@ int main(int argc, const char **argv)
     return EXIT_FAILURE;
   }
 
-  ImageUtil::WriteImage(
-      pvalueOutput, ImageUtil::Mask(oneSampleTest->GetOutput(), testImg, 0));
+  if (coarse)
+  {
+    ProbabilityImageType * fine = oneSampleTest->GetOutput();
+    itk::ImageRegionConstIterator< ProbabilityImageType > cit(
+        coarse, coarse->GetBufferedRegion());
+    itk::ImageRegionConstIterator< BandImageType > bit(band,
+                                                       coarse->GetBufferedRegion());
+    itk::ImageRegionIterator< ProbabilityImageType > fit(
+        fine, coarse->GetBufferedRegion());
+    for (; !cit.IsAtEnd(); ++cit, ++bit, ++fit)
+    {
+      if (!bit.Get())
+      {
+        fit.Set(cit.Get());
+      }
+    }
+    std::cout << "Re-evaluated " << oneSampleTest->GetNumberOfActiveVoxels()
+              << " voxels with the full radius" << std::endl;
+  }
+
+  ProbabilityImageUtil::WriteImage(
+      args.pvalueOutput,
+      ProbabilityImageUtil::MaskWithLabel(oneSampleTest->GetOutput(), testImg, 0));
 
   return EXIT_SUCCESS;
 }
+} // end namespace
+
+int main(int argc, const char **argv)
+{
+  if (false)
+  {
+    std::cerr << "Missing Parameters " << std::endl;
+    std::cerr << "Usage: " << argv[0];
+    std::cerr << " InclusionArea TestArea Input Output Radius [pos/neg]";
+    std::cerr << std::endl;
+    std::cerr << "InclusionArea, TestArea: 1/0 mask" << std::endl;
+    std::cerr << "Input: Input image" << std::endl;
+    std::cerr << "Output: P-value image" << std::endl;
+    std::cerr << "Radius: Neighborhood radius in millimeter" << std::endl;
+    std::cerr << "[pos/neg]: Right tail or left tail. Default: pos"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  StatisticTestArguments args;
+  std::string bandList;
+  std::string radiiList;
+  std::string typesList;
+
+  typedef itksys::CommandLineArguments argT;
+  argT argParser;
+  argParser.Initialize(argc, argv);
+
+  argParser.AddArgument("--direction", argT::SPACE_ARGUMENT, &args.directionFlag,
+                        "Direction of statistical test pos/neg [default=pos]");
+  argParser.AddArgument("--radius", argT::SPACE_ARGUMENT, &args.R,
+                        "Neighborhood radius in millimeter [default=1]");
+  argParser.AddArgument("--output", argT::SPACE_ARGUMENT, &args.pvalueOutput,
+                        "Output p-value image");
+  argParser.AddArgument("--input", argT::SPACE_ARGUMENT, &args.input, "Input image");
+  argParser.AddArgument("--train", argT::SPACE_ARGUMENT, &args.trainMask,
+                        "0/1 mask to create the reference sample");
+  argParser.AddArgument(
+      "--reference", argT::SPACE_ARGUMENT, &args.referenceFile,
+      "Reference histogram file to use instead of building it from --train");
+  argParser.AddArgument(
+      "--reference-cache", argT::SPACE_ARGUMENT, &args.referenceCache,
+      "Directory of reference histograms keyed by the input and training mask files (path, length, modification time) and parameters; reused when present, written otherwise");
+  argParser.AddArgument(
+      "--save-reference", argT::SPACE_ARGUMENT, &args.saveReference,
+      "Write the reference histogram to this file");
+  argParser.AddArgument(
+      "--normalize", argT::SPACE_ARGUMENT, &args.normalizeQuantile,
+      "Rescale the input so that this quantile and its complement map to 0 and 1, as for a NormativeReference cohort reference [default=off]");
+  argParser.AddArgument("--test", argT::SPACE_ARGUMENT, &args.testMask,
+                        "0/1 mask of the area to be tested");
+  argParser.AddArgument("--type", argT::SPACE_ARGUMENT, &args.testType,
+                        "Type of statistical test. AP/KS/KKS [default=AP]");
+  argParser.AddArgument(
+      "--radii", argT::SPACE_ARGUMENT, &radiiList,
+      "Comma separated neighborhood radii in millimeter. Writes one statistic per radius, in increasing order, as a vector image");
+  argParser.AddArgument(
+      "--types", argT::SPACE_ARGUMENT, &typesList,
+      "Comma separated type:direction list, e.g. AP:pos,KS:neg. Writes one statistic per entry, in the given order, as a vector image");
+  argParser.AddBooleanArgument(
+      "--pvalue", &args.computePValue,
+      "Output the p-value of the statistic instead of the statistic (KS only, also for every entry of --types)");
+  argParser.AddBooleanArgument(
+      "--exact", &args.exactPValue,
+      "Use exact p-values where neighborhood size times reference size is at most 2500, asymptotic ones otherwise (with --pvalue)");
+  argParser.AddArgument(
+      "--decision", argT::SPACE_ARGUMENT, &args.decisionMode,
+      "Only decide whether the statistic reaches --threshold: binary writes 1/0, clamped writes the statistic or 0");
+  argParser.AddArgument("--threshold", argT::SPACE_ARGUMENT,
+                        &args.decisionThreshold,
+                        "Threshold of the decision mode [default=0]");
+  argParser.AddBooleanArgument(
+      "--fast", &args.useCDFTransform,
+      "Use CDF transform and box means, radius independent (AP only)");
+  argParser.AddBooleanArgument(
+      "--ball", &args.useBall,
+      "Use the voxels within --radius millimeter instead of the bounding box");
+  argParser.AddArgument(
+      "--coarse-radius", argT::SPACE_ARGUMENT, &args.coarseR,
+      "Radius in millimeter of a first pass over the test area; only voxels whose statistic falls in --band are tested again with --radius");
+  argParser.AddArgument(
+      "--band", argT::SPACE_ARGUMENT, &bandList,
+      "Ambiguity band of the coarse pass as low,high (with --coarse-radius)");
+  argParser.AddBooleanArgument(
+      "--histogram", &args.useHistogram,
+      "Quantize into the reference histogram bins and slide a neighborhood histogram (AP/KS)");
+
+  argParser.StoreUnusedArguments(true);
+
+  if (!argParser.Parse() || args.input.empty()
+      || (args.trainMask.empty() && args.referenceFile.empty()) || args.testMask.empty() || args.pvalueOutput.empty())
+  {
+    std::cerr << "Error parsing arguments." << std::endl;
+    std::cerr << argParser.GetArgv0() << " [OPTIONS]" << std::endl;
+    std::cerr << "Options: " << argParser.GetHelp() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  {
+    std::stringstream ss(radiiList);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+      if (!item.empty())
+      {
+        args.radii.push_back(atof(item.c_str()));
+      }
+    }
+    std::sort(args.radii.begin(), args.radii.end());
+    if (!args.radii.empty())
+    {
+      args.R = args.radii.back();
+    }
+  }
+  if (!args.radii.empty() && (args.useBall || args.useCDFTransform || args.useHistogram))
+  {
+    std::cerr << "--ball, --fast and --histogram are not supported with --radii"
+              << std::endl;
+    return EXIT_FAILURE;
+  }
 
+  /*
+   * Each entry is a test type and a direction; without --types it is the
+   * single --type and --direction.
+   */
+  {
+    std::stringstream ss(typesList);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+      if (item.empty())
+      {
+        continue;
+      }
+      const std::string::size_type colon = item.find(':');
+      if (colon == std::string::npos)
+      {
+        args.testList.push_back(std::make_pair(item, args.directionFlag));
+      }
+      else
+      {
+        args.testList.push_back(std::make_pair(item.substr(0, colon),
+                                          item.substr(colon + 1)));
+      }
+    }
+  }
+  args.multiTest = !args.testList.empty();
+  if (!args.multiTest)
+  {
+    args.testList.push_back(std::make_pair(args.testType, args.directionFlag));
+  }
+  if (args.multiTest && (!args.radii.empty() || args.coarseR > 0 || args.useCDFTransform
+      || args.useHistogram))
+  {
+    std::cerr << "--types is not supported with --radii, --coarse-radius,"
+              << " --fast or --histogram" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if (args.coarseR > 0)
+  {
+    const std::string::size_type comma = bandList.find(',');
+    if (!args.radii.empty() || comma == std::string::npos)
+    {
+      std::cerr << "--coarse-radius needs --band low,high and no --radii"
+                << std::endl;
+      return EXIT_FAILURE;
+    }
+    args.bandLow = atof(bandList.substr(0, comma).c_str());
+    args.bandHigh = atof(bandList.substr(comma + 1).c_str());
+  }
+
+  /*
+   * Scanner data stored as 16 bit integers is read and tested as such;
+   * anything else, and rescaled intensities, as float or double.
+   */
+  const bool rescale = args.normalizeQuantile > 0;
+  switch (CU::ReadComponentType(args.input))
+  {
+    case itk::ImageIOBase::SHORT:
+      if (!rescale)
+      {
+        return RunStatisticTest< short >(args);
+      }
+      return RunStatisticTest< float >(args);
+    case itk::ImageIOBase::USHORT:
+      if (!rescale)
+      {
+        return RunStatisticTest< unsigned short >(args);
+      }
+      return RunStatisticTest< float >(args);
+    case itk::ImageIOBase::UCHAR:
+    case itk::ImageIOBase::CHAR:
+    case itk::ImageIOBase::FLOAT:
+      return RunStatisticTest< float >(args);
+    default:
+      return RunStatisticTest< double >(args);
+  }
+}
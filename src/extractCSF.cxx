@@ -1,5 +1,6 @@
 /* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
 #include "itkImageToWeightedHistogramFilter.h"
+#include "itkMultiClassWeightedHistogramCalculator.h"
 #include "itkEmpiricalDensityMembershipFunction.h"
 #include "itkIterativeBayesianImageFilter.h"
 #include "itkBinaryFillholeImageFilter.h"
@@ -13,6 +14,20 @@
 
 namespace CU = cascade::util;
 
+namespace
+{
+template< class TFilter >
+void ReportIterations(const TFilter * filter)
+{
+  for (unsigned int i = 0; i < filter->GetNumberOfElapsedIterations(); i++)
+  {
+    std::cerr << "Iteration " << i + 1 << ": "
+              << filter->GetNumberOfChangedLabels(i) << " voxels changed class"
+              << std::endl;
+  }
+}
+} // end namespace
+
 /*
  * TODO: Current extract CSF is sensitive to small ventricles. Empirical
  * distribution need to be adjusted.
@@ -24,6 +39,7 @@ int main(int argc, char *argv[])
     std::cerr << "Missing Parameters " << std::endl;
     std::cerr << "Usage: " << argv[0];
     std::cerr << " image brainMask csfPrior csfOutput [bias] [nIteration]";
+    std::cerr << " [convergence]";
     std::cerr << std::endl;
     return EXIT_FAILURE;
   }
@@ -36,6 +52,9 @@ int main(int argc, char *argv[])
   unsigned int numberOfIteration = 1;
   if (argc > 5) priorBias = atof(argv[5]);
   if (argc > 6) numberOfIteration = atof(argv[6]);
+  // Fraction of voxels changing class at which the iterations stop
+  double convergenceThreshold = 0;
+  if (argc > 7) convergenceThreshold = atof(argv[7]);
 
   const unsigned int ImageDimension = 3;
   const unsigned int SpaceDimension = ImageDimension;
@@ -170,8 +189,10 @@ int main(int argc, char *argv[])
     ibFilter->SetPriorVectorImage(composePriorFilter->GetOutput());
     ibFilter->SetInput(subjectImg);
     ibFilter->SetNumberOfIterations(numberOfIteration);
+    ibFilter->SetConvergenceThreshold(convergenceThreshold);
     ibFilter->SetPriorBias(priorBias);
     ibFilter->Update();
+    ReportIterations(ibFilter.GetPointer());
     CSFMask = CU::Mask< ClassifidImageType, LabelImageType >(
         ibFilter->GetOutput(), brainMaskImg);
   }
@@ -180,39 +201,32 @@ int main(int argc, char *argv[])
     CSFMask = CU::Erode< ClassifidImageType >(CSFMask, 2);
     IBFilterType::Pointer ibFilter = IBFilterType::New();
 
-    // Create WM+GM membership
+    // Create WM+GM and CSF memberships from one pass over the subject
     {
-      WeightedHistogramType::Pointer hist = WeightedHistogramType::New();
-      hist->SetWeightImage(wgPriorImg);
-      hist->SetAutoMinimumMaximum(true);
-      hist->SetHistogramSize(size);
+      typedef itk::Statistics::MultiClassWeightedHistogramCalculator<
+          ImageType, Probability > HistogramCalculatorType;
+      HistogramCalculatorType::Pointer hist = HistogramCalculatorType::New();
       hist->SetInput(subjectImg);
-      hist->Update();
-
-      EmpiricalDistributionMembershipType::Pointer membership =
-          EmpiricalDistributionMembershipType::New();
-      membership->SetDistribution(hist->GetOutput());
-      ibFilter->AddMembershipFunction(membership);
-    }
-    //Create CSF membership
-    {
-      WeightedHistogramType::Pointer hist = WeightedHistogramType::New();
-      EmpiricalDistributionMembershipType::Pointer membership =
-          EmpiricalDistributionMembershipType::New();
-      hist->SetWeightImage(CU::Cast< PriorImageType >(CSFMask.GetPointer()));
-      hist->SetAutoMinimumMaximum(true);
       hist->SetHistogramSize(size);
-      hist->SetInput(subjectImg);
-      hist->Update();
-
-      membership->SetDistribution(hist->GetOutput());
-      ibFilter->AddMembershipFunction(membership);
+      hist->AddWeightImage(wgPriorImg);
+      hist->AddWeightImage(CU::Cast< PriorImageType >(CSFMask.GetPointer()));
+      hist->Compute();
+
+      for (unsigned int i = 0; i < hist->GetNumberOfClasses(); i++)
+      {
+        EmpiricalDistributionMembershipType::Pointer membership =
+            EmpiricalDistributionMembershipType::New();
+        membership->SetDistribution(hist->GetHistogram(i));
+        ibFilter->AddMembershipFunction(membership);
+      }
     }
     ibFilter->SetPriorVectorImage(composePriorFilter->GetOutput());
     ibFilter->SetInput(subjectImg);
     ibFilter->SetNumberOfIterations(numberOfIteration);
+    ibFilter->SetConvergenceThreshold(convergenceThreshold);
     ibFilter->SetPriorBias(priorBias);
     ibFilter->Update();
+    ReportIterations(ibFilter.GetPointer());
     CSFMask = CU::Mask< ClassifidImageType, LabelImageType >(
         ibFilter->GetOutput(), brainMaskImg);
 
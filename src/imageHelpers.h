@@ -11,6 +11,7 @@
 
 #include "itkMaskImageFilter.h"
 #include "itkImageFileReader.h"
+#include "itkImageIOFactory.h"
 #include "itkImageFileWriter.h"
 #include "itkBinaryThresholdImageFilter.h"
 #include "itkImageMaskSpatialObject.h"
@@ -278,6 +279,29 @@ typename ImageT::Pointer CropImage(const ImageT* image,
   DispatchFilterOutput(croppingFilter, typename ImageT::Pointer);
 }
 
+/** Component type of an image file as stored on disk, or
+ * UNKNOWNCOMPONENTTYPE if no image IO can read it. */
+inline ::itk::ImageIOBase::IOComponentType ReadComponentType(
+    std::string filename)
+{
+  ::itk::ImageIOBase::Pointer imageIO = ::itk::ImageIOFactory::CreateImageIO(
+      filename.c_str(), ::itk::ImageIOFactory::ReadMode);
+  if (!imageIO)
+  {
+    return ::itk::ImageIOBase::UNKNOWNCOMPONENTTYPE;
+  }
+  try
+  {
+    imageIO->SetFileName(filename);
+    imageIO->ReadImageInformation();
+  }
+  catch (::itk::ExceptionObject &)
+  {
+    return ::itk::ImageIOBase::UNKNOWNCOMPONENTTYPE;
+  }
+  return imageIO->GetComponentType();
+}
+
 template< class ImageT >
 typename ImageT::Pointer LoadImage(std::string filename)
 {
@@ -8,6 +8,9 @@
 #include "itkStatisticsAlgorithm.h"
 #include "vcl_algorithm.h"
 
+#include <vector>
+#include <algorithm>
+
 #include "itkStatisticalTestBase.h"
 namespace itk
 {
@@ -39,24 +42,21 @@ public:
   typedef typename SubSampleType1::ConstIterator SubsampleConstIter1;
   typedef typename SubSampleType2::ConstIterator SubsampleConstIter2;
 
+  typedef typename Superclass::ScratchType ScratchType;
+
   virtual TRealValueType Evaluate(const SampleType1 * x1, const SampleType2 * x2) const
   {
-    typename SubSampleType1::Pointer subsample1 = SubSampleType1::New();
-    subsample1->SetSample(x1);
-    subsample1->InitializeWithAllInstances();
-
-    typename SubSampleType2::Pointer subsample2 = SubSampleType2::New();
-    subsample2->SetSample(x2);
-    subsample2->InitializeWithAllInstances();
+    ScratchType scratch;
+    return this->Evaluate(x1, x2, scratch);
+  }
 
-    if (!this->GetSortedFirst())
-    {
-      Algorithm::HeapSort<SubSampleType1>(subsample1, 0, 0, subsample1->Size());
-    }
-    if (!this->GetSortedSecond())
-    {
-      Algorithm::HeapSort<SubSampleType2>(subsample2, 0, 0, subsample2->Size());
-    }
+  virtual TRealValueType Evaluate(const SampleType1 * x1, const SampleType2 * x2,
+                                  ScratchType & scratch) const
+  {
+    this->PrepareScratch(x1, x2, this->GetSortedFirst(),
+                         this->GetSortedSecond(), scratch);
+    const SubSampleType1 * subsample1 = scratch.Subsample1;
+    const SubSampleType2 * subsample2 = scratch.Subsample2;
 
     TRealValueType step1 = 1.0 / subsample1->GetTotalFrequency();
 
@@ -73,6 +73,17 @@ public:
     TRealValueType last1=it1.GetMeasurementVector()[0];
     TRealValueType last2=it2.GetMeasurementVector()[0];
 
+    /*
+     * For the decision mode: the test values not merged yet have a reference
+     * CDF between cdf1 and 1, and the autoconvolution ends between its
+     * current value and its value over the whole reference.
+     */
+    const bool decide = this->GetDecisionMode() != Superclass::NoDecision;
+    const TRealValueType total1 = subsample1->GetTotalFrequency();
+    const TRealValueType total2 = subsample2->GetTotalFrequency();
+    TRealValueType remaining2 = total2;
+    TRealValueType decision;
+
     while (it2 != it2End)
       {
       while (it1 != it1End)
@@ -86,12 +97,167 @@ public:
         ++it1;
         }
       p += cdf1*it2.GetFrequency();
+      remaining2 -= it2.GetFrequency();
       ++it2;
+      if (decide)
+        {
+        const TRealValueType pLow = (p + remaining2 * cdf1) / total2;
+        const TRealValueType pHigh = (p + remaining2) / total2;
+        const TRealValueType prLow = pr / total1;
+        const TRealValueType prHigh = vcl_max(prLow, scratch.Sample1Summary);
+        if (this->Decide(this->APLowerBound(pLow, pHigh, prLow, prHigh),
+                         this->APUpperBound(pLow, pHigh, prLow, prHigh),
+                         decision))
+          {
+          return decision;
+          }
+        }
+      }
+    pr /= total1;
+    p /= total2;
+
+    return this->DecisionOutput(this->APStatistics(p, pr));
+  }
+
+  virtual bool SupportsMeanCDF() const
+  {
+    return true;
+  }
+
+  /** As in Evaluate(), the reference autoconvolution only runs over the
+   * reference values below the largest test value; it is tabulated for every
+   * prefix of the sorted reference. */
+  virtual void InitializeMeanCDF(const SampleType1 * x1)
+  {
+    typename SubSampleType1::Pointer subsample1 = SubSampleType1::New();
+    subsample1->SetSample(x1);
+    subsample1->InitializeWithAllInstances();
+
+    if (!this->GetSortedFirst())
+    {
+      Algorithm::HeapSort<SubSampleType1>(subsample1, 0, 0, subsample1->Size());
+    }
+
+    const TRealValueType total1 = subsample1->GetTotalFrequency();
+    TRealValueType step1 = 1.0 / total1;
+    TRealValueType cdf1=0;
+    TRealValueType pr=0;
+    m_ReferenceValues.clear();
+    m_ReferenceAutoConvolution.assign(1, 0);
+    for (SubsampleConstIter1 it1 = subsample1->Begin(); it1 != subsample1->End(); ++it1)
+      {
+      cdf1 += step1*it1.GetFrequency();
+      pr+= cdf1*it1.GetFrequency();
+      m_ReferenceValues.push_back(it1.GetMeasurementVector()[0]);
+      m_ReferenceAutoConvolution.push_back(pr / total1);
+      }
+  }
+
+  virtual TRealValueType EvaluateMeanCDF(const TRealValueType & meanCDF,
+                                         const TRealValueType & maximum) const
+  {
+    const size_t below = std::lower_bound(m_ReferenceValues.begin(),
+                                          m_ReferenceValues.end(), maximum)
+        - m_ReferenceValues.begin();
+    return this->DecisionOutput(
+        this->APStatistics(meanCDF, m_ReferenceAutoConvolution[below]));
+  }
+
+  virtual bool SupportsHistogram() const
+  {
+    return true;
+  }
+
+  /** As in Evaluate() with a histogram reference, each bin being one
+   * reference value: a test value sees the reference CDF of the bins below
+   * its own and the autoconvolution stops at the bin of the largest test
+   * value. */
+  virtual TRealValueType EvaluateHistogram(const TRealValueType * frequency1,
+                                           const TRealValueType & total1,
+                                           const TRealValueType * frequency2,
+                                           const TRealValueType & total2,
+                                           unsigned int numberOfBins) const
+  {
+    unsigned int last = numberOfBins;
+    while (last > 0 && frequency2[last - 1] == 0)
+      {
+      --last;
+      }
+
+    const TRealValueType step1 = 1.0 / total1;
+    TRealValueType cdf1 = 0;
+    TRealValueType p = 0;
+    TRealValueType pr = 0;
+    for (unsigned int b = 0; b + 1 < last; b++)
+      {
+      p += cdf1 * frequency2[b];
+      cdf1 += step1 * frequency1[b];
+      pr += cdf1 * frequency1[b];
+      }
+    if (last > 0)
+      {
+      p += cdf1 * frequency2[last - 1];
       }
-    pr /= subsample1->GetTotalFrequency();
-    p /= subsample2->GetTotalFrequency();
+    pr /= total1;
+    p /= total2;
 
-    return this->APStatistics(p, pr);
+    return this->DecisionOutput(this->APStatistics(p, pr));
+  }
+
+  virtual bool SupportsBatch() const
+  {
+    return true;
+  }
+
+  virtual void EvaluateBatch(const float * values1,
+                             const TRealValueType * frequencies1,
+                             SizeValueType size1, const float * values2,
+                             const SizeValueType * offsets2, SizeValueType count,
+                             TRealValueType * output) const
+  {
+    this->EvaluateBatchKernel(values1, frequencies1, size1, values2, offsets2,
+                              count, output);
+  }
+
+  virtual void EvaluateBatch(const double * values1,
+                             const TRealValueType * frequencies1,
+                             SizeValueType size1, const double * values2,
+                             const SizeValueType * offsets2, SizeValueType count,
+                             TRealValueType * output) const
+  {
+    this->EvaluateBatchKernel(values1, frequencies1, size1, values2, offsets2,
+                              count, output);
+  }
+
+  /** The right tail statistic grows with p and shrinks with pr, the left
+   * tail statistic the other way round, so the extremes over a box of (p, pr)
+   * are at its corners. The two tail lower bound is left at zero. */
+  inline TRealValueType APLowerBound(const TRealValueType& pLow, const TRealValueType& pHigh,
+                                     const TRealValueType& prLow, const TRealValueType& prHigh) const
+  {
+    if (this->GetRightTail())
+    {
+      return this->APStatistics(pLow, prHigh);
+    }
+    if (this->GetLeftTail())
+    {
+      return this->APStatistics(pHigh, prLow);
+    }
+    return TRealValueType(0);
+  }
+
+  inline TRealValueType APUpperBound(const TRealValueType& pLow, const TRealValueType& pHigh,
+                                     const TRealValueType& prLow, const TRealValueType& prHigh) const
+  {
+    if (this->GetRightTail())
+    {
+      return this->APStatistics(pHigh, prLow);
+    }
+    if (this->GetLeftTail())
+    {
+      return this->APStatistics(pLow, prHigh);
+    }
+    return vcl_max(this->APStatistics(pHigh, prLow), this->APStatistics(pLow, prHigh));
   }
 
   inline TRealValueType APStatistics(const TRealValueType& p,const TRealValueType& pr) const
@@ -123,6 +289,67 @@ public:
   itkBooleanMacro(SortedSecond);
 
 protected:
+  /** Autoconvolution over the whole reference, the largest value the one
+   * accumulated by Evaluate() can reach. */
+  virtual void SummarizeFirstSample(ScratchType & scratch) const
+  {
+    const SubSampleType1 * subsample1 = scratch.Subsample1;
+    TRealValueType step1 = 1.0 / subsample1->GetTotalFrequency();
+    TRealValueType cdf1=0;
+    TRealValueType pr=0;
+    for (SubsampleConstIter1 it1 = subsample1->Begin(); it1 != subsample1->End(); ++it1)
+      {
+      cdf1 += step1*it1.GetFrequency();
+      pr+= cdf1*it1.GetFrequency();
+      }
+    scratch.Sample1Summary = pr / subsample1->GetTotalFrequency();
+  }
+
+  /** The merge of Evaluate() on plain arrays. */
+  template< typename TValue >
+  void EvaluateBatchKernel(const TValue * values1,
+                           const TRealValueType * frequencies1,
+                           SizeValueType size1, const TValue * values2,
+                           const SizeValueType * offsets2, SizeValueType count,
+                           TRealValueType * output) const
+  {
+    TRealValueType total1 = 0;
+    for (SizeValueType i = 0; i < size1; i++)
+      {
+      total1 += frequencies1[i];
+      }
+    const TRealValueType step1 = 1.0 / total1;
+
+    for (SizeValueType k = 0; k < count; k++)
+      {
+      const TValue * x2 = values2 + offsets2[k];
+      const SizeValueType size2 = offsets2[k + 1] - offsets2[k];
+      if (size1 == 0 || size2 == 0)
+        {
+        output[k] = 0;
+        continue;
+        }
+      TRealValueType cdf1 = 0;
+      TRealValueType p = 0;
+      TRealValueType pr = 0;
+      SizeValueType i = 0;
+      for (SizeValueType j = 0; j < size2; j++)
+        {
+        const TValue t = x2[j];
+        while (i < size1 && values1[i] < t)
+          {
+          cdf1 += step1 * frequencies1[i];
+          pr += cdf1 * frequencies1[i];
+          ++i;
+          }
+        p += cdf1;
+        }
+      pr /= total1;
+      p /= size2;
+      output[k] = this->DecisionOutput(this->APStatistics(p, pr));
+      }
+  }
+
   APTest()
   {
     m_SortedFirst = false;
@@ -139,6 +366,10 @@ protected:
 private:
   bool m_SortedFirst;
   bool m_SortedSecond;
+  /** Sorted reference values, and the autoconvolution over the first k of
+   * them at index k. */
+  std::vector< TRealValueType > m_ReferenceValues;
+  std::vector< TRealValueType > m_ReferenceAutoConvolution;
 };
 // end of class
 }// end of namespace Statistics
@@ -0,0 +1,186 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkActiveVoxelBoxImageFilter_h
+#define __itkActiveVoxelBoxImageFilter_h
+
+#include "itkBoxImageFilter.h"
+#include "itkNeighborhoodSpans.h"
+#include "itkImage.h"
+#include "itkProgressReporter.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <vector>
+
+namespace itk
+{
+namespace Functor
+{
+/** Voxels with a value above zero are active. */
+template< typename TPixel >
+class ActiveIfPositive
+{
+public:
+  inline bool operator()(const TPixel & p) const
+  {
+    return p > NumericTraits< TPixel >::Zero;
+  }
+};
+
+/** Voxels with a value different from the background are active. */
+template< typename TPixel >
+class ActiveIfNotEqual
+{
+public:
+  ActiveIfNotEqual(const TPixel & background) :
+      m_Background(background)
+  {
+  }
+  inline bool operator()(const TPixel & p) const
+  {
+    return p != m_Background;
+  }
+private:
+  TPixel m_Background;
+};
+}
+
+/** \class ActiveVoxelBoxImageFilter
+ * \brief Box filter that only schedules the voxels it has to compute.
+ *
+ * GenerateData() compacts the active voxels of the requested region into
+ * runs along the first dimension, groups the runs into chunks with about the
+ * same number of voxels and hands the chunks to the threads on demand. Wall
+ * time then follows the number of active voxels, and threads that get a
+ * sparse part of the mask do not sit idle while others finish the dense
+ * parts. Inactive voxels of every output are set to zero.
+ *
+ * Subclasses fill the runs in ComputeActiveRuns() and implement
+ * ThreadedComputeRegion(), which is called with whole regions when
+ * scheduling is off and with single runs when it is on.
+ *
+ * The neighborhood is the box of the radius unless SetBallRadius() restricts
+ * it to an ellipsoid. Subclasses gather neighbors through
+ * GetNeighborhoodSpans(), which covers both shapes, and slide windows along
+ * the scan lines with SlidingWindowType.
+ */
+template< typename TInputImage, typename TOutputImage >
+class ActiveVoxelBoxImageFilter: public BoxImageFilter< TInputImage, TOutputImage >
+{
+public:
+  /** Standard class typedefs. */
+  typedef ActiveVoxelBoxImageFilter Self;
+  typedef BoxImageFilter< TInputImage, TOutputImage > Superclass;
+  typedef SmartPointer< Self > Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ActiveVoxelBoxImageFilter, BoxImageFilter);
+
+  typedef TOutputImage OutputImageType;
+  typedef typename OutputImageType::PixelType OutputPixelType;
+  typedef typename OutputImageType::RegionType OutputImageRegionType;
+  typedef typename OutputImageType::IndexType OutputIndexType;
+  typedef typename OutputImageType::SizeType OutputSizeType;
+
+  typedef typename Superclass::RadiusType RadiusType;
+  typedef NeighborhoodSpans< TInputImage::ImageDimension > NeighborhoodSpansType;
+  typedef typename NeighborhoodSpansType::BallRadiusType BallRadiusType;
+  typedef SlidingNeighborhoodWindow< TInputImage::ImageDimension > SlidingWindowType;
+
+  /** Setting the radius selects a box neighborhood. */
+  using Superclass::SetRadius;
+  virtual void SetRadius(const RadiusType & radius);
+
+  /** Use the ellipsoid with the given semi-axes in voxels, e.g. a radius in
+   * millimeter divided by the spacing, instead of a box. The box radius
+   * becomes the floor of the semi-axes. */
+  void SetBallRadius(const BallRadiusType & radius);
+
+  /** True when the neighborhood is the ball of SetBallRadius(). */
+  itkGetConstMacro(UseBallNeighborhood, bool);
+
+  const NeighborhoodSpansType & GetNeighborhoodSpans() const
+  {
+    return m_NeighborhoodSpans;
+  }
+
+  /** Schedule only the active voxels, dynamically over the threads. When off
+   * the requested region is split statically between the threads. */
+  itkGetConstMacro(UseActiveVoxelScheduling, bool);
+  itkSetMacro(UseActiveVoxelScheduling, bool);
+  itkBooleanMacro(UseActiveVoxelScheduling);
+
+  /** Number of active voxels per chunk. Zero picks a size giving about
+   * sixteen chunks per thread. */
+  itkGetConstMacro(ChunkSize, SizeValueType);
+  itkSetMacro(ChunkSize, SizeValueType);
+
+  /** Optional mask further restricting the active voxels to those where it
+   * is non-zero, e.g. the voxels left undecided by a coarser pass. Only the
+   * computed voxels are restricted, not their neighborhoods. Setting it
+   * forces active voxel scheduling. */
+  typedef Image< unsigned char, TInputImage::ImageDimension > ActiveMaskImageType;
+  itkSetConstObjectMacro(ActiveMask, ActiveMaskImageType);
+  itkGetConstObjectMacro(ActiveMask, ActiveMaskImageType);
+
+  /** Number of active voxels found by the last scheduled update. */
+  itkGetConstMacro(NumberOfActiveVoxels, SizeValueType);
+
+protected:
+  ActiveVoxelBoxImageFilter();
+  virtual ~ActiveVoxelBoxImageFilter()
+  {
+  }
+
+  virtual void GenerateData();
+
+  void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
+                            ThreadIdType threadId);
+
+  /** Compute the output on a region; inactive voxels within it are set to
+   * zero. */
+  virtual void ThreadedComputeRegion(const OutputImageRegionType & region,
+                                     ThreadIdType threadId,
+                                     ProgressReporter & progress) = 0;
+
+  /** Add the active voxels of region with AddActiveRuns(). */
+  virtual void ComputeActiveRuns(const OutputImageRegionType & region) = 0;
+
+  /** Add the runs of voxels of image within region for which isActive holds. */
+  template< typename TActivityImage, typename TPredicate >
+  void AddActiveRuns(const TActivityImage * image,
+                     const OutputImageRegionType & region,
+                     const TPredicate & isActive);
+
+  void PrintSelf(std::ostream & os, Indent indent) const;
+
+private:
+  ActiveVoxelBoxImageFilter(const Self &); //purposely not implemented
+  void operator=(const Self &); //purposely not implemented
+
+  static ITK_THREAD_RETURN_TYPE ActiveRunsThreaderCallback(void *arg);
+
+  void ThreadedComputeActiveChunks(ThreadIdType threadId);
+
+  NeighborhoodSpansType m_NeighborhoodSpans;
+  bool m_UseBallNeighborhood;
+
+  typename ActiveMaskImageType::ConstPointer m_ActiveMask;
+
+  bool m_UseActiveVoxelScheduling;
+  SizeValueType m_ChunkSize;
+  SizeValueType m_NumberOfActiveVoxels;
+
+  std::vector< OutputImageRegionType > m_ActiveRuns;
+  std::vector< size_t > m_ChunkStarts;
+  /** Active voxels in the chunks before each chunk. */
+  std::vector< SizeValueType > m_ChunkVoxelStarts;
+  size_t m_NextChunk;
+  SimpleFastMutexLock m_ChunkLock;
+};
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkActiveVoxelBoxImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,259 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkActiveVoxelBoxImageFilter_hxx
+#define __itkActiveVoxelBoxImageFilter_hxx
+#include "itkActiveVoxelBoxImageFilter.h"
+
+#include "itkImageLinearConstIteratorWithIndex.h"
+#include "itkMultiThreader.h"
+
+#include <algorithm>
+
+namespace itk
+{
+template< typename TInputImage, typename TOutputImage >
+ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::ActiveVoxelBoxImageFilter()
+{
+  m_UseActiveVoxelScheduling = true;
+  m_ChunkSize = 0;
+  m_NumberOfActiveVoxels = 0;
+  m_NextChunk = 0;
+  m_UseBallNeighborhood = false;
+  m_NeighborhoodSpans.SetBox(this->GetRadius());
+}
+
+template< typename TInputImage, typename TOutputImage >
+void ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::SetRadius(
+    const RadiusType & radius)
+{
+  if (m_UseBallNeighborhood || radius != this->GetRadius())
+  {
+    m_UseBallNeighborhood = false;
+    m_NeighborhoodSpans.SetBox(radius);
+    this->Modified();
+  }
+  Superclass::SetRadius(radius);
+}
+
+template< typename TInputImage, typename TOutputImage >
+void ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::SetBallRadius(
+    const BallRadiusType & radius)
+{
+  m_NeighborhoodSpans.SetBall(radius);
+  m_UseBallNeighborhood = true;
+  Superclass::SetRadius(m_NeighborhoodSpans.GetRadius());
+  this->Modified();
+}
+
+template< typename TInputImage, typename TOutputImage >
+template< typename TActivityImage, typename TPredicate >
+void ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::AddActiveRuns(
+    const TActivityImage * image, const OutputImageRegionType & region,
+    const TPredicate & isActive)
+{
+  ImageLinearConstIteratorWithIndex< TActivityImage > it(image, region);
+  it.SetDirection(0);
+  it.GoToBegin();
+
+  typedef ImageLinearConstIteratorWithIndex< ActiveMaskImageType > MaskIteratorType;
+  MaskIteratorType mit;
+  if (m_ActiveMask)
+  {
+    itkAssertOrThrowMacro(m_ActiveMask->GetBufferedRegion().IsInside(region),
+                          "Active mask does not cover the requested region.");
+    mit = MaskIteratorType(m_ActiveMask, region);
+    mit.SetDirection(0);
+    mit.GoToBegin();
+  }
+
+  OutputImageRegionType run;
+  OutputSizeType runSize;
+  runSize.Fill(1);
+  for (; !it.IsAtEnd(); it.NextLine())
+  {
+    SizeValueType length = 0;
+    while (true)
+    {
+      const bool atEnd = it.IsAtEndOfLine();
+      if (!atEnd && isActive(it.Get()) && (!m_ActiveMask || mit.Get()))
+      {
+        if (length == 0)
+        {
+          run.SetIndex(it.GetIndex());
+        }
+        ++length;
+      }
+      else if (length > 0)
+      {
+        runSize[0] = length;
+        run.SetSize(runSize);
+        m_ActiveRuns.push_back(run);
+        m_NumberOfActiveVoxels += length;
+        length = 0;
+      }
+      if (atEnd)
+      {
+        break;
+      }
+      ++it;
+      if (m_ActiveMask)
+      {
+        ++mit;
+      }
+    }
+    if (m_ActiveMask)
+    {
+      mit.NextLine();
+    }
+  }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::GenerateData()
+{
+  if (!m_UseActiveVoxelScheduling && !m_ActiveMask)
+  {
+    Superclass::GenerateData();
+    return;
+  }
+
+  this->AllocateOutputs();
+  this->BeforeThreadedGenerateData();
+
+  for (unsigned int i = 0; i < this->GetNumberOfIndexedOutputs(); i++)
+  {
+    OutputImageType * output = this->GetOutput(i);
+    OutputPixelType zero;
+    NumericTraits< OutputPixelType >::SetLength(
+        zero, output->GetNumberOfComponentsPerPixel());
+    zero = NumericTraits< OutputPixelType >::ZeroValue(zero);
+    output->FillBuffer(zero);
+  }
+
+  m_ActiveRuns.clear();
+  m_NumberOfActiveVoxels = 0;
+  this->ComputeActiveRuns(this->GetOutput()->GetRequestedRegion());
+
+  /*
+   * Group consecutive runs into chunks of about the same number of voxels.
+   * m_ChunkStarts ends with the total number of runs, m_ChunkVoxelStarts
+   * with the total number of active voxels.
+   */
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+  SizeValueType chunkSize = m_ChunkSize;
+  if (chunkSize == 0)
+  {
+    chunkSize = std::max< SizeValueType >(
+        1, m_NumberOfActiveVoxels / (16 * numberOfThreads));
+  }
+  m_ChunkStarts.clear();
+  m_ChunkStarts.push_back(0);
+  m_ChunkVoxelStarts.clear();
+  m_ChunkVoxelStarts.push_back(0);
+  SizeValueType chunkVoxels = 0;
+  SizeValueType voxels = 0;
+  for (size_t r = 0; r < m_ActiveRuns.size(); ++r)
+  {
+    chunkVoxels += m_ActiveRuns[r].GetNumberOfPixels();
+    voxels += m_ActiveRuns[r].GetNumberOfPixels();
+    if (chunkVoxels >= chunkSize)
+    {
+      m_ChunkStarts.push_back(r + 1);
+      m_ChunkVoxelStarts.push_back(voxels);
+      chunkVoxels = 0;
+    }
+  }
+  if (m_ChunkStarts.back() != m_ActiveRuns.size())
+  {
+    m_ChunkStarts.push_back(m_ActiveRuns.size());
+    m_ChunkVoxelStarts.push_back(voxels);
+  }
+  m_NextChunk = 0;
+
+  if (m_NumberOfActiveVoxels > 0)
+  {
+    this->GetMultiThreader()->SetNumberOfThreads(numberOfThreads);
+    this->GetMultiThreader()->SetSingleMethod(this->ActiveRunsThreaderCallback,
+                                              this);
+    this->GetMultiThreader()->SingleMethodExecute();
+  }
+
+  this->AfterThreadedGenerateData();
+
+  m_ActiveRuns.clear();
+  m_ChunkStarts.clear();
+  m_ChunkVoxelStarts.clear();
+}
+
+template< typename TInputImage, typename TOutputImage >
+ITK_THREAD_RETURN_TYPE ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::ActiveRunsThreaderCallback(
+    void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+      static_cast< MultiThreader::ThreadInfoStruct * >(arg);
+  Self * filter = static_cast< Self * >(info->UserData);
+  filter->ThreadedComputeActiveChunks(info->ThreadID);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template< typename TInputImage, typename TOutputImage >
+void ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::ThreadedComputeActiveChunks(
+    ThreadIdType threadId)
+{
+  const size_t numberOfChunks = m_ChunkStarts.size() - 1;
+  const double total = m_NumberOfActiveVoxels;
+  while (true)
+  {
+    m_ChunkLock.Lock();
+    const size_t chunk = m_NextChunk++;
+    m_ChunkLock.Unlock();
+    if (chunk >= numberOfChunks)
+    {
+      break;
+    }
+    /*
+     * Chunks are taken in order, so the chunks before this one are done or
+     * being done. Its progress is reported on top of them; ProgressReporter
+     * only reports from thread 0, which thus follows all threads.
+     */
+    const SizeValueType chunkVoxels = m_ChunkVoxelStarts[chunk + 1]
+        - m_ChunkVoxelStarts[chunk];
+    ProgressReporter progress(
+        this, threadId, chunkVoxels,
+        std::max< SizeValueType >(1, 100 * chunkVoxels / m_NumberOfActiveVoxels),
+        m_ChunkVoxelStarts[chunk] / total, chunkVoxels / total);
+    for (size_t r = m_ChunkStarts[chunk]; r < m_ChunkStarts[chunk + 1]; ++r)
+    {
+      this->ThreadedComputeRegion(m_ActiveRuns[r], threadId, progress);
+    }
+  }
+}
+
+template< typename TInputImage, typename TOutputImage >
+void ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::ThreadedGenerateData(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId)
+{
+  ProgressReporter progress(this, threadId,
+                            outputRegionForThread.GetNumberOfPixels());
+  this->ThreadedComputeRegion(outputRegionForThread, threadId, progress);
+}
+
+template< typename TInputImage, typename TOutputImage >
+void ActiveVoxelBoxImageFilter< TInputImage, TOutputImage >::PrintSelf(
+    std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Active voxel scheduling: "
+     << (m_UseActiveVoxelScheduling ? "Yes" : "No") << std::endl;
+  os << indent << "Chunk size: " << m_ChunkSize << std::endl;
+  os << indent << "Active mask: " << (m_ActiveMask ? "Yes" : "No")
+     << std::endl;
+  os << indent << "Ball neighborhood: "
+     << (m_UseBallNeighborhood ? "Yes" : "No") << std::endl;
+  os << indent << "Neighborhood size: "
+     << m_NeighborhoodSpans.GetNumberOfIndices() << std::endl;
+  os << indent << "Number of active voxels: " << m_NumberOfActiveVoxels
+     << std::endl;
+}
+} // end namespace itk
+
+#endif
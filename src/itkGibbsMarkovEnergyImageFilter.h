@@ -8,10 +8,17 @@
 #include "itkVectorImage.h"
 #include "itkVectorContainer.h"
 
+#include <vector>
+
 namespace itk
 {
 /** \class GibbsMarkovEnergyImageFilter
  * \brief Applies a GibbsMarkovEnergy filter to an image
+ *
+ * The energy of a class is the fraction of the neighbors of a voxel, center
+ * excluded, labeled with that class. The neighbor counts are box sums of one
+ * indicator image per class (SeparableBoxSum), so a voxel costs one read per
+ * class whatever the radius.
  * \endwiki
  */
 template< typename TInputImage, typename TProbabilityPrecision=float,
@@ -74,6 +81,9 @@ protected:
 
   virtual void GenerateOutputInformation();
 
+  void BeforeThreadedGenerateData();
+  void AfterThreadedGenerateData();
+
   void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
                             ThreadIdType threadId);
 
@@ -84,6 +94,10 @@ private:
   typedef typename InputClassContainerType::ConstIterator ClassIteratorType;
 
   typename InputClassContainerType::Pointer m_ClassIDs;
+
+  /** Number of neighbors, center included, with each class. */
+  typedef Image< unsigned int, InputImageDimension > CountImageType;
+  std::vector< typename CountImageType::Pointer > m_ClassCounts;
 };
 } // end namespace itk
 
@@ -4,12 +4,9 @@
 #define __itkGibbsMarkovEnergyImageFilter_hxx
 #include "itkGibbsMarkovEnergyImageFilter.h"
 
-#include "itkConstNeighborhoodIterator.h"
-#include "itkNeighborhoodInnerProduct.h"
 #include "itkImageRegionIterator.h"
-#include "itkNeighborhoodAlgorithm.h"
-#include "itkOffset.h"
 #include "itkProgressReporter.h"
+#include "itkSeparableBoxSum.h"
 
 #include <vector>
 #include <algorithm>
@@ -50,89 +47,91 @@ void GibbsMarkovEnergyImageFilter< TInputImage, TProbabilityPrecision,
   m_ClassIDs->Initialize();
 }
 
+template< typename TInputImage, typename TProbabilityPrecision,
+    typename TOutputImage >
+void GibbsMarkovEnergyImageFilter< TInputImage, TProbabilityPrecision,
+    TOutputImage >::BeforeThreadedGenerateData()
+{
+  typename InputImageType::ConstPointer input = this->GetInput();
+  const InputImageRegionType region = input->GetBufferedRegion();
+
+  m_ClassCounts.clear();
+  for (ClassIteratorType clsIt = m_ClassIDs->Begin();
+      clsIt != m_ClassIDs->End(); ++clsIt)
+  {
+    typename CountImageType::Pointer counts = CountImageType::New();
+    counts->CopyInformation(input);
+    counts->SetRegions(region);
+    counts->Allocate();
+
+    ImageRegionConstIterator< InputImageType > iit(input, region);
+    ImageRegionIterator< CountImageType > cit(counts, region);
+    for (; !iit.IsAtEnd(); ++iit, ++cit)
+    {
+      cit.Set(iit.Get() == clsIt.Value() ? 1 : 0);
+    }
+    SeparableBoxSum(counts.GetPointer(), this->GetRadius());
+    m_ClassCounts.push_back(counts);
+  }
+}
+
+template< typename TInputImage, typename TProbabilityPrecision,
+    typename TOutputImage >
+void GibbsMarkovEnergyImageFilter< TInputImage, TProbabilityPrecision,
+    TOutputImage >::AfterThreadedGenerateData()
+{
+  m_ClassCounts.clear();
+}
+
 template< typename TInputImage, typename TProbabilityPrecision,
     typename TOutputImage >
 void GibbsMarkovEnergyImageFilter< TInputImage, TProbabilityPrecision,
     TOutputImage >::ThreadedGenerateData(
     const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId)
 {
-  // Allocate output
   typename OutputImageType::Pointer output = this->GetOutput();
   typename InputImageType::ConstPointer input = this->GetInput();
 
-  // Find the data-set boundary "faces"
-  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType > bC;
-  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
-      bC(input, outputRegionForThread, this->GetRadius());
-
   // support progress methods/callbacks
   ProgressReporter progress(this, threadId,
                             outputRegionForThread.GetNumberOfPixels());
 
-  ZeroFluxNeumannBoundaryCondition< InputImageType > nbc;
-
+  const unsigned int nClass = this->GetNumberOfClasses();
   OutputPixelType outpix;
-  NumericTraits< OutputPixelType >::SetLength(outpix,
-                                              this->GetNumberOfClasses());
+  NumericTraits< OutputPixelType >::SetLength(outpix, nClass);
 
-  ClassIteratorType clsIt = m_ClassIDs->Begin();
-  ClassIteratorType clsEnd = m_ClassIDs->End();
-
-  // Process each of the boundary faces.  These are N-d regions which border
-  // the edge of the buffer.
-  for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
-      InputImageType >::FaceListType::iterator fit = faceList.begin();
-      fit != faceList.end(); ++fit)
+  SizeValueType neighborhoodSize = 1;
+  for (unsigned int d = 0; d < InputImageDimension; d++)
   {
-    ImageRegionIterator< OutputImageType > it = ImageRegionIterator<
-        OutputImageType >(output, *fit);
-
-    ConstNeighborhoodIterator< InputImageType > bit = ConstNeighborhoodIterator<
-        InputImageType >(this->GetRadius(), input, *fit);
-    bit.OverrideBoundaryCondition(&nbc);
-    bit.GoToBegin();
-    const unsigned int neighborhoodSize = bit.Size();
-    TProbabilityPrecision bitInc = 1.0
-        / static_cast< TProbabilityPrecision >(neighborhoodSize-1);
-    while (!bit.IsAtEnd())
-    {
-      // collect all the pixels in the neighborhood, note that we use
-      // GetPixel on the NeighborhoodIterator to honor the boundary conditions
-
-      for (clsIt = m_ClassIDs->Begin(); clsIt != clsEnd; ++clsIt)
-      {
-        outpix[clsIt.Index()] = 0;
-        if (bit.GetCenterPixel() == clsIt.Value())
-        {
-          outpix[clsIt.Index()] = -bitInc;
-        }
-      }
+    neighborhoodSize *= 2 * this->GetRadius()[d] + 1;
+  }
+  const TProbabilityPrecision bitInc = 1.0
+      / static_cast< TProbabilityPrecision >(neighborhoodSize - 1);
 
-      for (unsigned int i = 0; i < neighborhoodSize; ++i)
-      {
-        for (clsIt = m_ClassIDs->Begin(); clsIt != clsEnd; ++clsIt)
-        {
-          if (bit.GetPixel(i) == clsIt.Value())
-          {
-            outpix[clsIt.Index()] += bitInc;
-          }
-        }
-      }
+  std::vector< ImageRegionConstIterator< CountImageType > > countIts;
+  for (unsigned int c = 0; c < nClass; c++)
+  {
+    countIts.push_back(ImageRegionConstIterator< CountImageType >(
+        m_ClassCounts[c], outputRegionForThread));
+  }
 
-      /*
-      for (clsIt = m_ClassIDs->Begin(); clsIt != clsEnd; ++clsIt)
+  ImageRegionConstIterator< InputImageType > iit(input, outputRegionForThread);
+  ImageRegionIterator< OutputImageType > it(output, outputRegionForThread);
+  for (; !it.IsAtEnd(); ++iit, ++it)
+  {
+    const InputPixelType center = iit.Get();
+    for (unsigned int c = 0; c < nClass; c++)
+    {
+      unsigned int count = countIts[c].Get();
+      if (center == m_ClassIDs->ElementAt(c))
       {
-        outpix[clsIt.Index()] = exp(outpix[clsIt.Index()]);
+        --count;
       }
-      */
-
-      bit.GetCenterPixel();
-      it.Set(outpix);
-
-      ++bit;
-      ++it;
-      progress.CompletedPixel();
+      outpix[c] = count * bitInc;
+      ++countIts[c];
     }
+    it.Set(outpix);
+    progress.CompletedPixel();
   }
 }
 } // end namespace itk
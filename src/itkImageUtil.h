@@ -7,6 +7,7 @@
 #include "itkObjectFactory.h"
 #include "itkImageSource.h"
 #include "itkMaskImageFilter.h"
+#include "itkFixedArray.h"
 
 #include <string>
 #include <vector>
@@ -37,6 +38,12 @@ public:
   typedef typename ImageType::SizeType SizeType;
   typedef typename ImageType::SizeValueType SizeValueType;
 
+  /** 1/0 mask on the grid of the image. */
+  typedef Image< unsigned char, TImage::ImageDimension > LabelImageType;
+
+  /** Semi-axes of a ball in voxels. */
+  typedef FixedArray< double, TImage::ImageDimension > BallRadiusType;
+
   /** Method for creation through the object factory. */
   itkNewMacro(Self)
   /** Run-time type information (and related methods). */
@@ -60,6 +67,9 @@ public:
   static SizeType
   GetRadiusFromPhysicalSize(const ImageType* img, float r);
 
+  static BallRadiusType
+  GetBallRadiusFromPhysicalSize(const ImageType* img, float r);
+
   static float
   GetPhysicalPixelSize(const ImageType* img);
 
@@ -85,9 +95,18 @@ public:
   static ImagePointer
   Mask(const ImageType* img, const ImageType* mask, float background = 0);
 
+  static ImagePointer
+  MaskWithLabel(const ImageType* img, const LabelImageType* mask,
+                float background = 0);
+
   static void ImageExtent(const ImageType* img, PixelType& minValue,
                    PixelType& maxValue, double quantile = 0.01);
 
+  /** Rescale so that the quantile and 1 - quantile of ImageExtent map to 0
+   * and 1, which puts images of different subjects on one scale. */
+  static ImagePointer
+  NormalizeExtent(const ImageType* img, double quantile = 0.01);
+
 protected:
   ImageUtil()
   {
@@ -17,6 +17,7 @@
 #include "itkBinaryMorphologicalOpeningImageFilter.h"
 
 #include "itkImageToHistogramFilter.h"
+#include "itkShiftScaleImageFilter.h"
 
 namespace itk
 {
@@ -144,6 +145,18 @@ typename ImageUtil< TImage >::SizeType ImageUtil< TImage >::GetRadiusFromPhysica
   return radius;
 }
 
+template< typename TImage >
+typename ImageUtil< TImage >::BallRadiusType ImageUtil< TImage >::GetBallRadiusFromPhysicalSize(
+    const TImage* img, float r)
+{
+  BallRadiusType radius;
+  for (unsigned int i = 0; i < ImageDimension; i++)
+  {
+    radius[i] = r / img->GetSpacing()[i];
+  }
+  return radius;
+}
+
 template< typename TImage >
 float ImageUtil< TImage >::GetPhysicalPixelSize(const TImage* img)
 {
@@ -261,6 +274,19 @@ typename ImageUtil< TImage >::ImagePointer ImageUtil< TImage >::Mask(
   return output;
 }
 
+template< typename TImage >
+typename ImageUtil< TImage >::ImagePointer ImageUtil< TImage >::MaskWithLabel(
+    const ImageType* img, const LabelImageType* mask, float background)
+{
+  typedef MaskImageFilter< TImage, LabelImageType, TImage > MaskType;
+  typename MaskType::Pointer maskFilter = MaskType::New();
+  maskFilter->SetInput(img);
+  maskFilter->SetMaskImage(mask);
+  maskFilter->SetOutsideValue(background);
+  ImagePointer output = Self::GraftOutput(maskFilter, 0);
+  return output;
+}
+
 template< typename TImage >
 void ImageUtil< TImage >::ImageExtent(const ImageType* img, PixelType& minValue,
                                       PixelType& maxValue, double quantile)
@@ -283,6 +309,24 @@ void ImageUtil< TImage >::ImageExtent(const ImageType* img, PixelType& minValue,
   maxValue = hist->Quantile(0, 1 - quantile);
 }
 
+template< typename TImage >
+typename ImageUtil< TImage >::ImagePointer ImageUtil< TImage >::NormalizeExtent(
+    const ImageType* img, double quantile)
+{
+  PixelType minValue;
+  PixelType maxValue;
+  Self::ImageExtent(img, minValue, maxValue, quantile);
+  itkAssertOrThrowMacro(maxValue > minValue, "Image extent is empty.");
+
+  typedef ShiftScaleImageFilter< TImage, TImage > ShiftScaleType;
+  typename ShiftScaleType::Pointer shiftScale = ShiftScaleType::New();
+  shiftScale->SetInput(img);
+  shiftScale->SetShift(-static_cast< double >(minValue));
+  shiftScale->SetScale(1.0 / (static_cast< double >(maxValue) - minValue));
+  ImagePointer output = Self::GraftOutput(shiftScale, 0);
+  return output;
+}
+
 } // end namespace itk
 
 #endif
@@ -12,13 +12,21 @@
 
 #include "itkMAPMarkovImageFilter.h"
 #include "itkImageToWeightedHistogramFilter.h"
+#include "itkMultiClassWeightedHistogramCalculator.h"
 #include "itkEmpiricalDensityMembershipFunction.h"
 
+#include <vector>
+
 namespace itk
 {
 
 /** \class IterativeBayesianImageFilter
  * \brief composite ITK filter for MAP classification with Markov field
+ *
+ * Each iteration classifies with the memberships, then estimates them again
+ * from the classes. The iterations stop early once the fraction of voxels that
+ * changed class is at most ConvergenceThreshold; the number of changed voxels
+ * of every iteration is kept for reporting.
  */
 
 template <class TImage, class TClassificationImage=TImage,class TProbabilityPrecision=float>
@@ -72,6 +80,11 @@ public:
       EmpiricalDistributionMembershipType, TProbabilityPrecision,
       MembershipsVectorImageType > MembershipFilterType;
 
+  /** Histograms of every class from one pass; the same as
+   * WeightedHistogramType run once per class. */
+  typedef Statistics::MultiClassWeightedHistogramCalculator< ImageType,
+      PriorPixelType, ClassifierOutputImageType > ClassHistogramCalculatorType;
+
   void SetPriorVectorImage( const PriorsVectorImageType *image)
     {
     this->ProcessObject::SetNthInput( 1, const_cast< PriorsVectorImageType * >( image ) );
@@ -99,6 +112,22 @@ public:
   itkSetMacro(PriorBias, float);
   itkGetMacro(PriorBias, float);
 
+  /** Fraction of voxels changing class at which the iterations stop; 0, the
+   * default, stops once no voxel changes, which does not alter the result. */
+  itkSetMacro(ConvergenceThreshold, double);
+  itkGetConstMacro(ConvergenceThreshold, double);
+
+  /** Iterations run by the last update. */
+  unsigned int GetNumberOfElapsedIterations() const
+  {
+    return m_ChangedLabels.size();
+  }
+  /** Voxels that changed class in an iteration of the last update. */
+  SizeValueType GetNumberOfChangedLabels(unsigned int iteration) const
+  {
+    return m_ChangedLabels[iteration];
+  }
+
 protected:
 
   IterativeBayesianImageFilter();
@@ -110,10 +139,6 @@ protected:
   void PrintSelf( std::ostream& os, Indent indent ) const;
 
 private:
-  typedef Functor::Equal<ClassificationPixelType,ClassificationPixelType,ClassificationPixelType> ClassSelectorFunctor;
-  typedef BinaryFunctorImageFilter<ClassifierOutputImageType,ClassifierOutputImageType, ClassifierOutputImageType, ClassSelectorFunctor> ClassSelectorFilter;
-  typedef MaskImageFilter<ClassifierOutputImageType,PriorImageType,MembershipsImageType> MaskPriorFilter;
-  typedef itk::VectorIndexSelectionCastImageFilter< PriorsVectorImageType, PriorImageType > PriorSelectorImageFilterType;
 
   typedef typename EmpiricalDistributionMembershipType::Pointer MembershipFunctionPointer;
 
@@ -128,6 +153,8 @@ private:
   MembershipFunctionContainerPointer m_MembershipFunctions;
   unsigned int m_NumberOfClasses;
   float m_PriorBias;
+  double m_ConvergenceThreshold;
+  std::vector< SizeValueType > m_ChangedLabels;
 
 }; // end of class
 
@@ -5,6 +5,8 @@
 
 #include "itkIterativeBayesianImageFilter.h"
 
+#include "itkImageRegionConstIterator.h"
+
 namespace itk
 {
 
@@ -17,6 +19,7 @@ IterativeBayesianImageFilter< TImage, TClassificationImage,
   m_MembershipFunctions = MembershipFunctionContainerType::New();
   m_MembershipFunctions->Initialize(); // Clear elements
   m_NumberOfClasses = 0;
+  m_ConvergenceThreshold = 0;
 }
 
 template< class TImage, class TClassificationImage, class TProbabilityPrecision >
@@ -42,11 +45,16 @@ void IterativeBayesianImageFilter< TImage, TClassificationImage,
   MAPMarkovFilter->SetPriorBias(this->GetPriorBias());
   MAPMarkovFilter->SetNumberOfIterations(1);
 
-  typename MaskPriorFilter::Pointer maskWeights = MaskPriorFilter::New();
-  typename ClassSelectorFilter::Pointer classSelector = ClassSelectorFilter::New();
-  typename PriorSelectorImageFilterType::Pointer classPriorSelector =
-      PriorSelectorImageFilterType::New();
-  classPriorSelector->SetInput(this->GetPriorVectorImage());
+  /*
+   * A class is estimated from the voxels labeled with it where its prior is
+   * not zero.
+   */
+  typename ClassHistogramCalculatorType::Pointer classHistograms =
+      ClassHistogramCalculatorType::New();
+  classHistograms->SetInput(this->GetInput());
+  classHistograms->SetWeightVectorImage(this->GetPriorVectorImage());
+  classHistograms->BinaryWeightsOn();
+  classHistograms->SetHistogramSize(size);
 
   membershipFilter->ClearMembershipFunctions();
   for (unsigned int i = 0; i < m_NumberOfClasses; ++i)
@@ -54,42 +62,61 @@ void IterativeBayesianImageFilter< TImage, TClassificationImage,
     membershipFilter->AddMembershipFunction(
         m_MembershipFunctions->GetElement(i));
   }
+  MAPMarkovFilter->SetMembershipVectorImage(membershipFilter->GetOutput());
+  MAPMarkovFilter->Update();
+  typename ClassifierOutputImageType::Pointer lastSeg = MAPMarkovFilter->GetOutput();
+  lastSeg->DisconnectPipeline();
+
+  const SizeValueType numberOfPixels =
+      lastSeg->GetBufferedRegion().GetNumberOfPixels();
+  m_ChangedLabels.clear();
   for (unsigned int iteration = 0; iteration < m_NumberOfIterations; iteration++)
   {
-    MAPMarkovFilter->SetMembershipVectorImage(membershipFilter->GetOutput());
-    MAPMarkovFilter->Update();
-    typename ClassifierOutputImageType::Pointer lastSeg = MAPMarkovFilter->GetOutput();
-    lastSeg->DisconnectPipeline();
+    classHistograms->SetLabelImage(lastSeg);
+    classHistograms->Compute();
     membershipFilter->ClearMembershipFunctions();
-    classSelector->SetInput1(lastSeg);
-
-    for (ClassificationPixelType i = 0; i < m_NumberOfClasses; ++i)
+    for (unsigned int i = 0; i < m_NumberOfClasses; ++i)
     {
-      typename WeightedHistogramType::Pointer hist =
-          WeightedHistogramType::New();
       typename EmpiricalDistributionMembershipType::Pointer membership =
           EmpiricalDistributionMembershipType::New();
-
-      classPriorSelector->SetIndex(i);
-      classSelector->SetConstant2(i);
-      maskWeights->SetInput(classSelector->GetOutput());
-      maskWeights->SetMaskImage(classPriorSelector->GetOutput());
-      maskWeights->Update();
-      hist->SetWeightImage(maskWeights->GetOutput());
-      hist->SetInput(this->GetInput());
-      hist->SetAutoMinimumMaximum(true);
-      hist->SetHistogramSize(size);
-      hist->Update();
-      membership->SetDistribution(hist->GetOutput());
+      membership->SetDistribution(classHistograms->GetHistogram(i));
       membershipFilter->AddMembershipFunction(membership);
     }
+
+    MAPMarkovFilter->SetMembershipVectorImage(membershipFilter->GetOutput());
+    MAPMarkovFilter->Update();
+    typename ClassifierOutputImageType::Pointer seg = MAPMarkovFilter->GetOutput();
+    seg->DisconnectPipeline();
+
     /*
-     * Calculate the difference between previous and current distribution
+     * Calculate the difference between previous and current classification;
+     * unchanged classes give unchanged memberships, so nothing would change
+     * any more.
      */
+    SizeValueType changed = 0;
+    ImageRegionConstIterator< ClassifierOutputImageType > lit(
+        lastSeg, lastSeg->GetBufferedRegion());
+    ImageRegionConstIterator< ClassifierOutputImageType > sit(
+        seg, lastSeg->GetBufferedRegion());
+    for (; !lit.IsAtEnd(); ++lit, ++sit)
+    {
+      if (lit.Get() != sit.Get())
+      {
+        ++changed;
+      }
+    }
+    m_ChangedLabels.push_back(changed);
+    itkDebugMacro(<< "Iteration " << iteration + 1 << ": " << changed
+                  << " voxels changed class");
+    this->InvokeEvent(IterationEvent());
+
+    lastSeg = seg;
+    if (changed <= m_ConvergenceThreshold * numberOfPixels)
+    {
+      break;
+    }
   }
-  MAPMarkovFilter->SetMembershipVectorImage(membershipFilter->GetOutput());
-  MAPMarkovFilter->Update();
-  this->GraftOutput(MAPMarkovFilter->GetOutput());
+  this->GraftOutput(lastSeg);
 }
 
 template< class TImage, class TClassificationImage, class TProbabilityPrecision >
@@ -101,6 +128,8 @@ void IterativeBayesianImageFilter< TImage, TClassificationImage,
   os << indent << "Iterations: " << m_NumberOfIterations << std::endl;
   os << indent << "Prior bias: " << m_PriorBias << std::endl;
   os << indent << "Number of classes: " << m_NumberOfClasses << std::endl;
+  os << indent << "Convergence threshold: " << m_ConvergenceThreshold
+     << std::endl;
 }
 
 } // end namespace itk
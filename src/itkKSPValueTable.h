@@ -0,0 +1,285 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkKSPValueTable_h
+#define __itkKSPValueTable_h
+
+#include "itkObject.h"
+#include "itkSimpleFastMutexLock.h"
+#include "vcl_cmath.h"
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class KSPValueTable
+ * \brief Null distribution of the two sample KS statistic, tabulated per pair
+ * of sample sizes.
+ *
+ * GetPValue() returns the probability of a statistic at least as large as D
+ * for samples of sizes n and m. Prepare() builds the tables of every n up to
+ * a maximum for one m before the threads start; those are then read without
+ * locking. Any other table is built under a lock the first time it is asked
+ * for and reused afterwards. GetPValue() may be called from several threads.
+ *
+ * With Exact set and n*m not above the exact limit (2500 by default), the
+ * table holds the exact probability for every attainable statistic, counted
+ * over the lattice paths of the merged samples. Building it costs (n*m)^2, so
+ * against a reference of thousands of values only tiny samples are exact. Otherwise the asymptotic distribution with Stephens'
+ * small sample correction is tabulated on a grid of D and interpolated.
+ */
+class KSPValueTable
+{
+public:
+  KSPValueTable()
+  {
+    m_Exact = false;
+    m_ExactLimit = 2500;
+    m_GridSize = 1024;
+    m_PreparedM = 0;
+    m_PreparedTwoSided = false;
+    m_ExactWarned = false;
+  }
+
+  /** Changing a setting clears the tables. */
+  void SetExact(bool exact)
+  {
+    m_Lock.Lock();
+    if (m_Exact != exact)
+    {
+      m_Exact = exact;
+      m_Tables.clear();
+      m_Prepared.clear();
+    }
+    m_Lock.Unlock();
+  }
+  bool GetExact() const
+  {
+    return m_Exact;
+  }
+
+  /** Largest n*m for which the exact table is built. */
+  void SetExactLimit(size_t limit)
+  {
+    m_Lock.Lock();
+    if (m_ExactLimit != limit)
+    {
+      m_ExactLimit = limit;
+      m_Tables.clear();
+      m_Prepared.clear();
+    }
+    m_Lock.Unlock();
+  }
+  size_t GetExactLimit() const
+  {
+    return m_ExactLimit;
+  }
+
+  void Clear()
+  {
+    m_Lock.Lock();
+    m_Tables.clear();
+    m_Prepared.clear();
+    m_Lock.Unlock();
+  }
+
+  /** Build the tables of sizes 1 to maximumN against m. Must not run
+   * concurrently with GetPValue(). Warns once when Exact is set but some of
+   * the sizes exceed the exact limit and get the asymptotic table. */
+  void Prepare(size_t maximumN, size_t m, bool twoSided)
+  {
+    m_Lock.Lock();
+    if (m_Exact && maximumN * m > m_ExactLimit && !m_ExactWarned)
+    {
+      m_ExactWarned = true;
+      itkGenericOutputMacro(
+          "Exact KS p-values are limited to n*m <= " << m_ExactLimit
+          << "; against a reference of " << m << " values only samples of at most "
+          << m_ExactLimit / m << " values are exact, larger ones use the asymptotic distribution.");
+    }
+    if (m_Prepared.size() != maximumN + 1 || m_PreparedM != m
+        || m_PreparedTwoSided != twoSided)
+    {
+      m_Prepared.clear();
+      m_Prepared.resize(maximumN + 1);
+      m_PreparedM = m;
+      m_PreparedTwoSided = twoSided;
+      for (size_t n = 1; n <= maximumN && m > 0; n++)
+      {
+        this->BuildTable(n, m, twoSided, m_Prepared[n]);
+      }
+    }
+    m_Lock.Unlock();
+  }
+
+  /** P(D >= d) for samples of sizes n and m under the null hypothesis; one
+   * sided D+ (or D-) unless twoSided. */
+  double GetPValue(size_t n, size_t m, double d, bool twoSided) const
+  {
+    if (n == 0 || m == 0 || d <= 0)
+    {
+      return 1;
+    }
+    if (d > 1)
+    {
+      d = 1;
+    }
+    const TableType & table =
+        m == m_PreparedM && twoSided == m_PreparedTwoSided && n < m_Prepared.size() ?
+            m_Prepared[n] : this->GetTable(n, m, twoSided);
+    const double x = d * table.Scale;
+    if (table.Exact)
+    {
+      const size_t c = static_cast< size_t >(x + 0.5);
+      return table.PValues[std::min(c, table.PValues.size() - 1)];
+    }
+    const size_t i = std::min(static_cast< size_t >(x), table.PValues.size() - 2);
+    const double w = x - i;
+    return (1 - w) * table.PValues[i] + w * table.PValues[i + 1];
+  }
+
+private:
+  struct TableType
+  {
+    bool Exact;
+    double Scale;
+    std::vector< double > PValues;
+  };
+  typedef std::pair< std::pair< size_t, size_t >, bool > KeyType;
+  typedef std::map< KeyType, TableType > TableMapType;
+
+  /** Tables are never modified once built and map nodes do not move, so the
+   * returned reference stays valid after the lock is released. */
+  const TableType & GetTable(size_t n, size_t m, bool twoSided) const
+  {
+    const KeyType key(std::make_pair(n, m), twoSided);
+    m_Lock.Lock();
+    TableMapType::iterator it = m_Tables.find(key);
+    if (it == m_Tables.end())
+    {
+      this->BuildTable(n, m, twoSided, m_Tables[key]);
+      it = m_Tables.find(key);
+    }
+    const TableType & table = it->second;
+    m_Lock.Unlock();
+    return table;
+  }
+
+  void BuildTable(size_t n, size_t m, bool twoSided, TableType & table) const
+  {
+    if (m_Exact && n * m <= m_ExactLimit)
+    {
+      this->BuildExact(n, m, twoSided, table);
+    }
+    else
+    {
+      this->BuildAsymptotic(n, m, twoSided, table);
+    }
+  }
+
+  /**
+   * The statistic is c/(n*m) for an integer c. P(D < c/(n*m)) is the
+   * probability that the merged path from (0,0) to (n,m), taking n steps in i
+   * and m in j in random order, keeps i*m - j*n (or its absolute value) below
+   * c.
+   */
+  void BuildExact(size_t n, size_t m, bool twoSided, TableType & table) const
+  {
+    const long nm = static_cast< long >(n * m);
+    const long N = static_cast< long >(n + m);
+    table.Exact = true;
+    table.Scale = static_cast< double >(nm);
+    table.PValues.resize(nm + 1);
+    std::vector< double > row(m + 1);
+    for (long c = 0; c <= nm; c++)
+    {
+      for (long i = 0; i <= static_cast< long >(n); i++)
+      {
+        for (long j = 0; j <= static_cast< long >(m); j++)
+        {
+          const long diff = i * static_cast< long >(m) - j * static_cast< long >(n);
+          const bool inside = twoSided ? (diff < c && -diff < c) : diff < c;
+          double p = 0;
+          if (inside)
+          {
+            if (i == 0 && j == 0)
+            {
+              p = 1;
+            }
+            else
+            {
+              const long before = N - (i + j) + 1;
+              if (i > 0)
+              {
+                p += row[j] * static_cast< double >(static_cast< long >(n) - i + 1) / before;
+              }
+              if (j > 0)
+              {
+                p += row[j - 1] * static_cast< double >(static_cast< long >(m) - j + 1) / before;
+              }
+            }
+          }
+          row[j] = p;
+        }
+      }
+      table.PValues[c] = std::max(0.0, std::min(1.0, 1 - row[m]));
+    }
+  }
+
+  void BuildAsymptotic(size_t n, size_t m, bool twoSided, TableType & table) const
+  {
+    const double ne = static_cast< double >(n) * m / (n + m);
+    const double sq = vcl_sqrt(ne);
+    const double factor = sq + 0.12 + 0.11 / sq;
+    table.Exact = false;
+    table.Scale = m_GridSize;
+    table.PValues.resize(m_GridSize + 1);
+    for (size_t g = 0; g <= m_GridSize; g++)
+    {
+      const double lambda = factor * g / m_GridSize;
+      double p;
+      if (!twoSided)
+      {
+        p = vcl_exp(-2 * lambda * lambda);
+      }
+      else if (lambda < 0.3)
+      {
+        p = 1;
+      }
+      else
+      {
+        p = 0;
+        double sign = 2;
+        for (int k = 1; k <= 100; k++)
+        {
+          const double term = sign * vcl_exp(-2.0 * k * k * lambda * lambda);
+          p += term;
+          if (vcl_fabs(term) < 1e-12)
+          {
+            break;
+          }
+          sign = -sign;
+        }
+      }
+      table.PValues[g] = std::max(0.0, std::min(1.0, p));
+    }
+  }
+
+  bool m_Exact;
+  size_t m_ExactLimit;
+  size_t m_GridSize;
+  mutable TableMapType m_Tables;
+  /** Tables of Prepare(), indexed by n; read without the lock. */
+  std::vector< TableType > m_Prepared;
+  size_t m_PreparedM;
+  bool m_PreparedTwoSided;
+  bool m_ExactWarned;
+  mutable SimpleFastMutexLock m_Lock;
+};
+} // end of namespace Statistics
+} // end of namespace itk
+
+#endif
@@ -9,6 +9,7 @@
 #include "vcl_algorithm.h"
 
 #include "itkStatisticalTestBase.h"
+#include "itkKSPValueTable.h"
 namespace itk
 {
 namespace Statistics
@@ -39,24 +40,21 @@ public:
   typedef typename SubSampleType1::ConstIterator SubsampleConstIter1;
   typedef typename SubSampleType2::ConstIterator SubsampleConstIter2;
 
+  typedef typename Superclass::ScratchType ScratchType;
+
   virtual TRealValueType Evaluate(const SampleType1 * x1, const SampleType2 * x2) const
   {
-    typename SubSampleType1::Pointer subsample1 = SubSampleType1::New();
-    subsample1->SetSample(x1);
-    subsample1->InitializeWithAllInstances();
-
-    typename SubSampleType2::Pointer subsample2 = SubSampleType2::New();
-    subsample2->SetSample(x2);
-    subsample2->InitializeWithAllInstances();
+    ScratchType scratch;
+    return this->Evaluate(x1, x2, scratch);
+  }
 
-    if (!this->GetSortedFirst())
-    {
-      Algorithm::HeapSort<SubSampleType1>(subsample1, 0, 0, subsample1->Size());
-    }
-    if (!this->GetSortedSecond())
-    {
-      Algorithm::HeapSort<SubSampleType2>(subsample2, 0, 0, subsample2->Size());
-    }
+  virtual TRealValueType Evaluate(const SampleType1 * x1, const SampleType2 * x2,
+                                  ScratchType & scratch) const
+  {
+    this->PrepareScratch(x1, x2, this->GetSortedFirst(),
+                         this->GetSortedSecond(), scratch);
+    const SubSampleType1 * subsample1 = scratch.Subsample1;
+    const SubSampleType2 * subsample2 = scratch.Subsample2;
 
     TRealValueType step1 = 1.0 / subsample1->GetTotalFrequency();
     TRealValueType step2 = 1.0 / subsample2->GetTotalFrequency();
@@ -76,6 +74,15 @@ public:
     TRealValueType last1=it1.GetMeasurementVector()[0];
     TRealValueType last2=it2.GetMeasurementVector()[0];
 
+    /*
+     * Statistics only grow along the merge. D+ can still reach 1 - cdf2 and
+     * D- can still reach 1 - cdf1, which bounds the final statistic for the
+     * decision mode.
+     */
+    const bool decide = this->GetDecisionMode() != Superclass::NoDecision
+        && !m_ComputePValue;
+    TRealValueType decision;
+
     while (it2 != it2End)
       {
       while (it1 != it1End)
@@ -95,6 +102,14 @@ public:
       dp = vcl_max(dp, cdf1 - cdf2);
       dn = vcl_max(dn, cdf2 - cdf1);
       ++it2;
+      if (decide
+          && this->Decide(this->KSStatistics(dn, dp),
+                          this->KSStatistics(vcl_max(dn, 1 - cdf1),
+                                             vcl_max(dp, 1 - cdf2)),
+                          decision))
+        {
+        return decision;
+        }
       }
 
     while (it1 != it1End)
@@ -106,7 +121,91 @@ public:
       ++it1;
       }
 
-    return this->KSStatistics(dn,dp);
+    if (m_ComputePValue)
+    {
+      const size_t n = static_cast< size_t >(subsample2->GetTotalFrequency() + 0.5);
+      const size_t m = static_cast< size_t >(subsample1->GetTotalFrequency() + 0.5);
+      return m_PValueTable.GetPValue(n, m, this->KSStatistics(dn, dp),
+                                     this->GetTwoTail());
+    }
+    return this->DecisionOutput(this->KSStatistics(dn,dp));
+  }
+
+  /** Builds the p-value tables of every neighborhood size. */
+  virtual void PrepareEvaluation(const SampleType1 * x1, SizeValueType maximumSize2)
+  {
+    if (m_ComputePValue)
+    {
+      m_PValueTable.Prepare(maximumSize2,
+                            static_cast< size_t >(x1->GetTotalFrequency() + 0.5),
+                            this->GetTwoTail());
+    }
+  }
+
+  virtual bool SupportsHistogram() const
+  {
+    return true;
+  }
+
+  /**
+   * Evaluate() adds the values of the first sample below a value of the
+   * second sample before it, so within a bin the second sample comes
+   * first: D+ is reached after whole bins and D- before the bin of the
+   * first sample is added.
+   */
+  virtual TRealValueType EvaluateHistogram(const TRealValueType * frequency1,
+                                           const TRealValueType & total1,
+                                           const TRealValueType * frequency2,
+                                           const TRealValueType & total2,
+                                           unsigned int numberOfBins) const
+  {
+    const TRealValueType step1 = 1.0 / total1;
+    const TRealValueType step2 = 1.0 / total2;
+    TRealValueType cdf1 = 0;
+    TRealValueType cdf2 = 0;
+    TRealValueType dp = 0;
+    TRealValueType dn = 0;
+    for (unsigned int b = 0; b < numberOfBins; b++)
+      {
+      cdf2 += step2 * frequency2[b];
+      dn = vcl_max(dn, cdf2 - cdf1);
+      cdf1 += step1 * frequency1[b];
+      dp = vcl_max(dp, cdf1 - cdf2);
+      }
+
+    if (m_ComputePValue)
+    {
+      return m_PValueTable.GetPValue(static_cast< size_t >(total2 + 0.5),
+                                     static_cast< size_t >(total1 + 0.5),
+                                     this->KSStatistics(dn, dp),
+                                     this->GetTwoTail());
+    }
+    return this->DecisionOutput(this->KSStatistics(dn, dp));
+  }
+
+  virtual bool SupportsBatch() const
+  {
+    return true;
+  }
+
+  virtual void EvaluateBatch(const float * values1,
+                             const TRealValueType * frequencies1,
+                             SizeValueType size1, const float * values2,
+                             const SizeValueType * offsets2, SizeValueType count,
+                             TRealValueType * output) const
+  {
+    this->EvaluateBatchKernel(values1, frequencies1, size1, values2, offsets2,
+                              count, output);
+  }
+
+  virtual void EvaluateBatch(const double * values1,
+                             const TRealValueType * frequencies1,
+                             SizeValueType size1, const double * values2,
+                             const SizeValueType * offsets2, SizeValueType count,
+                             TRealValueType * output) const
+  {
+    this->EvaluateBatchKernel(values1, frequencies1, size1, values2, offsets2,
+                              count, output);
   }
 
   inline TRealValueType KSStatistics(const TRealValueType& dn, const TRealValueType& dp) const
@@ -137,11 +236,33 @@ public:
   itkSetMacro(SortedSecond, bool);
   itkBooleanMacro(SortedSecond);
 
+  /** Return the p-value of the statistic instead of the statistic. Small
+   * values are significant. The decision mode does not apply to p-values. */
+  itkGetConstMacro(ComputePValue, bool);
+  itkSetMacro(ComputePValue, bool);
+  itkBooleanMacro(ComputePValue);
+
+  /** Use exact p-values where the sample sizes allow it. */
+  virtual bool GetExactPValue() const
+  {
+    return m_PValueTable.GetExact();
+  }
+  virtual void SetExactPValue(const bool _arg)
+  {
+    if (m_PValueTable.GetExact() != _arg)
+    {
+      m_PValueTable.SetExact(_arg);
+      this->Modified();
+    }
+  }
+  itkBooleanMacro(ExactPValue);
+
 protected:
   KSTest()
   {
     m_SortedFirst = false;
     m_SortedSecond = false;
+    m_ComputePValue = false;
   }
   virtual ~KSTest()
   {
@@ -151,9 +272,73 @@ protected:
     Superclass::PrintSelf(os, indent);
   }
 
+  /**
+   * The merge of Evaluate() on plain arrays. D+ only grows when the first
+   * CDF steps and D- when the second one does, so each is only checked
+   * there. Both samples are exhausted once the last second sample value is
+   * merged, the rest of the first sample can only lower the distances.
+   */
+  template< typename TValue >
+  void EvaluateBatchKernel(const TValue * values1,
+                           const TRealValueType * frequencies1,
+                           SizeValueType size1, const TValue * values2,
+                           const SizeValueType * offsets2, SizeValueType count,
+                           TRealValueType * output) const
+  {
+    TRealValueType total1 = 0;
+    for (SizeValueType i = 0; i < size1; i++)
+      {
+      total1 += frequencies1[i];
+      }
+    const TRealValueType step1 = 1.0 / total1;
+    const size_t referenceSize = static_cast< size_t >(total1 + 0.5);
+
+    for (SizeValueType k = 0; k < count; k++)
+      {
+      const TValue * x2 = values2 + offsets2[k];
+      const SizeValueType size2 = offsets2[k + 1] - offsets2[k];
+      if (size1 == 0 || size2 == 0)
+        {
+        output[k] = 0;
+        continue;
+        }
+      const TRealValueType step2 = 1.0 / size2;
+      TRealValueType cdf1 = 0;
+      TRealValueType cdf2 = 0;
+      TRealValueType dp = 0;
+      TRealValueType dn = 0;
+      SizeValueType i = 0;
+      for (SizeValueType j = 0; j < size2; j++)
+        {
+        const TValue t = x2[j];
+        while (i < size1 && values1[i] < t)
+          {
+          cdf1 += step1 * frequencies1[i];
+          dp = vcl_max(dp, cdf1 - cdf2);
+          ++i;
+          }
+        cdf2 += step2;
+        dn = vcl_max(dn, cdf2 - cdf1);
+        }
+
+      if (m_ComputePValue)
+        {
+        output[k] = m_PValueTable.GetPValue(size2, referenceSize,
+                                            this->KSStatistics(dn, dp),
+                                            this->GetTwoTail());
+        }
+      else
+        {
+        output[k] = this->DecisionOutput(this->KSStatistics(dn, dp));
+        }
+      }
+  }
+
 private:
   bool m_SortedFirst;
   bool m_SortedSecond;
+  bool m_ComputePValue;
+  KSPValueTable m_PValueTable;
 };
 // end of class
 }// end of namespace Statistics
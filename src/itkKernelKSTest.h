@@ -9,6 +9,7 @@
 #include "itkGaussianDistribution.h"
 
 #include "vcl_algorithm.h"
+#include "vcl_cmath.h"
 
 #include "itkKSTest.h"
 #include "itkTimeProbe.h"
@@ -25,6 +26,7 @@ public:
   /** Standard typedefs */
   typedef KernelKSTest Self;
   typedef StatisticalTestBase< SubSampleT1, SubSampleT2, TRealValueType > Superclass;
+  typedef KSTest< SubSampleT1, SubSampleT2, TRealValueType > KSTestType;
   typedef SmartPointer< Self > Pointer;
   typedef SmartPointer< const Self > ConstPointer;
 
@@ -44,49 +46,71 @@ public:
   typedef typename SubSampleType1::ConstIterator SubsampleConstIter1;
   typedef typename SubSampleType2::ConstIterator SubsampleConstIter2;
 
+  typedef typename Superclass::ScratchType ScratchType;
+
+  /** The kernel smoothed CDFs are not a function of the bin frequencies,
+   * nor are they computed by the merge of KSTest. */
+  virtual bool SupportsHistogram() const
+  {
+    return false;
+  }
+
+  virtual bool SupportsBatch() const
+  {
+    return false;
+  }
+
   virtual TRealValueType Evaluate(const SampleType1 * x1,
                                   const SampleType2 * x2) const
+  {
+    ScratchType scratch;
+    return this->Evaluate(x1, x2, scratch);
+  }
+
+  virtual TRealValueType Evaluate(const SampleType1 * x1,
+                                  const SampleType2 * x2,
+                                  ScratchType & scratch) const
   {
     if(x1->Size() == 0 || x2->Size() == 0)
     {
       return 0;
     }
 
-    typename SubSampleType1::Pointer subsample1 = SubSampleType1::New();
-    subsample1->SetSample(x1);
-    subsample1->InitializeWithAllInstances();
+    this->PrepareScratch(x1, x2, this->GetSortedFirst(),
+                         this->GetSortedSecond(), scratch);
+    const SubSampleType1 * subsample1 = scratch.Subsample1;
+    const SubSampleType2 * subsample2 = scratch.Subsample2;
 
-    typename SubSampleType2::Pointer subsample2 = SubSampleType2::New();
-    subsample2->SetSample(x2);
-    subsample2->InitializeWithAllInstances();
+    const TRealValueType total1 = subsample1->GetTotalFrequency();
+    const TRealValueType total2 = subsample2->GetTotalFrequency();
 
-    if (!this->GetSortedFirst())
-    {
-      Algorithm::HeapSort< SubSampleType1 >(subsample1, 0, 0,
-                                            subsample1->Size());
-    }
-    if (!this->GetSortedSecond())
+    TRealValueType bandwidth1 = 1.06 * m_Sigma1 * vcl_pow(total1, -0.2);
+    TRealValueType bandwidth2 = 1.06 * m_Sigma2 * vcl_pow(total2, -0.2);
+
+    TRealValueType step = vcl_min(bandwidth1, bandwidth2);
+    if (!(step > 0))
     {
-      Algorithm::HeapSort< SubSampleType2 >(subsample2, 0, 0,
-                                            subsample2->Size());
+      // Degenerate kernel, fall back to the plain empirical CDFs.
+      return KSTestType::Evaluate(x1, x2, scratch);
     }
 
-    TRealValueType bandwidth1 = 1.06
-        * m_Sigma1 * vcl_pow(subsample1->GetTotalFrequency(), -0.2);
-    TRealValueType bandwidth2 = 1.06
-        * m_Sigma2 * vcl_pow(subsample2->GetTotalFrequency(), -0.2);
+    /*
+     * The kernel CDF is 0 below -m_Z and 1 above m_Z, so only points within
+     * the band of width m_Z * bandwidth around x are looked up in the cache;
+     * points left of the band are counted in full.
+     */
+    const TRealValueType interval1 = m_Z * bandwidth1;
+    const TRealValueType interval2 = m_Z * bandwidth2;
+
+    const TRealValueType min = vcl_min(
+        subsample1->GetMeasurementVector(0)[0] - interval1,
+        subsample2->GetMeasurementVector(0)[0] - interval2);
+    const TRealValueType max = vcl_max(
+        subsample1->GetMeasurementVector(subsample1->Size() - 1)[0] + interval1,
+        subsample2->GetMeasurementVector(subsample2->Size() - 1)[0] + interval2);
+    const unsigned int nSteps = static_cast< unsigned int >(
+        vcl_ceil((max - min) / step));
 
-    TRealValueType interval = vcl_max(bandwidth1, bandwidth2) * 1.96;
-
-    TRealValueType min = vcl_min(subsample1->GetMeasurementVector(0)[0],
-                                 subsample2->GetMeasurementVector(0)[0])
-                         - interval;
-    TRealValueType max = vcl_max(
-        subsample1->GetMeasurementVector(subsample1->Size() - 1)[0],
-        subsample2->GetMeasurementVector(subsample2->Size() - 1)[0])
-                         + interval;
-
-    TRealValueType step = vcl_min(bandwidth1, bandwidth2);
     SubsampleConstIter1 it1 = subsample1->Begin();
     SubsampleConstIter1 it1min = subsample1->Begin();
     SubsampleConstIter1 it1max = subsample1->Begin();
@@ -97,36 +121,35 @@ public:
     SubsampleConstIter2 it2max = subsample2->Begin();
     SubsampleConstIter2 it2End = subsample2->End();
 
-    TRealValueType precdf1 = 0; // CDF for sample 1
-    TRealValueType precdf2 = 0; // CDF for sample 2
+    TRealValueType precdf1 = 0; // Frequency left of the band for sample 1
+    TRealValueType precdf2 = 0; // Frequency left of the band for sample 2
 
     TRealValueType dp = 0; // Distance toward positive
     TRealValueType dn = 0; // Distance toward negative
 
-    return 1;
-
-    for (TRealValueType x = min; x <= max; x += step)
+    for (unsigned int k = 0; k <= nSteps; ++k)
     {
+      const TRealValueType x = min + k * step;
       while ((it1min != it1End)
-          && (x - it1min.GetMeasurementVector()[0] > interval))
+          && (x - it1min.GetMeasurementVector()[0] >= interval1))
       {
+        precdf1 += it1min.GetFrequency();
         ++it1min;
-        ++precdf1;
       }
       while ((it1max != it1End)
-          && (it1max.GetMeasurementVector()[0] - x < interval))
+          && (it1max.GetMeasurementVector()[0] - x < interval1))
       {
         ++it1max;
       }
 
       while ((it2min != it2End)
-          && (x - it2min.GetMeasurementVector()[0] > interval))
+          && (x - it2min.GetMeasurementVector()[0] >= interval2))
       {
+        precdf2 += it2min.GetFrequency();
         ++it2min;
-        ++precdf2;
       }
       while ((it2max != it2End)
-          && (it2max.GetMeasurementVector()[0] - x < interval))
+          && (it2max.GetMeasurementVector()[0] - x < interval2))
       {
         ++it2max;
       }
@@ -134,27 +157,25 @@ public:
       TRealValueType cdf1 = precdf1; // CDF for sample 1
       TRealValueType cdf2 = precdf2; // CDF for sample 2
 
-      if(it1min!=it1max)
-        for (it1 = it1min; it1 != it1max; ++it1)
+      for (it1 = it1min; it1 != it1max; ++it1)
       {
         cdf1 += it1.GetFrequency()
-           * this->Kernel((x - it1.GetMeasurementVector()[0]) / bandwidth1);
+            * this->Kernel((x - it1.GetMeasurementVector()[0]) / bandwidth1);
       }
-      cdf1 /= subsample1->GetTotalFrequency();
+      cdf1 /= total1;
 
-      if(it2min!=it2max)
       for (it2 = it2min; it2 != it2max; ++it2)
       {
         cdf2 += it2.GetFrequency()
             * this->Kernel((x - it2.GetMeasurementVector()[0]) / bandwidth2);
       }
-      cdf2 /= subsample2->GetTotalFrequency();
+      cdf2 /= total2;
 
       dp = vcl_max(dp, cdf1 - cdf2);
       dn = vcl_max(dn, cdf2 - cdf1);
     }
 
-    return this->KSStatistics(dn, dp);
+    return this->DecisionOutput(this->KSStatistics(dn, dp));
   }
 
   itkGetConstMacro(Sigma1, TRealValueType);itkSetMacro(Sigma1, TRealValueType);itkGetConstMacro(Sigma2, TRealValueType);itkSetMacro(Sigma2, TRealValueType);
@@ -184,29 +205,39 @@ protected:
 
 private:
 
+  /** CDF of the Gaussian kernel truncated to [-m_Z, m_Z], linearly
+   * interpolated from the cache. */
   inline TRealValueType Kernel(const TRealValueType& x) const
   {
-    if (x < -m_Z) return 0;
+    if (x <= -m_Z) return 0;
     if (x >= m_Z) return 1;
-    return 1;//(x + m_Z) / (2 * m_Z);//m_Cache.GetElement(m_N * (x + m_Z) / (2 * m_Z));
+    const TRealValueType t = (x + m_Z) * m_CacheScale;
+    const unsigned int i = static_cast< unsigned int >(t);
+    const TRealValueType f = t - i;
+    return (1 - f) * m_Cache[i] + f * m_Cache[i + 1];
   }
 
   void UpdateCache()
   {
     double x = -m_Z;
     const double step = 2 * m_Z / (m_N - 1);
+    const double low = GaussianDistribution::CDF(-m_Z);
+    const double high = GaussianDistribution::CDF(m_Z);
     m_Cache = itk::Array< double >(m_N+1);
     for (unsigned int i = 0; i <= m_N; i++)
     {
-      m_Cache.SetElement(i, GaussianDistribution::CDF(x));
+      m_Cache.SetElement(
+          i, vcl_min(1.0, (GaussianDistribution::CDF(x) - low) / (high - low)));
       x += step;
     }
+    m_CacheScale = 1.0 / step;
   }
 
   TRealValueType m_Sigma1;
   TRealValueType m_Sigma2;
 
   itk::Array< double > m_Cache;
+  TRealValueType m_CacheScale;
 
   TRealValueType m_Z;
   unsigned int m_N;
@@ -4,6 +4,7 @@
 #include "itkFunctionBase.h"
 #include "itkMeasurementVectorTraits.h"
 #include "itkSample.h"
+#include "itkKSPValueTable.h"
 
 #include "vector"
 
@@ -30,10 +31,25 @@ public:
   itkNewMacro(Self)
   ;
 
+  typedef TMeasurement MeasurementType;
   typedef std::vector< TMeasurement > DistributionType;
   typedef std::pair<DistributionType, DistributionType > PairDistribution;
+
+  /** Copies both distributions and sorts the copies unless flagged sorted. */
   double Evaluate(const PairDistribution & x) const;
 
+  /** Zero-copy evaluation on two ascending ranges. Neither range is copied
+   * or modified, so a single sorted reference can be shared by all threads
+   * while each thread passes its own test buffer. The cost is linear in the
+   * size of both ranges. */
+  double Evaluate(const MeasurementType * reference, size_t referenceSize,
+                  const MeasurementType * sample, size_t sampleSize) const;
+
+  /** Evaluate a thread-local test buffer against a sorted reference. The
+   * buffer is sorted in place unless SortedSample is set. */
+  double Evaluate(const DistributionType & reference,
+                  DistributionType & sample) const;
+
   itkGetConstMacro(Positive, bool);
   itkSetMacro(Positive, bool);
   itkBooleanMacro(Positive);
@@ -41,6 +57,41 @@ public:
   itkSetMacro(SortedReference, bool);
   itkBooleanMacro(SortedReference)
   ;
+  itkGetConstMacro(SortedSample, bool);
+  itkSetMacro(SortedSample, bool);
+  itkBooleanMacro(SortedSample)
+  ;
+
+  /** Return the p-value of the one sided KS statistic in the direction of
+   * Positive instead of the mean reference CDF. Small values are
+   * significant. */
+  itkGetConstMacro(ComputePValue, bool);
+  itkSetMacro(ComputePValue, bool);
+  itkBooleanMacro(ComputePValue)
+  ;
+
+  /** Use exact p-values where the sample sizes allow it. */
+  virtual bool GetExactPValue() const
+  {
+    return m_PValueTable.GetExact();
+  }
+  virtual void SetExactPValue(const bool _arg)
+  {
+    if (m_PValueTable.GetExact() != _arg)
+      {
+      m_PValueTable.SetExact(_arg);
+      this->Modified();
+      }
+  }
+  itkBooleanMacro(ExactPValue)
+  ;
+
+  /** Build the p-value tables of samples of up to maximumSampleSize values
+   * against a reference of referenceSize values before threads evaluate. */
+  void PreparePValues(size_t maximumSampleSize, size_t referenceSize)
+  {
+    m_PValueTable.Prepare(maximumSampleSize, referenceSize, false);
+  }
 
 #ifdef ITK_USE_CONCEPT_CHECKING
     // Begin concept checking
@@ -60,6 +111,9 @@ protected:
 private:
   bool m_Positive;
   bool m_SortedReference;
+  bool m_SortedSample;
+  bool m_ComputePValue;
+  KSPValueTable m_PValueTable;
 };
 // end of class
 }// end of namespace Statistics
@@ -15,6 +15,8 @@ KolmogorovSmirnovTest< TMeasurement >::KolmogorovSmirnovTest()
 {
   m_Positive = true;
   m_SortedReference = false;
+  m_SortedSample = false;
+  m_ComputePValue = false;
 }
 
 template< typename TMeasurement >
@@ -28,20 +30,43 @@ KolmogorovSmirnovTest< TMeasurement >::Evaluate(
     {
     std::sort(D1.begin(), D1.end());
     }
-  std::sort(D2.begin(), D2.end());
+  if (!this->GetSortedSample())
+    {
+    std::sort(D2.begin(), D2.end());
+    }
+  return this->Evaluate(D1.empty() ? 0 : &D1[0], D1.size(),
+                        D2.empty() ? 0 : &D2[0], D2.size());
+}
+
+template< typename TMeasurement >
+double
+KolmogorovSmirnovTest< TMeasurement >::Evaluate(
+    const DistributionType & reference, DistributionType & sample) const
+{
+  if (!this->GetSortedSample())
+    {
+    std::sort(sample.begin(), sample.end());
+    }
+  return this->Evaluate(reference.empty() ? 0 : &reference[0],
+                        reference.size(), sample.empty() ? 0 : &sample[0],
+                        sample.size());
+}
+
+template< typename TMeasurement >
+double
+KolmogorovSmirnovTest< TMeasurement >::Evaluate(
+    const MeasurementType * reference, size_t referenceSize,
+    const MeasurementType * sample, size_t sampleSize) const
+{
   double cdf1 = 0;
   double cdf2 = 0;
-  double step1 = 1.0 / D1.size();
-  double step2 = 1.0 / D2.size();
+  double step1 = 1.0 / referenceSize;
+  double step2 = 1.0 / sampleSize;
 
-  double x;
-  typename DistributionType::const_iterator it1 = D1.begin();
-  typename DistributionType::const_iterator it1End = D1.end();
-  typename DistributionType::const_iterator it2 = D2.begin();
-  typename DistributionType::const_iterator it2End = D2.end();
-
-  it1 = D1.begin();
-  it2 = D2.begin();
+  const MeasurementType * it1 = reference;
+  const MeasurementType * it1End = reference + referenceSize;
+  const MeasurementType * it2 = sample;
+  const MeasurementType * it2End = sample + sampleSize;
 
   double dp = 0;
   double dn = 0;
@@ -59,10 +84,8 @@ KolmogorovSmirnovTest< TMeasurement >::Evaluate(
       cdf1 += step1;
       dp = vcl_max(dp, cdf1 - cdf2);
       dn = vcl_max(dn, cdf2 - cdf1);
-      x = *it1;
       it1++;
       }
-    x = *it2;
     cdf2 += step2;
     mean_cdf += cdf1;
     dp = vcl_max(dp, cdf1 - cdf2);
@@ -71,6 +94,12 @@ KolmogorovSmirnovTest< TMeasurement >::Evaluate(
     }
   mean_cdf *= step2;
 
+  if (this->GetComputePValue())
+    {
+    return m_PValueTable.GetPValue(sampleSize, referenceSize,
+                                   this->GetPositive() ? dp : dn, false);
+    }
+
   if (this->GetPositive())
     {
     return mean_cdf;//dp; //> dn ? dp : 0;
@@ -91,6 +120,12 @@ KolmogorovSmirnovTest< TMeasurement >::PrintSelf(std::ostream & os,
      << std::endl;
   os << indent << "Reference samples are sorted: "
      << (m_SortedReference ? "Yes" : "No") << std::endl;
+  os << indent << "Test samples are sorted: "
+     << (m_SortedSample ? "Yes" : "No") << std::endl;
+  os << indent << "Compute p-value: " << (m_ComputePValue ? "Yes" : "No")
+     << std::endl;
+  os << indent << "Exact p-value: "
+     << (m_PValueTable.GetExact() ? "Yes" : "No") << std::endl;
 }
 
 } // end of namespace Statistics
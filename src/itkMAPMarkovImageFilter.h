@@ -23,11 +23,32 @@
 
 #include "itkRGBGibbsPriorFilter.h"
 
+#include <vector>
+
 namespace itk
 {
 
 /** \class MAPMarkovImageFilter
  * \brief composite ITK filter for MAP classification with Markov field
+ *
+ * Every pass goes from the membership and the prior of a voxel to its
+ * posterior and label in one traversal: the posterior is the membership times
+ * the normalized prior, weighted after the first pass by the fraction of the
+ * neighbors (within Radius, center excluded) carrying each label. The neighbor
+ * counts are box sums of the labels of each class, as in
+ * GibbsMarkovEnergyImageFilter, so a voxel costs the same whatever the radius.
+ * No vector image is written during the iterations.
+ *
+ * A pass only records the voxels that change label; the changes are applied to
+ * the labels and the class counts after it, so an iteration is synchronous
+ * with a single label image. Only the voxels with a change in their
+ * neighborhood since their last evaluation are evaluated again, and the
+ * iterations stop early once no label changes.
+ *
+ * With Checkerboard on, an iteration instead visits the voxels one color at a
+ * time. Voxels whose indices agree modulo Radius+1 in every dimension share a
+ * color and are never neighbors, so each color sees the freshest labels of
+ * the others. Either way the result does not depend on the number of threads.
  */
 
 template <class TImage, class TClassificationImage=TImage,class TProbabilityPrecision=float>
@@ -92,6 +113,22 @@ public:
   itkSetMacro(PriorBias, float);
   itkGetMacro(PriorBias, float);
 
+  typedef typename ClassifierOutputImageType::SizeType RadiusType;
+  typedef typename ClassifierOutputImageType::RegionType OutputImageRegionType;
+
+  /** Neighborhood of the Markov field, 1 by default. */
+  itkSetMacro(Radius, RadiusType);
+  itkGetConstMacro(Radius, RadiusType);
+
+  /** Update the labels color by color rather than synchronously. */
+  itkSetMacro(Checkerboard, bool);
+  itkGetConstMacro(Checkerboard, bool);
+  itkBooleanMacro(Checkerboard);
+
+  /** Markov iterations run by the last update; fewer than
+   * NumberOfIterations when the labels converged. */
+  itkGetConstMacro(NumberOfElapsedIterations, unsigned int);
+
 protected:
 
   MAPMarkovImageFilter();
@@ -107,16 +144,103 @@ private:
   MAPMarkovImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
-  typedef itk::NormalizeVectorImageFilter< PriorsVectorImageType,
-      PriorsVectorImageType > NormalizeProbabilitiesFilterType;
-  typedef itk::MultiplyVectorImageFilter< PriorsVectorImageType,
-      MembershipsVectorImageType, PriorsVectorImageType > FreqBayesFilterType;
-  typedef itk::MaximumIndexVectorImageFilter< PriorsVectorImageType,
-      ClassifierOutputImageType > MaxIndexFilterType;
-  typedef itk::GibbsMarkovEnergyImageFilter< ClassifierOutputImageType > GibbsMarkovEnergyFilterType;
+  typedef std::vector< PriorPixelType > PosteriorType;
+
+  /** Membership times the prior normalized with bias, as
+   * NormalizeVectorImageFilter and MultiplyVectorImageFilter do. */
+  static void ComputePosterior(
+      const typename PriorsVectorImageType::PixelType & prior,
+      const typename MembershipsVectorImageType::PixelType & membership,
+      double bias, PosteriorType & posterior)
+  {
+    const unsigned int nClass = posterior.size();
+    double sum = 0;
+    for (unsigned int c = 0; c < nClass; c++)
+    {
+      sum += prior[c];
+    }
+    for (unsigned int c = 0; c < nClass; c++)
+    {
+      const PriorPixelType normalized = (prior[c] / sum + bias)
+          / (1 + bias * nClass);
+      posterior[c] = membership[c] * normalized;
+    }
+  }
+
+  static void NormalizePosterior(PosteriorType & posterior)
+  {
+    double sum = 0;
+    for (unsigned int c = 0; c < posterior.size(); c++)
+    {
+      sum += posterior[c];
+    }
+    for (unsigned int c = 0; c < posterior.size(); c++)
+    {
+      posterior[c] = posterior[c] / sum;
+    }
+  }
+
+  /** First index of the maximum, 0 unless a value is above the smallest
+   * positive value, as MaximumIndexVectorImageFilter does. */
+  static ClassificationPixelType MaximumIndex(const PosteriorType & posterior)
+  {
+    unsigned int maximumIndex = 0;
+    PriorPixelType maxVal = NumericTraits< PriorPixelType >::min();
+    for (unsigned int c = 0; c < posterior.size(); c++)
+    {
+      if (maxVal < posterior[c])
+      {
+        maximumIndex = c;
+        maxVal = posterior[c];
+      }
+    }
+    return static_cast< ClassificationPixelType >(maximumIndex);
+  }
+
+  typedef typename ClassifierOutputImageType::IndexType IndexType;
+  struct LabelChange
+  {
+    IndexType Index;
+    unsigned int From;
+    unsigned int To;
+  };
+
+  /** Runs ThreadedPass, or ThreadedColorSweep, on the split regions. */
+  void ExecutePass();
+  static ITK_THREAD_RETURN_TYPE PassThreaderCallback(void *arg);
+  /** Labels the maximum posteriori, without the Markov field. */
+  void ThreadedPass(const OutputImageRegionType & region);
+  /** Records the changes of the active voxels of m_Color in the region. */
+  void ThreadedColorSweep(const OutputImageRegionType & region,
+                          ThreadIdType threadId);
+
+  /** Box sums of the labels of each class. */
+  void ComputeClassCounts();
+  /** Applies the recorded changes; returns their number. */
+  SizeValueType ApplyLabelChanges();
+  /** Moves the count of a changed voxel from its old to its new class in the
+   * boxes containing it, and activates them. */
+  void ApplyLabelChange(const LabelChange & change);
 
   unsigned int m_NumberOfIterations;
+  unsigned int m_NumberOfElapsedIterations;
   float m_PriorBias;
+  RadiusType m_Radius;
+  bool m_Checkerboard;
+
+  ClassifierOutputImageType * m_Labels;
+  bool m_InitialPass;
+
+  typedef Image< unsigned int, ImageDimension > CountImageType;
+  std::vector< typename CountImageType::Pointer > m_ClassCounts;
+
+  /** Last sweep with a label change in the box of each voxel. */
+  typedef Image< SizeValueType, ImageDimension > SweepImageType;
+  typename SweepImageType::Pointer m_LastChange;
+  SizeValueType m_Sweep;
+  SizeValueType m_NumberOfColors;
+  IndexType m_Color;
+  std::vector< std::vector< LabelChange > > m_LabelChanges;
 
 }; // end of class
 
@@ -5,6 +5,13 @@
 
 #include "itkMAPMarkovImageFilter.h"
 
+#include "itkImageRegionIterator.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkSeparableBoxSum.h"
+
+#include <vector>
+#include <algorithm>
+
 namespace itk
 {
 
@@ -12,69 +19,421 @@ template< class TImage, class TClassificationImage, class TProbabilityPrecision
 MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::MAPMarkovImageFilter()
 {
   m_NumberOfIterations = 1;
+  m_NumberOfElapsedIterations = 0;
   m_PriorBias = 0;
+  m_Radius.Fill(1);
+  m_Checkerboard = false;
+  m_Labels = 0;
+  m_InitialPass = false;
+  m_Sweep = 0;
+  m_NumberOfColors = 1;
+  m_Color.Fill(0);
 }
 
 template< class TImage, class TClassificationImage, class TProbabilityPrecision >
 void MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::GenerateData()
+{
+  itkAssertOrThrowMacro(
+      this->GetPriorVectorImage()->GetNumberOfComponentsPerPixel()
+      == this->GetMembershipVectorImage()->GetNumberOfComponentsPerPixel(),
+      "Number of priors and memberships does not match.");
+
+  this->AllocateOutputs();
+  m_Labels = this->GetOutput();
+  const unsigned int nClass =
+      this->GetPriorVectorImage()->GetNumberOfComponentsPerPixel();
+
+  /*
+   * Pass 0 labels the maximum posteriori.
+   */
+  m_InitialPass = true;
+  this->ExecutePass();
+  m_InitialPass = false;
+  this->UpdateProgress(1.0f / (m_NumberOfIterations + 1));
+
+  m_NumberOfElapsedIterations = 0;
+  if (m_NumberOfIterations > 0)
+  {
+    const OutputImageRegionType region = m_Labels->GetBufferedRegion();
+    m_ClassCounts.clear();
+    for (unsigned int c = 0; c < nClass; c++)
+    {
+      typename CountImageType::Pointer counts = CountImageType::New();
+      counts->CopyInformation(m_Labels);
+      counts->SetRegions(region);
+      counts->Allocate();
+      m_ClassCounts.push_back(counts);
+    }
+    this->ComputeClassCounts();
+
+    m_LastChange = SweepImageType::New();
+    m_LastChange->CopyInformation(m_Labels);
+    m_LastChange->SetRegions(region);
+    m_LastChange->Allocate();
+    m_LastChange->FillBuffer(0);
+
+    m_NumberOfColors = 1;
+    for (unsigned int d = 0; m_Checkerboard && d < ImageDimension; d++)
+    {
+      m_NumberOfColors *= m_Radius[d] + 1;
+    }
+
+    /*
+     * Sweeps are numbered from 1, so every voxel is active in the first
+     * iteration.
+     */
+    m_Sweep = 0;
+    for (unsigned int i = 0; i < m_NumberOfIterations; i++)
+    {
+      SizeValueType changed = 0;
+      for (SizeValueType color = 0; color < m_NumberOfColors; color++)
+      {
+        SizeValueType rest = color;
+        for (unsigned int d = 0; d < ImageDimension; d++)
+        {
+          const SizeValueType step = m_Checkerboard ? m_Radius[d] + 1 : 1;
+          m_Color[d] = rest % step;
+          rest /= step;
+        }
+        ++m_Sweep;
+        m_LabelChanges.assign(this->GetNumberOfThreads(),
+                              std::vector< LabelChange >());
+        this->ExecutePass();
+        changed += this->ApplyLabelChanges();
+      }
+      m_NumberOfElapsedIterations = i + 1;
+      itkDebugMacro(<< "Iteration " << i + 1 << ": " << changed
+                    << " labels changed");
+      this->UpdateProgress(static_cast< float >(i + 2)
+                           / (m_NumberOfIterations + 1));
+      if (changed == 0)
+      {
+        break;
+      }
+    }
+  }
+
+  m_Labels = 0;
+  m_ClassCounts.clear();
+  m_LastChange = 0;
+  m_LabelChanges.clear();
+}
+
+template< class TImage, class TClassificationImage, class TProbabilityPrecision >
+void MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::ExecutePass()
+{
+  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+  this->GetMultiThreader()->SetSingleMethod(this->PassThreaderCallback, this);
+  this->GetMultiThreader()->SingleMethodExecute();
+}
+
+template< class TImage, class TClassificationImage, class TProbabilityPrecision >
+ITK_THREAD_RETURN_TYPE MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::PassThreaderCallback(
+    void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+      static_cast< MultiThreader::ThreadInfoStruct * >(arg);
+  Self * filter = static_cast< Self * >(info->UserData);
+
+  OutputImageRegionType splitRegion;
+  const ThreadIdType total = filter->SplitRequestedRegion(
+      info->ThreadID, info->NumberOfThreads, splitRegion);
+  if (info->ThreadID < total)
+  {
+    if (filter->m_InitialPass)
+    {
+      filter->ThreadedPass(splitRegion);
+    }
+    else
+    {
+      filter->ThreadedColorSweep(splitRegion, info->ThreadID);
+    }
+  }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template< class TImage, class TClassificationImage, class TProbabilityPrecision >
+void MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::ThreadedPass(
+    const OutputImageRegionType & region)
 {
   const unsigned int nClass =
       this->GetPriorVectorImage()->GetNumberOfComponentsPerPixel();
+  const double bias = m_PriorBias;
 
-  typename NormalizeProbabilitiesFilterType::Pointer normalizePriori =
-      NormalizeProbabilitiesFilterType::New();
-  typename NormalizeProbabilitiesFilterType::Pointer normalizePosteriori =
-      NormalizeProbabilitiesFilterType::New();
+  PosteriorType posterior(nClass);
+  ImageRegionConstIterator< PriorsVectorImageType > pit(
+      this->GetPriorVectorImage(), region);
+  ImageRegionConstIterator< MembershipsVectorImageType > mit(
+      this->GetMembershipVectorImage(), region);
+  ImageRegionIterator< ClassifierOutputImageType > lit(m_Labels, region);
+  for (; !lit.IsAtEnd(); ++pit, ++mit, ++lit)
+  {
+    ComputePosterior(pit.Get(), mit.Get(), bias, posterior);
+    NormalizePosterior(posterior);
+    lit.Set(MaximumIndex(posterior));
+  }
+}
+
+template< class TImage, class TClassificationImage, class TProbabilityPrecision >
+void MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::ThreadedColorSweep(
+    const OutputImageRegionType & region, ThreadIdType threadId)
+{
+  const unsigned int nClass = m_ClassCounts.size();
+  const double bias = m_PriorBias;
+  const IndexType origin = m_Labels->GetBufferedRegion().GetIndex();
 
-  typename FreqBayesFilterType::Pointer freqBayesFilter =
-      FreqBayesFilterType::New();
-  typename MaxIndexFilterType::Pointer maximumPosteriori =
-      MaxIndexFilterType::New();
-  typename GibbsMarkovEnergyFilterType::Pointer gibbsMarkov =
-      GibbsMarkovEnergyFilterType::New();
-  typename FreqBayesFilterType::Pointer gibbsMarkovBayesFilter =
-      FreqBayesFilterType::New();
+  SizeValueType neighborhoodSize = 1;
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    neighborhoodSize *= 2 * m_Radius[d] + 1;
+  }
+  const PriorPixelType bitInc = 1.0
+      / static_cast< PriorPixelType >(neighborhoodSize - 1);
 
   /*
-   * General pipelne setup
+   * First index of the color in the region and the number of its voxels in
+   * each dimension; the color repeats every step voxels.
    */
+  OffsetValueType step[ImageDimension];
+  IndexType first;
+  SizeValueType count[ImageDimension];
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    step[d] = m_Checkerboard ? m_Radius[d] + 1 : 1;
+    const OffsetValueType start = region.GetIndex()[d];
+    const OffsetValueType shift = ((m_Color[d] - (start - origin[d]))
+        % step[d] + step[d]) % step[d];
+    first[d] = start + shift;
+    const OffsetValueType length = region.GetSize()[d];
+    count[d] = shift < length ? (length - shift + step[d] - 1) / step[d] : 0;
+    if (count[d] == 0)
+    {
+      return;
+    }
+  }
 
-  normalizePriori->SetBias(m_PriorBias);
-  normalizePriori->SetInput(this->GetPriorVectorImage());
+  PosteriorType posterior(nClass);
+  std::vector< LabelChange > & changes = m_LabelChanges[threadId];
 
-  freqBayesFilter->SetInput1(this->GetMembershipVectorImage());
-  freqBayesFilter->SetInput2(normalizePriori->GetOutput());
+  /*
+   * A voxel was last evaluated in the sweep of its color one iteration ago;
+   * it is evaluated again only if a label changed in its box since.
+   */
+  const SizeValueType lastEvaluation = m_Sweep > m_NumberOfColors ?
+      m_Sweep - m_NumberOfColors : 0;
+
+  /*
+   * One row along the first dimension per color index of the others.
+   */
+  IndexType row = first;
+  while (true)
+  {
+    OutputImageRegionType rowRegion;
+    rowRegion.SetIndex(row);
+    typename OutputImageRegionType::SizeType rowSize;
+    rowSize.Fill(1);
+    rowSize[0] = (count[0] - 1) * step[0] + 1;
+    rowRegion.SetSize(rowSize);
 
-  normalizePosteriori->SetBias(0);
-  normalizePosteriori->SetInput(freqBayesFilter->GetOutput());
+    ImageRegionConstIterator< PriorsVectorImageType > pit(
+        this->GetPriorVectorImage(), rowRegion);
+    ImageRegionConstIterator< MembershipsVectorImageType > mit(
+        this->GetMembershipVectorImage(), rowRegion);
+    ImageRegionConstIterator< ClassifierOutputImageType > lit(m_Labels,
+                                                              rowRegion);
+    ImageRegionConstIterator< SweepImageType > sit(m_LastChange, rowRegion);
+    std::vector< ImageRegionConstIterator< CountImageType > > countIts;
+    for (unsigned int c = 0; c < nClass; c++)
+    {
+      countIts.push_back(ImageRegionConstIterator< CountImageType >(
+          m_ClassCounts[c], rowRegion));
+    }
 
-  maximumPosteriori->SetInput(normalizePosteriori->GetOutput());
+    for (SizeValueType k = 0; k < count[0]; k++)
+    {
+      if (k > 0)
+      {
+        for (OffsetValueType j = 0; j < step[0]; j++)
+        {
+          ++pit;
+          ++mit;
+          ++lit;
+          ++sit;
+          for (unsigned int c = 0; c < nClass; c++)
+          {
+            ++countIts[c];
+          }
+        }
+      }
+      if (sit.Get() < lastEvaluation)
+      {
+        continue;
+      }
+      const unsigned int center = static_cast< unsigned int >(lit.Get());
+      ComputePosterior(pit.Get(), mit.Get(), bias, posterior);
+      for (unsigned int c = 0; c < nClass; c++)
+      {
+        const unsigned int n = countIts[c].Get() - (center == c ? 1 : 0);
+        posterior[c] *= n * bitInc;
+      }
+      const unsigned int label =
+          static_cast< unsigned int >(MaximumIndex(posterior));
+      if (label != center)
+      {
+        LabelChange change;
+        change.Index = row;
+        change.Index[0] += k * step[0];
+        change.From = center;
+        change.To = label;
+        changes.push_back(change);
+      }
+    }
 
-  maximumPosteriori->Update();
+    unsigned int d = 1;
+    for (; d < ImageDimension; d++)
+    {
+      row[d] += step[d];
+      if (row[d] < first[d] + static_cast< OffsetValueType >(count[d] * step[d]))
+      {
+        break;
+      }
+      row[d] = first[d];
+    }
+    if (d == ImageDimension)
+    {
+      break;
+    }
+  }
+}
+
+template< class TImage, class TClassificationImage, class TProbabilityPrecision >
+void MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::ComputeClassCounts()
+{
+  const unsigned int nClass = m_ClassCounts.size();
+  const OutputImageRegionType region = m_Labels->GetBufferedRegion();
 
-  for (unsigned int i = 0; i < nClass; i++)
+  std::vector< ImageRegionIterator< CountImageType > > countIts;
+  for (unsigned int c = 0; c < nClass; c++)
+  {
+    countIts.push_back(ImageRegionIterator< CountImageType >(
+        m_ClassCounts[c], region));
+  }
+  ImageRegionConstIterator< ClassifierOutputImageType > lit(m_Labels, region);
+  for (; !lit.IsAtEnd(); ++lit)
+  {
+    const unsigned int label = static_cast< unsigned int >(lit.Get());
+    for (unsigned int c = 0; c < nClass; c++)
+    {
+      countIts[c].Set(label == c ? 1 : 0);
+      ++countIts[c];
+    }
+  }
+  for (unsigned int c = 0; c < nClass; c++)
   {
-    gibbsMarkov->AddClass(i);
+    SeparableBoxSum(m_ClassCounts[c].GetPointer(), m_Radius);
   }
+}
 
-  for (unsigned int i = 0; i < m_NumberOfIterations; i++)
+template< class TImage, class TClassificationImage, class TProbabilityPrecision >
+SizeValueType MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::ApplyLabelChanges()
+{
+  SizeValueType changed = 0;
+  for (size_t t = 0; t < m_LabelChanges.size(); t++)
+  {
+    changed += m_LabelChanges[t].size();
+  }
+  if (changed == 0)
   {
-    typename ClassifierOutputImageType::Pointer prevClassification =
-        maximumPosteriori->GetOutput();
-    prevClassification->DisconnectPipeline();
+    return 0;
+  }
 
-    gibbsMarkov->SetInput(prevClassification);
-    gibbsMarkovBayesFilter->SetInput1(freqBayesFilter->GetOutput());
-    gibbsMarkovBayesFilter->SetInput2(gibbsMarkov->GetOutput());
-    maximumPosteriori->SetInput(gibbsMarkovBayesFilter->GetOutput());
-    maximumPosteriori->Modified();
-    maximumPosteriori->Update();
+  SizeValueType boxSize = 1;
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    boxSize *= 2 * m_Radius[d] + 1;
   }
 
   /*
-   * Put output of gibbsMarkovBayesFilter to the output as well
+   * Many changes are cheaper to apply by computing the counts again, with
+   * every voxel active.
    */
-  this->GraftOutput(maximumPosteriori->GetOutput());
+  if (changed * boxSize
+      > m_Labels->GetBufferedRegion().GetNumberOfPixels() * m_ClassCounts.size())
+  {
+    for (size_t t = 0; t < m_LabelChanges.size(); t++)
+    {
+      for (size_t k = 0; k < m_LabelChanges[t].size(); k++)
+      {
+        const LabelChange & change = m_LabelChanges[t][k];
+        m_Labels->SetPixel(change.Index,
+                           static_cast< ClassificationPixelType >(change.To));
+      }
+    }
+    this->ComputeClassCounts();
+    m_LastChange->FillBuffer(m_Sweep);
+    return changed;
+  }
+
+  for (size_t t = 0; t < m_LabelChanges.size(); t++)
+  {
+    for (size_t k = 0; k < m_LabelChanges[t].size(); k++)
+    {
+      this->ApplyLabelChange(m_LabelChanges[t][k]);
+    }
+  }
+  return changed;
+}
+
+template< class TImage, class TClassificationImage, class TProbabilityPrecision >
+void MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >::ApplyLabelChange(
+    const LabelChange & change)
+{
+  m_Labels->SetPixel(change.Index,
+                     static_cast< ClassificationPixelType >(change.To));
+
+  /*
+   * A voxel is counted in the box of w once per offset that reaches it; at
+   * the border of the buffer the clamped offsets all reach the border voxel.
+   */
+  const OutputImageRegionType buffered = m_Labels->GetBufferedRegion();
+  OutputImageRegionType box;
+  std::vector< unsigned int > weights[ImageDimension];
+  for (unsigned int d = 0; d < ImageDimension; d++)
+  {
+    const OffsetValueType r = m_Radius[d];
+    const OffsetValueType v = change.Index[d];
+    const OffsetValueType low = buffered.GetIndex()[d];
+    const OffsetValueType high = low
+        + static_cast< OffsetValueType >(buffered.GetSize()[d]) - 1;
+    const OffsetValueType boxLow = std::max(v - r, low);
+    const OffsetValueType boxHigh = std::min(v + r, high);
+    box.SetIndex(d, boxLow);
+    box.SetSize(d, boxHigh - boxLow + 1);
+    for (OffsetValueType w = boxLow; w <= boxHigh; w++)
+    {
+      const OffsetValueType reachLow = v == low ? w - r : std::max(v, w - r);
+      const OffsetValueType reachHigh = v == high ? w + r : std::min(v, w + r);
+      weights[d].push_back(static_cast< unsigned int >(
+          std::max< OffsetValueType >(reachHigh - reachLow + 1, 0)));
+    }
+  }
+
+  ImageRegionIteratorWithIndex< CountImageType > fromIt(
+      m_ClassCounts[change.From], box);
+  ImageRegionIterator< CountImageType > toIt(m_ClassCounts[change.To], box);
+  ImageRegionIterator< SweepImageType > sit(m_LastChange, box);
+  for (; !fromIt.IsAtEnd(); ++fromIt, ++toIt, ++sit)
+  {
+    const IndexType w = fromIt.GetIndex();
+    unsigned int weight = 1;
+    for (unsigned int d = 0; d < ImageDimension; d++)
+    {
+      weight *= weights[d][w[d] - box.GetIndex()[d]];
+    }
+    fromIt.Set(fromIt.Get() - weight);
+    toIt.Set(toIt.Get() + weight);
+    sit.Set(m_Sweep);
+  }
 }
 
 template< class TImage, class TClassificationImage, class TProbabilityPrecision >
@@ -85,6 +444,8 @@ void MAPMarkovImageFilter< TImage, TClassificationImage, TProbabilityPrecision >
 
   os << indent << "Iterations: " << m_NumberOfIterations<< std::endl;
   os << indent << "Prior bias: " << m_PriorBias<< std::endl;
+  os << indent << "Radius: " << m_Radius << std::endl;
+  os << indent << "Checkerboard: " << m_Checkerboard << std::endl;
 }
 
 } // end namespace itk
@@ -0,0 +1,154 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkMultiClassWeightedHistogramCalculator_h
+#define __itkMultiClassWeightedHistogramCalculator_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkVectorImage.h"
+#include "itkImageToHistogramFilter.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <vector>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class MultiClassWeightedHistogramCalculator
+ * \brief Weighted histograms of an image for several classes from one pass
+ * over the image.
+ *
+ * The weights of the classes are the components of a weight vector image,
+ * followed by the added scalar weight images. With a label image, a class c
+ * only takes the voxels labeled c. With BinaryWeights on, a voxel with a
+ * nonzero weight counts once, as a histogram weighted by a mask.
+ *
+ * Every histogram has the bins of ImageToHistogramFilter with
+ * AutoMinimumMaximum: the range of the whole input, widened by MarginalScale,
+ * so the histograms equal those of ImageToWeightedHistogramFilter run once per
+ * class. The image is split into slices along the last dimension which
+ * threads take in turn; each thread fills its own histograms, added together
+ * at the end.
+ */
+template< typename TImage, typename TWeightPixel = float,
+    typename TLabelImage = Image< unsigned char, TImage::ImageDimension > >
+class MultiClassWeightedHistogramCalculator: public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef MultiClassWeightedHistogramCalculator Self;
+  typedef Object Superclass;
+  typedef SmartPointer< Self > Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(MultiClassWeightedHistogramCalculator, Object);
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TImage::ImageDimension);
+
+  typedef TImage ImageType;
+  typedef typename ImageType::PixelType PixelType;
+  typedef typename ImageType::RegionType RegionType;
+  typedef Image< TWeightPixel, ImageDimension > WeightImageType;
+  typedef VectorImage< TWeightPixel, ImageDimension > WeightVectorImageType;
+  typedef TLabelImage LabelImageType;
+  typedef typename LabelImageType::PixelType LabelPixelType;
+
+  typedef typename ImageToHistogramFilter< ImageType >::HistogramType HistogramType;
+  typedef typename HistogramType::Pointer HistogramPointer;
+  typedef typename HistogramType::SizeType HistogramSizeType;
+  typedef typename HistogramType::MeasurementType HistogramMeasurementType;
+  typedef typename HistogramType::MeasurementVectorType HistogramMeasurementVectorType;
+
+  itkSetConstObjectMacro(Input, ImageType);
+  itkGetConstObjectMacro(Input, ImageType);
+
+  /** One class per component. */
+  itkSetConstObjectMacro(WeightVectorImage, WeightVectorImageType);
+  itkGetConstObjectMacro(WeightVectorImage, WeightVectorImageType);
+
+  /** One class per image, after the components of the weight vector image. */
+  void AddWeightImage(const WeightImageType * image);
+  void ClearWeightImages();
+
+  /** Optional; class c only takes the voxels labeled c. */
+  itkSetConstObjectMacro(LabelImage, LabelImageType);
+  itkGetConstObjectMacro(LabelImage, LabelImageType);
+
+  itkSetMacro(BinaryWeights, bool);
+  itkGetConstMacro(BinaryWeights, bool);
+  itkBooleanMacro(BinaryWeights);
+
+  itkSetMacro(HistogramSize, HistogramSizeType);
+  itkGetConstMacro(HistogramSize, HistogramSizeType);
+
+  itkSetMacro(MarginalScale, double);
+  itkGetConstMacro(MarginalScale, double);
+
+  itkSetMacro(NumberOfThreads, ThreadIdType);
+  itkGetConstMacro(NumberOfThreads, ThreadIdType);
+
+  unsigned int GetNumberOfClasses() const;
+
+  void Compute();
+
+  HistogramType * GetHistogram(unsigned int c) const
+  {
+    return m_Histograms[c].GetPointer();
+  }
+
+protected:
+  MultiClassWeightedHistogramCalculator();
+  virtual ~MultiClassWeightedHistogramCalculator()
+  {
+  }
+
+  void PrintSelf(std::ostream & os, Indent indent) const;
+
+private:
+  MultiClassWeightedHistogramCalculator(const Self &); //purposely not implemented
+  void operator=(const Self &); //purposely not implemented
+
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback(void *arg);
+  void ThreadedComputeSlices(ThreadIdType threadId);
+  void ThreadedComputeMinimumAndMaximum(const RegionType & region,
+                                        ThreadIdType threadId);
+  void ThreadedComputeHistograms(const RegionType & region,
+                                 ThreadIdType threadId);
+  HistogramPointer NewHistogram() const;
+
+  typename ImageType::ConstPointer m_Input;
+  typename WeightVectorImageType::ConstPointer m_WeightVectorImage;
+  std::vector< typename WeightImageType::ConstPointer > m_WeightImages;
+  typename LabelImageType::ConstPointer m_LabelImage;
+  bool m_BinaryWeights;
+  HistogramSizeType m_HistogramSize;
+  double m_MarginalScale;
+  ThreadIdType m_NumberOfThreads;
+
+  std::vector< HistogramPointer > m_Histograms;
+
+  RegionType m_Region;
+  unsigned int m_NumberOfComponents;
+  bool m_ComputeMinimumAndMaximum;
+  HistogramMeasurementVectorType m_Minimum;
+  HistogramMeasurementVectorType m_Maximum;
+  /** Per thread: range of the input, and the histograms of every class. */
+  std::vector< HistogramMeasurementVectorType > m_ThreadMinimum;
+  std::vector< HistogramMeasurementVectorType > m_ThreadMaximum;
+  std::vector< std::vector< HistogramPointer > > m_ThreadHistograms;
+  SizeValueType m_NextSlice;
+  SimpleFastMutexLock m_SliceLock;
+};
+} // end namespace Statistics
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkMultiClassWeightedHistogramCalculator.hxx"
+#endif
+
+#endif
@@ -0,0 +1,301 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkMultiClassWeightedHistogramCalculator_hxx
+#define __itkMultiClassWeightedHistogramCalculator_hxx
+#include "itkMultiClassWeightedHistogramCalculator.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkMultiThreader.h"
+
+#include <algorithm>
+
+namespace itk
+{
+namespace Statistics
+{
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::MultiClassWeightedHistogramCalculator()
+{
+  m_BinaryWeights = false;
+  m_MarginalScale = 100;
+  m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  m_NumberOfComponents = 0;
+  m_ComputeMinimumAndMaximum = false;
+  m_NextSlice = 0;
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+void MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::AddWeightImage(
+    const WeightImageType * image)
+{
+  itkAssertOrThrowMacro(image != 0, "Weight image is null.");
+  m_WeightImages.push_back(image);
+  this->Modified();
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+void MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::ClearWeightImages()
+{
+  m_WeightImages.clear();
+  this->Modified();
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+unsigned int MultiClassWeightedHistogramCalculator< TImage, TWeightPixel,
+    TLabelImage >::GetNumberOfClasses() const
+{
+  const unsigned int fromVector = m_WeightVectorImage ?
+      m_WeightVectorImage->GetNumberOfComponentsPerPixel() : 0;
+  return fromVector + m_WeightImages.size();
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+typename MultiClassWeightedHistogramCalculator< TImage, TWeightPixel,
+    TLabelImage >::HistogramPointer MultiClassWeightedHistogramCalculator<
+    TImage, TWeightPixel, TLabelImage >::NewHistogram() const
+{
+  HistogramPointer histogram = HistogramType::New();
+  histogram->SetMeasurementVectorSize(m_NumberOfComponents);
+  histogram->Initialize(m_HistogramSize, m_Minimum, m_Maximum);
+  return histogram;
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+void MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::Compute()
+{
+  itkAssertOrThrowMacro(m_Input, "Input is not set.");
+  itkAssertOrThrowMacro(this->GetNumberOfClasses() > 0, "No weight is set.");
+
+  m_Region = m_Input->GetBufferedRegion();
+  m_NumberOfComponents = m_Input->GetNumberOfComponentsPerPixel();
+  itkAssertOrThrowMacro(m_HistogramSize.Size() == m_NumberOfComponents,
+                        "Histogram size does not match the input.");
+  for (size_t i = 0; i < m_WeightImages.size(); i++)
+  {
+    itkAssertOrThrowMacro(m_WeightImages[i]->GetBufferedRegion().IsInside(m_Region),
+                          "Weight image does not cover the input.");
+  }
+  itkAssertOrThrowMacro(
+      !m_WeightVectorImage || m_WeightVectorImage->GetBufferedRegion().IsInside(m_Region),
+      "Weight image does not cover the input.");
+  itkAssertOrThrowMacro(
+      !m_LabelImage || m_LabelImage->GetBufferedRegion().IsInside(m_Region),
+      "Label image does not cover the input.");
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads(m_NumberOfThreads);
+  const ThreadIdType numberOfThreads = threader->GetNumberOfThreads();
+  threader->SetSingleMethod(this->ThreaderCallback, this);
+
+  /*
+   * Range of the input, widened by the margin ImageToHistogramFilter adds.
+   */
+  m_ThreadMinimum.assign(numberOfThreads, HistogramMeasurementVectorType(
+      m_NumberOfComponents));
+  m_ThreadMaximum.assign(numberOfThreads, HistogramMeasurementVectorType(
+      m_NumberOfComponents));
+  for (ThreadIdType t = 0; t < numberOfThreads; t++)
+  {
+    m_ThreadMinimum[t].Fill(NumericTraits< HistogramMeasurementType >::max());
+    m_ThreadMaximum[t].Fill(NumericTraits< HistogramMeasurementType >::NonpositiveMin());
+  }
+  m_ComputeMinimumAndMaximum = true;
+  m_NextSlice = 0;
+  threader->SingleMethodExecute();
+
+  m_Minimum = m_ThreadMinimum[0];
+  m_Maximum = m_ThreadMaximum[0];
+  for (ThreadIdType t = 1; t < numberOfThreads; t++)
+  {
+    for (unsigned int i = 0; i < m_NumberOfComponents; i++)
+    {
+      m_Minimum[i] = std::min(m_Minimum[i], m_ThreadMinimum[t][i]);
+      m_Maximum[i] = std::max(m_Maximum[i], m_ThreadMaximum[t][i]);
+    }
+  }
+  for (unsigned int i = 0; i < m_NumberOfComponents; i++)
+  {
+    const HistogramMeasurementType margin = (m_Maximum[i] - m_Minimum[i])
+        / static_cast< HistogramMeasurementType >(m_HistogramSize[i])
+        / static_cast< HistogramMeasurementType >(m_MarginalScale);
+    if (NumericTraits< HistogramMeasurementType >::max() - m_Maximum[i] > margin)
+    {
+      m_Maximum[i] += margin;
+    }
+  }
+
+  const unsigned int numberOfClasses = this->GetNumberOfClasses();
+  m_ThreadHistograms.resize(numberOfThreads);
+  for (ThreadIdType t = 0; t < numberOfThreads; t++)
+  {
+    m_ThreadHistograms[t].clear();
+    for (unsigned int c = 0; c < numberOfClasses; c++)
+    {
+      m_ThreadHistograms[t].push_back(this->NewHistogram());
+    }
+  }
+  m_ComputeMinimumAndMaximum = false;
+  m_NextSlice = 0;
+  threader->SingleMethodExecute();
+
+  m_Histograms.clear();
+  for (unsigned int c = 0; c < numberOfClasses; c++)
+  {
+    HistogramPointer histogram = this->NewHistogram();
+    for (ThreadIdType t = 0; t < numberOfThreads; t++)
+    {
+      const HistogramType * threadHistogram = m_ThreadHistograms[t][c];
+      for (SizeValueType n = 0; n < histogram->Size(); n++)
+      {
+        histogram->IncreaseFrequency(n, threadHistogram->GetFrequency(n));
+      }
+    }
+    m_Histograms.push_back(histogram);
+  }
+  m_ThreadHistograms.clear();
+  m_ThreadMinimum.clear();
+  m_ThreadMaximum.clear();
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+ITK_THREAD_RETURN_TYPE MultiClassWeightedHistogramCalculator< TImage,
+    TWeightPixel, TLabelImage >::ThreaderCallback(void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+      static_cast< MultiThreader::ThreadInfoStruct * >(arg);
+  Self * calculator = static_cast< Self * >(info->UserData);
+  calculator->ThreadedComputeSlices(info->ThreadID);
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+void MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::ThreadedComputeSlices(
+    ThreadIdType threadId)
+{
+  const SizeValueType numberOfSlices = m_Region.GetSize()[ImageDimension - 1];
+  while (true)
+  {
+    m_SliceLock.Lock();
+    const SizeValueType slice = m_NextSlice++;
+    m_SliceLock.Unlock();
+    if (slice >= numberOfSlices)
+    {
+      break;
+    }
+    RegionType region = m_Region;
+    region.SetIndex(ImageDimension - 1,
+                    m_Region.GetIndex()[ImageDimension - 1] + slice);
+    region.SetSize(ImageDimension - 1, 1);
+    if (m_ComputeMinimumAndMaximum)
+    {
+      this->ThreadedComputeMinimumAndMaximum(region, threadId);
+    }
+    else
+    {
+      this->ThreadedComputeHistograms(region, threadId);
+    }
+  }
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+void MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::ThreadedComputeMinimumAndMaximum(
+    const RegionType & region, ThreadIdType threadId)
+{
+  HistogramMeasurementVectorType & minimum = m_ThreadMinimum[threadId];
+  HistogramMeasurementVectorType & maximum = m_ThreadMaximum[threadId];
+  HistogramMeasurementVectorType m(m_NumberOfComponents);
+  ImageRegionConstIterator< ImageType > it(m_Input, region);
+  for (; !it.IsAtEnd(); ++it)
+  {
+    NumericTraits< PixelType >::AssignToArray(it.Get(), m);
+    for (unsigned int i = 0; i < m_NumberOfComponents; i++)
+    {
+      minimum[i] = std::min(minimum[i], m[i]);
+      maximum[i] = std::max(maximum[i], m[i]);
+    }
+  }
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+void MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::ThreadedComputeHistograms(
+    const RegionType & region, ThreadIdType threadId)
+{
+  std::vector< HistogramPointer > & histograms = m_ThreadHistograms[threadId];
+  const unsigned int numberOfClasses = histograms.size();
+  const unsigned int fromVector = numberOfClasses - m_WeightImages.size();
+
+  std::vector< ImageRegionConstIterator< WeightImageType > > weightIts;
+  for (size_t i = 0; i < m_WeightImages.size(); i++)
+  {
+    weightIts.push_back(ImageRegionConstIterator< WeightImageType >(
+        m_WeightImages[i], region));
+  }
+  ImageRegionConstIterator< WeightVectorImageType > vit;
+  if (m_WeightVectorImage)
+  {
+    vit = ImageRegionConstIterator< WeightVectorImageType >(
+        m_WeightVectorImage, region);
+  }
+  ImageRegionConstIterator< LabelImageType > lit;
+  if (m_LabelImage)
+  {
+    lit = ImageRegionConstIterator< LabelImageType >(m_LabelImage, region);
+  }
+
+  std::vector< TWeightPixel > weights(numberOfClasses);
+  HistogramMeasurementVectorType m(m_NumberOfComponents);
+  ImageRegionConstIterator< ImageType > it(m_Input, region);
+  for (; !it.IsAtEnd(); ++it)
+  {
+    if (m_WeightVectorImage)
+    {
+      const typename WeightVectorImageType::PixelType & w = vit.Get();
+      for (unsigned int c = 0; c < fromVector; c++)
+      {
+        weights[c] = w[c];
+      }
+      ++vit;
+    }
+    for (size_t i = 0; i < weightIts.size(); i++)
+    {
+      weights[fromVector + i] = weightIts[i].Get();
+      ++weightIts[i];
+    }
+    unsigned int onlyClass = numberOfClasses;
+    if (m_LabelImage)
+    {
+      onlyClass = static_cast< unsigned int >(lit.Get());
+      ++lit;
+      if (onlyClass >= numberOfClasses)
+      {
+        continue;
+      }
+    }
+
+    NumericTraits< PixelType >::AssignToArray(it.Get(), m);
+    for (unsigned int c = 0; c < numberOfClasses; c++)
+    {
+      if (weights[c] == NumericTraits< TWeightPixel >::ZeroValue()
+          || (onlyClass < numberOfClasses && c != onlyClass))
+      {
+        continue;
+      }
+      histograms[c]->IncreaseFrequencyOfMeasurement(m,
+          m_BinaryWeights ? NumericTraits< TWeightPixel >::OneValue() : weights[c]);
+    }
+  }
+}
+
+template< typename TImage, typename TWeightPixel, typename TLabelImage >
+void MultiClassWeightedHistogramCalculator< TImage, TWeightPixel, TLabelImage >::PrintSelf(
+    std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Number of classes: " << this->GetNumberOfClasses()
+     << std::endl;
+  os << indent << "Binary weights: " << m_BinaryWeights << std::endl;
+  os << indent << "Marginal scale: " << m_MarginalScale << std::endl;
+}
+} // end namespace Statistics
+} // end namespace itk
+
+#endif
@@ -0,0 +1,143 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodMultiRadiusStatisticalTestImageFilter_h
+#define __itkNeighborhoodMultiRadiusStatisticalTestImageFilter_h
+
+#include "itkStatisticalTestBase.h"
+#include "itkReusableListSample.h"
+#include "itkSortedNeighborhoodSample.h"
+#include "itkActiveVoxelBoxImageFilter.h"
+#include "itkVectorImage.h"
+#include "itkArray.h"
+
+#include <vector>
+#include <utility>
+
+namespace itk
+{
+/** \class NeighborhoodMultiRadiusStatisticalTestImageFilter
+ *
+ * One sample statistical test over a series of nested neighborhoods. The
+ * output is a vector image with one statistic per radius, in the order the
+ * radii are given. Every radius must contain the previous one; the
+ * neighborhood of the largest radius is split into shells and the sample of
+ * each radius is the sample of the previous radius extended by its shell, so
+ * the neighborhood is gathered once per voxel whatever the number of radii.
+ *
+ * Each shell is sorted by its first component and merged into the sorted
+ * sample of the previous radius, which is handed sorted to the test; with
+ * SortedSecond set the test skips its own sort, so a radius only adds a
+ * linear merge and a CDF walk to the cost of the largest radius.
+ */
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+class NeighborhoodMultiRadiusStatisticalTestImageFilter: public ActiveVoxelBoxImageFilter<TInputImage,TOutputImage >
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef NeighborhoodMultiRadiusStatisticalTestImageFilter Self;
+  typedef ActiveVoxelBoxImageFilter< TInputImage, TOutputImage > Superclass;
+  typedef SmartPointer< Self > Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro (Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(NeighborhoodMultiRadiusStatisticalTestImageFilter, ActiveVoxelBoxImageFilter);
+
+  /** Image typedef support. */
+  typedef TInputImage InputImageType;
+  typedef TOutputImage OutputImageType;
+
+  typedef typename InputImageType::PixelType InputPixelType;
+  typedef typename OutputImageType::PixelType OutputPixelType;
+  typedef typename OutputImageType::InternalPixelType OutputInternalPixelType;
+
+  typedef typename InputImageType::RegionType InputImageRegionType;
+  typedef typename OutputImageType::RegionType OutputImageRegionType;
+
+  typedef typename InputImageType::SizeType InputSizeType;
+  typedef typename Superclass::RadiusType RadiusType;
+  typedef std::vector< RadiusType > RadiusListType;
+
+  typedef TReferenceSample ReferenceSampleType;
+  typedef Array< InputPixelType > MeasurementVectorType;
+  typedef Statistics::ReusableListSample<MeasurementVectorType> InternalSampleType;
+  typedef Statistics::StatisticalTestBase<TReferenceSample, InternalSampleType> StatisticsTestType;
+  typedef typename StatisticsTestType::ScratchType StatisticsScratchType;
+
+  itkGetConstMacro(BackgroundPixel, InputPixelType);
+  itkSetMacro(BackgroundPixel, InputPixelType);
+
+  itkGetObjectMacro(Statistics,StatisticsTestType);
+  itkSetObjectMacro(Statistics, StatisticsTestType);
+
+  itkGetObjectMacro(RefrenceSample,ReferenceSampleType);
+  itkSetObjectMacro(RefrenceSample, ReferenceSampleType);
+
+  /** Radii of the nested neighborhoods. The box radius of the filter is set
+   * to the last one. */
+  void SetRadii(const RadiusListType & radii);
+  const RadiusListType & GetRadii() const
+  {
+    return m_Radii;
+  }
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  // Begin concept checking
+  itkConceptMacro( InputLessThanComparableCheck,
+      ( Concept::LessThanComparable< InputPixelType > ) );
+  // End concept checking
+#endif
+
+protected:
+  NeighborhoodMultiRadiusStatisticalTestImageFilter();
+  virtual ~NeighborhoodMultiRadiusStatisticalTestImageFilter()
+  {
+  }
+
+  void GenerateOutputInformation();
+
+  void BeforeThreadedGenerateData();
+
+  void ThreadedComputeRegion(const OutputImageRegionType & outputRegionForThread,
+                             ThreadIdType threadId, ProgressReporter & progress);
+
+  void ComputeActiveRuns(const OutputImageRegionType & region);
+
+  void AfterThreadedGenerateData();
+
+  void PrintSelf(std::ostream & os, Indent indent) const;
+
+private:
+  NeighborhoodMultiRadiusStatisticalTestImageFilter(const Self &); //purposely not implemented
+  void operator=(const Self &); //purposely not implemented
+
+  typename StatisticsTestType::Pointer m_Statistics;
+  typename ReferenceSampleType::Pointer m_RefrenceSample;
+
+  InputPixelType m_BackgroundPixel;
+
+  RadiusListType m_Radii;
+
+  /** Neighborhood indices of the largest neighborhood ordered by shell;
+   * shell k spans [m_ShellBegin[k], m_ShellBegin[k + 1]). */
+  std::vector< unsigned int > m_ShellIndices;
+  std::vector< size_t > m_ShellBegin;
+
+  /** Per thread: the sorted sample handed to the test, the gathered
+   * neighborhood, and the order of the gathered values by first component. */
+  typedef Statistics::SortedNeighborhoodSample< std::pair< double, unsigned int > > OrderSampleType;
+  std::vector< typename InternalSampleType::Pointer > m_ThreadPixels;
+  std::vector< typename InternalSampleType::Pointer > m_ThreadGathered;
+  std::vector< OrderSampleType > m_ThreadOrder;
+  std::vector< StatisticsScratchType > m_ThreadScratch;
+};
+}
+// end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkNeighborhoodMultiRadiusStatisticalTestImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodMultiRadiusStatisticalTestImageFilter_hxx
+#define __itkNeighborhoodMultiRadiusStatisticalTestImageFilter_hxx
+#include "itkNeighborhoodMultiRadiusStatisticalTestImageFilter.h"
+
+#include "itkConstNeighborhoodIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkNeighborhood.h"
+#include "itkNeighborhoodAlgorithm.h"
+
+#include <vector>
+
+namespace itk
+{
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::NeighborhoodMultiRadiusStatisticalTestImageFilter()
+{
+  m_Statistics = 0;
+  m_BackgroundPixel = NumericTraits< InputPixelType >::ZeroValue();
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::SetRadii(const RadiusListType & radii)
+{
+  itkAssertOrThrowMacro(!radii.empty(), "At least one radius is required.");
+  for (size_t k = 1; k < radii.size(); k++)
+  {
+    for (unsigned int d = 0; d < InputImageType::ImageDimension; d++)
+    {
+      itkAssertOrThrowMacro(radii[k][d] >= radii[k - 1][d],
+                            "Each radius must contain the previous one.");
+    }
+  }
+  m_Radii = radii;
+  this->SetRadius(m_Radii.back());
+  this->Modified();
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::GenerateOutputInformation()
+{
+  Superclass::GenerateOutputInformation();
+  this->GetOutput()->SetNumberOfComponentsPerPixel(m_Radii.size());
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::BeforeThreadedGenerateData()
+{
+  itkAssertOrThrowMacro(!m_Radii.empty(), "Radii are not set.");
+  itkAssertOrThrowMacro(!this->GetUseBallNeighborhood(),
+                        "Nested radii only support box neighborhoods.");
+
+  /*
+   * Shell of a neighbor is the first radius whose box contains its offset.
+   */
+  Neighborhood< char, InputImageType::ImageDimension > neighborhood;
+  neighborhood.SetRadius(m_Radii.back());
+  const unsigned int numberOfRadii = m_Radii.size();
+  std::vector< std::vector< unsigned int > > shells(numberOfRadii);
+  for (unsigned int i = 0; i < neighborhood.Size(); i++)
+  {
+    const typename Neighborhood< char, InputImageType::ImageDimension >::OffsetType offset =
+        neighborhood.GetOffset(i);
+    for (unsigned int k = 0; k < numberOfRadii; k++)
+    {
+      bool inside = true;
+      for (unsigned int d = 0; d < InputImageType::ImageDimension; d++)
+      {
+        if (offset[d] > static_cast< OffsetValueType >(m_Radii[k][d])
+            || -offset[d] > static_cast< OffsetValueType >(m_Radii[k][d]))
+        {
+          inside = false;
+          break;
+        }
+      }
+      if (inside)
+      {
+        shells[k].push_back(i);
+        break;
+      }
+    }
+  }
+  m_ShellIndices.clear();
+  m_ShellBegin.clear();
+  for (unsigned int k = 0; k < numberOfRadii; k++)
+  {
+    m_ShellBegin.push_back(m_ShellIndices.size());
+    m_ShellIndices.insert(m_ShellIndices.end(), shells[k].begin(), shells[k].end());
+  }
+  m_ShellBegin.push_back(m_ShellIndices.size());
+  m_Statistics->PrepareEvaluation(m_RefrenceSample.GetPointer(),
+                                  neighborhood.Size());
+
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+  const unsigned int components =
+      this->GetInput()->GetNumberOfComponentsPerPixel();
+  m_ThreadPixels.clear();
+  m_ThreadGathered.clear();
+  m_ThreadScratch.clear();
+  m_ThreadOrder.assign(numberOfThreads, OrderSampleType());
+  for (ThreadIdType t = 0; t < numberOfThreads; t++)
+  {
+    typename InternalSampleType::Pointer pixels = InternalSampleType::New();
+    pixels->SetMeasurementVectorSize(components);
+    m_ThreadPixels.push_back(pixels);
+    typename InternalSampleType::Pointer gathered = InternalSampleType::New();
+    gathered->SetMeasurementVectorSize(components);
+    m_ThreadGathered.push_back(gathered);
+    m_ThreadOrder[t].Reserve(neighborhood.Size());
+    m_ThreadScratch.push_back(StatisticsScratchType());
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::AfterThreadedGenerateData()
+{
+  m_ThreadPixels.clear();
+  m_ThreadGathered.clear();
+  m_ThreadOrder.clear();
+  m_ThreadScratch.clear();
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ComputeActiveRuns(const OutputImageRegionType & region)
+{
+  this->AddActiveRuns(this->GetInput(), region,
+                      Functor::ActiveIfNotEqual< InputPixelType >(m_BackgroundPixel));
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ThreadedComputeRegion(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId,
+    ProgressReporter & progress)
+{
+  typename InputImageType::ConstPointer input = this->GetInput();
+  typename OutputImageType::Pointer output = this->GetOutput();
+
+  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType > bC;
+  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
+      bC(input, outputRegionForThread, this->GetRadius());
+
+  ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
+
+  InternalSampleType * pixels = m_ThreadPixels[threadId];
+  InternalSampleType * gathered = m_ThreadGathered[threadId];
+  OrderSampleType & order = m_ThreadOrder[threadId];
+  StatisticsScratchType & scratch = m_ThreadScratch[threadId];
+  MeasurementVectorType mv(input->GetNumberOfComponentsPerPixel());
+
+  const unsigned int numberOfRadii = m_Radii.size();
+  OutputPixelType statistics(numberOfRadii);
+  OutputPixelType zero(numberOfRadii);
+  zero.Fill(NumericTraits< OutputInternalPixelType >::ZeroValue());
+
+  for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
+      InputImageType >::FaceListType::iterator fit = faceList.begin();
+      fit != faceList.end(); ++fit)
+  {
+    ImageRegionIterator< OutputImageType > it = ImageRegionIterator<
+        OutputImageType >(output, *fit);
+
+    ConstNeighborhoodIterator< InputImageType > bit = ConstNeighborhoodIterator<
+        InputImageType >(this->GetRadius(), input, *fit);
+    bit.OverrideBoundaryCondition(&nbcInput);
+    bit.GoToBegin();
+
+    while (!bit.IsAtEnd())
+    {
+      if (bit.GetCenterPixel() != m_BackgroundPixel)
+      {
+        gathered->Clear();
+        order.Clear();
+        for (unsigned int k = 0; k < numberOfRadii; k++)
+        {
+          for (size_t j = m_ShellBegin[k]; j < m_ShellBegin[k + 1]; j++)
+          {
+            const InputPixelType & p = bit.GetPixel(m_ShellIndices[j]);
+            if (p != m_BackgroundPixel)
+            {
+              NumericTraits< InputPixelType >::AssignToArray(p, mv);
+              order.Insert(std::make_pair(static_cast< double >(mv[0]),
+                                          static_cast< unsigned int >(gathered->Size())));
+              gathered->PushBack(mv);
+            }
+          }
+          /* The shell is sorted and merged into the previous radius. */
+          order.Update();
+          pixels->Clear();
+          for (typename OrderSampleType::ConstIterator oit = order.Begin();
+              oit != order.End(); ++oit)
+          {
+            pixels->PushBack(gathered->GetMeasurementVector(oit->second));
+          }
+          statistics[k] = static_cast< OutputInternalPixelType >(
+              m_Statistics->Evaluate(m_RefrenceSample.GetPointer(), pixels,
+                                     scratch));
+        }
+        it.Set(statistics);
+      }
+      else
+      {
+        it.Set(zero);
+      }
+
+      ++bit;
+      ++it;
+      progress.CompletedPixel();
+    }
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiRadiusStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Radii:";
+  for (size_t k = 0; k < m_Radii.size(); k++)
+  {
+    os << " " << m_Radii[k];
+  }
+  os << std::endl;
+}
+} // end namespace itk
+
+#endif
@@ -0,0 +1,183 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodMultiSequenceKSImageFilter_h
+#define __itkNeighborhoodMultiSequenceKSImageFilter_h
+
+#include "itkActiveVoxelBoxImageFilter.h"
+#include "itkImage.h"
+#include "itkConstNeighborhoodIterator.h"
+
+#include "itkKolmogorovSmirnovTest.h"
+#include "itkSortedNeighborhoodSample.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class NeighborhoodMultiSequenceKSImageFilter
+ *
+ * One sample KS search over several co-registered sequences in a single
+ * traversal. Each sequence is tested against its own reference distribution
+ * and direction, as NeighborhoodOneSampleKSImageFilter does for one sequence,
+ * while the mask neighborhood is read once for all of them.
+ *
+ * The first sequence is the primary input and the mask is input 1, as for
+ * NeighborhoodOneSampleKSImageFilter. Output 0 is the voxel-wise maximum of
+ * the statistics and GetSequenceOutput(i) the statistic of sequence i.
+ */
+template< typename TInputImage, typename ProbabilityPrecision = double,
+    typename LabelType = unsigned char >
+class NeighborhoodMultiSequenceKSImageFilter: public ActiveVoxelBoxImageFilter< TInputImage,
+    Image< ProbabilityPrecision, TInputImage::ImageDimension > >
+{
+public:
+  /** Extract dimension from input and output image. */
+  itkStaticConstMacro(InputImageDimension, unsigned int,
+      TInputImage::ImageDimension);
+  itkStaticConstMacro(OutputImageDimension, unsigned int,
+      InputImageDimension);
+
+  /** Convenient typedefs for simplifying declarations. */
+  typedef TInputImage InputImageType;
+  typedef Image<ProbabilityPrecision, TInputImage::ImageDimension> OutputImageType;
+  typedef Image< LabelType, InputImageDimension > LabelImageType;
+
+  /** Standard class typedefs. */
+  typedef NeighborhoodMultiSequenceKSImageFilter Self;
+  typedef ActiveVoxelBoxImageFilter< InputImageType, OutputImageType > Superclass;
+  typedef SmartPointer< Self > Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(NeighborhoodMultiSequenceKSImageFilter, ActiveVoxelBoxImageFilter);
+
+  /** Image typedef support. */
+  typedef typename InputImageType::PixelType InputPixelType;
+  typedef typename OutputImageType::PixelType OutputPixelType;
+
+  typedef typename InputImageType::RegionType InputImageRegionType;
+  typedef typename OutputImageType::RegionType OutputImageRegionType;
+
+  typedef typename InputImageType::SizeType InputSizeType;
+  typedef typename Superclass::NeighborhoodSpansType NeighborhoodSpansType;
+  typedef typename Superclass::SlidingWindowType SlidingWindowType;
+
+  typedef Statistics::KolmogorovSmirnovTest< InputPixelType > KSType;
+  typedef typename KSType::DistributionType DistributionType;
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  // Begin concept checking
+  itkConceptMacro( InputLessThanComparableCheck,
+      ( Concept::LessThanComparable< InputPixelType > ) );
+  // End concept checking
+#endif
+
+  void SetMask( const LabelImageType *image)
+  {
+    this->ProcessObject::SetNthInput( 1, const_cast< LabelImageType * >( image ) );
+  }
+
+  const LabelImageType * GetMask()
+  {
+    return static_cast<const LabelImageType*>(this->ProcessObject::GetInput(1));
+  }
+
+  /** Add a sequence with its reference distribution and test direction. */
+  void AddSequence(const InputImageType * image, const DistributionType & reference,
+                   bool positive);
+
+  unsigned int GetNumberOfSequences() const
+  {
+    return static_cast< unsigned int >(m_References.size());
+  }
+
+  const InputImageType * GetSequence(unsigned int i)
+  {
+    return static_cast< const InputImageType * >(
+        this->ProcessObject::GetInput(this->SequenceInputIndex(i)));
+  }
+
+  OutputImageType * GetSequenceOutput(unsigned int i)
+  {
+    return this->GetOutput(i + 1);
+  }
+
+protected:
+  NeighborhoodMultiSequenceKSImageFilter();
+  virtual ~NeighborhoodMultiSequenceKSImageFilter()
+  {}
+
+  void ThreadedComputeRegion(const OutputImageRegionType & outputRegionForThread,
+      ThreadIdType threadId, ProgressReporter & progress);
+
+  void ComputeActiveRuns(const OutputImageRegionType & region);
+
+  void PrintSelf(std::ostream & os, Indent indent) const;
+
+private:
+  NeighborhoodMultiSequenceKSImageFilter(const Self &); //purposely not implemented
+  void operator=(const Self &);//purposely not implemented
+
+  /** The mask sits between the first and the second sequence. */
+  static unsigned int SequenceInputIndex(unsigned int i)
+  {
+    return i == 0 ? 0 : i + 1;
+  }
+
+  typedef Statistics::SortedNeighborhoodSample< InputPixelType > SortedSampleType;
+
+  /** Window callbacks keeping the values of every sequence at the neighbors
+   * inside the mask. */
+  struct MaskedWindow
+  {
+    MaskedWindow(const std::vector< ConstNeighborhoodIterator< InputImageType > > & sequences,
+                 const ConstNeighborhoodIterator< LabelImageType > & mask,
+                 std::vector< SortedSampleType > & pixels):
+      Sequences(sequences), Mask(mask), Pixels(pixels)
+    {
+    }
+    void Clear()
+    {
+      for (size_t s = 0; s < Pixels.size(); s++)
+      {
+        Pixels[s].Clear();
+      }
+    }
+    void Insert(unsigned int i)
+    {
+      if (Mask.GetPixel(i) > NumericTraits< LabelType >::Zero)
+      {
+        for (size_t s = 0; s < Pixels.size(); s++)
+        {
+          Pixels[s].Insert(Sequences[s].GetPixel(i));
+        }
+      }
+    }
+    void Remove(unsigned int i)
+    {
+      if (Mask.GetPixel(i) > NumericTraits< LabelType >::Zero)
+      {
+        for (size_t s = 0; s < Pixels.size(); s++)
+        {
+          Pixels[s].Remove(Sequences[s].GetPixel(i));
+        }
+      }
+    }
+    const std::vector< ConstNeighborhoodIterator< InputImageType > > & Sequences;
+    const ConstNeighborhoodIterator< LabelImageType > & Mask;
+    std::vector< SortedSampleType > & Pixels;
+  };
+
+  std::vector< typename KSType::Pointer > m_KS;
+  std::vector< DistributionType > m_References;
+};
+}
+// end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkNeighborhoodMultiSequenceKSImageFilter.hxx"
+#endif
+
+#endif
@@ -0,0 +1,163 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodMultiSequenceKSImageFilter_hxx
+#define __itkNeighborhoodMultiSequenceKSImageFilter_hxx
+#include "itkNeighborhoodMultiSequenceKSImageFilter.h"
+
+#include "itkConstNeighborhoodIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkNeighborhoodAlgorithm.h"
+#include "itkOffset.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace itk
+{
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+NeighborhoodMultiSequenceKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::NeighborhoodMultiSequenceKSImageFilter()
+{
+  this->SetNumberOfRequiredInputs(2);
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodMultiSequenceKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::AddSequence(
+    const InputImageType * image, const DistributionType & reference, bool positive)
+{
+  const unsigned int i = this->GetNumberOfSequences();
+  this->ProcessObject::SetNthInput(this->SequenceInputIndex(i),
+                                   const_cast< InputImageType * >(image));
+
+  typename KSType::Pointer ks = KSType::New();
+  ks->SortedReferenceOn();
+  ks->SortedSampleOn();
+  ks->SetPositive(positive);
+  m_KS.push_back(ks);
+  m_References.push_back(reference);
+  std::sort(m_References.back().begin(), m_References.back().end());
+
+  this->SetNumberOfRequiredOutputs(i + 2);
+  this->SetNthOutput(i + 1, this->MakeOutput(i + 1));
+  this->Modified();
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodMultiSequenceKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::ComputeActiveRuns(
+    const OutputImageRegionType & region)
+{
+  this->AddActiveRuns(this->GetMask(), region,
+                      Functor::ActiveIfPositive< LabelType >());
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodMultiSequenceKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::ThreadedComputeRegion(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType itkNotUsed(threadId),
+    ProgressReporter & progress)
+{
+  typedef ConstNeighborhoodIterator< InputImageType > InputNeighborhoodIteratorType;
+  typedef ImageRegionIterator< OutputImageType > OutputIteratorType;
+
+  const unsigned int numberOfSequences = this->GetNumberOfSequences();
+  typename OutputImageType::Pointer output = this->GetOutput();
+  typename LabelImageType::ConstPointer mask = this->GetMask();
+
+  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType > bC;
+  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
+      bC(this->GetInput(), outputRegionForThread, this->GetRadius());
+
+  ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
+  ZeroFluxNeumannBoundaryCondition< LabelImageType > nbcLabel;
+
+  std::vector< SortedSampleType > pixels(numberOfSequences);
+  std::vector< InputNeighborhoodIteratorType > bit(numberOfSequences);
+  std::vector< OutputIteratorType > sit(numberOfSequences);
+  std::vector< const InputPixelType * > referenceBegin(numberOfSequences);
+  for (unsigned int s = 0; s < numberOfSequences; s++)
+  {
+    referenceBegin[s] = m_References[s].empty() ? 0 : &m_References[s][0];
+  }
+
+  for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
+      InputImageType >::FaceListType::iterator fit = faceList.begin();
+      fit != faceList.end(); ++fit)
+  {
+    OutputIteratorType it(output, *fit);
+
+    ConstNeighborhoodIterator< LabelImageType > maskIt = ConstNeighborhoodIterator<
+        LabelImageType >(this->GetRadius(), mask, *fit);
+    maskIt.OverrideBoundaryCondition(&nbcLabel);
+    maskIt.GoToBegin();
+
+    for (unsigned int s = 0; s < numberOfSequences; s++)
+    {
+      bit[s] = InputNeighborhoodIteratorType(this->GetRadius(),
+                                             this->GetSequence(s), *fit);
+      bit[s].OverrideBoundaryCondition(&nbcInput);
+      bit[s].GoToBegin();
+      sit[s] = OutputIteratorType(this->GetSequenceOutput(s), *fit);
+    }
+
+    for (unsigned int s = 0; s < numberOfSequences; s++)
+    {
+      pixels[s].Reserve(this->GetNeighborhoodSpans().GetNumberOfIndices());
+    }
+    SlidingWindowType window(this->GetNeighborhoodSpans(), *fit);
+    MaskedWindow callbacks(bit, maskIt, pixels);
+
+    while (!maskIt.IsAtEnd())
+    {
+      if (maskIt.GetCenterPixel() > itk::NumericTraits< LabelType >::Zero)
+      {
+        window.Enter(callbacks);
+
+        double combined = 0;
+        for (unsigned int s = 0; s < numberOfSequences; s++)
+        {
+          pixels[s].Update();
+          const double st = m_KS[s]->Evaluate(referenceBegin[s],
+                                              m_References[s].size(),
+                                              &pixels[s].GetValues()[0],
+                                              pixels[s].Size());
+          sit[s].Set(static_cast< OutputPixelType >(st));
+          combined = (s == 0) ? st : std::max(combined, st);
+        }
+        it.Set(static_cast< OutputPixelType >(combined));
+      }
+      else
+      {
+        window.Invalidate();
+        for (unsigned int s = 0; s < numberOfSequences; s++)
+        {
+          sit[s].Set(itk::NumericTraits< OutputPixelType >::ZeroValue());
+        }
+        it.Set(itk::NumericTraits< OutputPixelType >::ZeroValue());
+      }
+      window.Leave(maskIt.GetIndex(), callbacks);
+
+      ++maskIt;
+      for (unsigned int s = 0; s < numberOfSequences; s++)
+      {
+        ++bit[s];
+        ++sit[s];
+      }
+      ++it;
+      progress.CompletedPixel();
+    }
+  }
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodMultiSequenceKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::PrintSelf(
+    std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Number of sequences: " << m_References.size() << std::endl;
+  for (size_t s = 0; s < m_References.size(); s++)
+  {
+    os << indent << "Sequence " << s << ": " << m_References[s].size()
+       << " reference values, "
+       << (m_KS[s]->GetPositive() ? "positive" : "negative") << std::endl;
+  }
+}
+} // end namespace itk
+
+#endif
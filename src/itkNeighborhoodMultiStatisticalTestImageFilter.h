@@ -0,0 +1,151 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodMultiStatisticalTestImageFilter_h
+#define __itkNeighborhoodMultiStatisticalTestImageFilter_h
+
+#include "itkStatisticalTestBase.h"
+#include "itkReusableListSample.h"
+#include "itkActiveVoxelBoxImageFilter.h"
+#include "itkVectorImage.h"
+#include "itkArray.h"
+
+#include <vector>
+#include <utility>
+
+namespace itk
+{
+/** \class NeighborhoodMultiStatisticalTestImageFilter
+ *
+ * Several one sample statistical tests over the same neighborhoods, e.g. AP,
+ * KS and KKS in both directions. The output is a vector image with one
+ * component per test, in the order the tests are added.
+ *
+ * Each neighborhood is gathered and sorted by its first component once and
+ * handed sorted to every test; tests with SortedSecond set skip their own
+ * sort. On float and double images the neighborhoods of a scan line are
+ * evaluated with one EvaluateBatch() call per test that SupportsBatch().
+ */
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+class NeighborhoodMultiStatisticalTestImageFilter: public ActiveVoxelBoxImageFilter<TInputImage,TOutputImage >
+{
+public:
+
+  /** Standard class typedefs. */
+  typedef NeighborhoodMultiStatisticalTestImageFilter Self;
+  typedef ActiveVoxelBoxImageFilter< TInputImage, TOutputImage > Superclass;
+  typedef SmartPointer< Self > Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro (Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(NeighborhoodMultiStatisticalTestImageFilter, ActiveVoxelBoxImageFilter);
+
+  /** Image typedef support. */
+  typedef TInputImage InputImageType;
+  typedef TOutputImage OutputImageType;
+
+  typedef typename InputImageType::PixelType InputPixelType;
+  typedef typename OutputImageType::PixelType OutputPixelType;
+  typedef typename OutputImageType::InternalPixelType OutputInternalPixelType;
+
+  typedef typename InputImageType::RegionType InputImageRegionType;
+  typedef typename OutputImageType::RegionType OutputImageRegionType;
+
+  typedef typename InputImageType::SizeType InputSizeType;
+  typedef typename Superclass::NeighborhoodSpansType NeighborhoodSpansType;
+
+  typedef TReferenceSample ReferenceSampleType;
+  typedef Array< InputPixelType > MeasurementVectorType;
+  typedef Statistics::ReusableListSample<MeasurementVectorType> InternalSampleType;
+  typedef Statistics::StatisticalTestBase<TReferenceSample, InternalSampleType> StatisticsTestType;
+  typedef typename StatisticsTestType::ScratchType StatisticsScratchType;
+  typedef typename StatisticsTestType::OutputType StatisticsOutputType;
+  typedef Statistics::ScalarBatchTraits< InputPixelType > BatchTraitsType;
+  typedef typename BatchTraitsType::ValueType BatchValueType;
+
+  itkGetConstMacro(BackgroundPixel, InputPixelType);
+  itkSetMacro(BackgroundPixel, InputPixelType);
+
+  itkGetObjectMacro(RefrenceSample,ReferenceSampleType);
+  itkSetObjectMacro(RefrenceSample, ReferenceSampleType);
+
+  /** Add a test; its statistic is written to the next output component. */
+  void AddStatistics(StatisticsTestType * statistics);
+  void ClearStatistics();
+  unsigned int GetNumberOfStatistics() const
+  {
+    return m_Statistics.size();
+  }
+  StatisticsTestType * GetStatistics(unsigned int i) const
+  {
+    return m_Statistics[i];
+  }
+
+#ifdef ITK_USE_CONCEPT_CHECKING
+  // Begin concept checking
+  itkConceptMacro( InputLessThanComparableCheck,
+      ( Concept::LessThanComparable< InputPixelType > ) );
+  // End concept checking
+#endif
+
+protected:
+  NeighborhoodMultiStatisticalTestImageFilter();
+  virtual ~NeighborhoodMultiStatisticalTestImageFilter()
+  {
+  }
+
+  void GenerateOutputInformation();
+
+  void BeforeThreadedGenerateData();
+
+  void ThreadedComputeRegion(const OutputImageRegionType & outputRegionForThread,
+                             ThreadIdType threadId, ProgressReporter & progress);
+
+  void ComputeActiveRuns(const OutputImageRegionType & region);
+
+  void AfterThreadedGenerateData();
+
+  void PrintSelf(std::ostream & os, Indent indent) const;
+
+private:
+  NeighborhoodMultiStatisticalTestImageFilter(const Self &); //purposely not implemented
+  void operator=(const Self &); //purposely not implemented
+
+  void ThreadedComputeRegionBatch(const OutputImageRegionType & outputRegionForThread,
+                                  ThreadIdType threadId,
+                                  ProgressReporter & progress);
+
+  std::vector< typename StatisticsTestType::Pointer > m_Statistics;
+  typename ReferenceSampleType::Pointer m_RefrenceSample;
+
+  InputPixelType m_BackgroundPixel;
+
+  /** Scalar float or double image: neighborhoods are gathered as scalars. */
+  bool m_BatchMode;
+  std::vector< BatchValueType > m_BatchReferenceValues;
+  std::vector< StatisticsOutputType > m_BatchReferenceFrequencies;
+
+  /** Per thread: the sorted neighborhood as a sample, the gathered
+   * neighborhood and its sort order, one scratch per test, and in batch mode
+   * the scan line buffers with one result row per test. */
+  struct ThreadDataType
+  {
+    typename InternalSampleType::Pointer Pixels;
+    typename InternalSampleType::Pointer Gathered;
+    std::vector< std::pair< double, unsigned int > > Order;
+    std::vector< StatisticsScratchType > Scratch;
+    std::vector< BatchValueType > Values;
+    std::vector< SizeValueType > Offsets;
+    std::vector< std::vector< StatisticsOutputType > > Results;
+  };
+  std::vector< ThreadDataType > m_ThreadData;
+};
+}
+// end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkNeighborhoodMultiStatisticalTestImageFilter.hxx"
+#endif
+
+#endif
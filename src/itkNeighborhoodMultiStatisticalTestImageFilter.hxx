@@ -0,0 +1,373 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodMultiStatisticalTestImageFilter_hxx
+#define __itkNeighborhoodMultiStatisticalTestImageFilter_hxx
+#include "itkNeighborhoodMultiStatisticalTestImageFilter.h"
+
+#include "itkConstNeighborhoodIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkNeighborhoodAlgorithm.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace itk
+{
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::NeighborhoodMultiStatisticalTestImageFilter()
+{
+  m_BackgroundPixel = NumericTraits< InputPixelType >::ZeroValue();
+  m_BatchMode = false;
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::AddStatistics(StatisticsTestType * statistics)
+{
+  itkAssertOrThrowMacro(statistics != 0, "Statistical test is null.");
+  m_Statistics.push_back(statistics);
+  this->Modified();
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ClearStatistics()
+{
+  m_Statistics.clear();
+  this->Modified();
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::GenerateOutputInformation()
+{
+  Superclass::GenerateOutputInformation();
+  this->GetOutput()->SetNumberOfComponentsPerPixel(m_Statistics.size());
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::BeforeThreadedGenerateData()
+{
+  itkAssertOrThrowMacro(!m_Statistics.empty(), "No statistical test is set.");
+
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+  const unsigned int numberOfStatistics = m_Statistics.size();
+  const unsigned int components =
+      this->GetInput()->GetNumberOfComponentsPerPixel();
+
+  SizeValueType neighborhoodSize = 1;
+  for (unsigned int d = 0; d < InputImageType::ImageDimension; d++)
+  {
+    neighborhoodSize *= 2 * this->GetRadius()[d] + 1;
+  }
+  for (unsigned int s = 0; s < numberOfStatistics; s++)
+  {
+    m_Statistics[s]->PrepareEvaluation(m_RefrenceSample.GetPointer(),
+                                       neighborhoodSize);
+  }
+
+  m_BatchMode = BatchTraitsType::Supported && components == 1;
+  if (m_BatchMode)
+  {
+    std::vector< std::pair< BatchValueType, StatisticsOutputType > > ref;
+    for (typename ReferenceSampleType::ConstIterator rit = m_RefrenceSample->Begin();
+        rit != m_RefrenceSample->End(); ++rit)
+    {
+      ref.push_back(std::make_pair(
+          static_cast< BatchValueType >(rit.GetMeasurementVector()[0]),
+          static_cast< StatisticsOutputType >(rit.GetFrequency())));
+    }
+    std::sort(ref.begin(), ref.end());
+    m_BatchReferenceValues.resize(ref.size());
+    m_BatchReferenceFrequencies.resize(ref.size());
+    for (size_t i = 0; i < ref.size(); i++)
+    {
+      m_BatchReferenceValues[i] = ref[i].first;
+      m_BatchReferenceFrequencies[i] = ref[i].second;
+    }
+  }
+
+  /*
+   * Scratch is filled in place: a copied scratch would share its subsamples.
+   */
+  m_ThreadData.clear();
+  m_ThreadData.resize(numberOfThreads);
+  for (ThreadIdType t = 0; t < numberOfThreads; t++)
+  {
+    ThreadDataType & data = m_ThreadData[t];
+    data.Pixels = InternalSampleType::New();
+    data.Pixels->SetMeasurementVectorSize(components);
+    data.Gathered = InternalSampleType::New();
+    data.Gathered->SetMeasurementVectorSize(components);
+    for (unsigned int s = 0; s < numberOfStatistics; s++)
+    {
+      data.Scratch.push_back(StatisticsScratchType());
+    }
+    data.Results.resize(numberOfStatistics);
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::AfterThreadedGenerateData()
+{
+  m_ThreadData.clear();
+  m_BatchReferenceValues.clear();
+  m_BatchReferenceFrequencies.clear();
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ComputeActiveRuns(const OutputImageRegionType & region)
+{
+  this->AddActiveRuns(this->GetInput(), region,
+                      Functor::ActiveIfNotEqual< InputPixelType >(m_BackgroundPixel));
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ThreadedComputeRegion(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId,
+    ProgressReporter & progress)
+{
+  if (m_BatchMode)
+  {
+    this->ThreadedComputeRegionBatch(outputRegionForThread, threadId, progress);
+    return;
+  }
+
+  typename InputImageType::ConstPointer input = this->GetInput();
+  typename OutputImageType::Pointer output = this->GetOutput();
+
+  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType > bC;
+  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
+      bC(input, outputRegionForThread, this->GetRadius());
+
+  ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
+
+  ThreadDataType & data = m_ThreadData[threadId];
+  InternalSampleType * pixels = data.Pixels;
+  InternalSampleType * gathered = data.Gathered;
+  MeasurementVectorType mv(input->GetNumberOfComponentsPerPixel());
+
+  const unsigned int numberOfStatistics = m_Statistics.size();
+  OutputPixelType statistics(numberOfStatistics);
+  OutputPixelType zero(numberOfStatistics);
+  zero.Fill(NumericTraits< OutputInternalPixelType >::ZeroValue());
+
+  for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
+      InputImageType >::FaceListType::iterator fit = faceList.begin();
+      fit != faceList.end(); ++fit)
+  {
+    ImageRegionIterator< OutputImageType > it = ImageRegionIterator<
+        OutputImageType >(output, *fit);
+
+    ConstNeighborhoodIterator< InputImageType > bit = ConstNeighborhoodIterator<
+        InputImageType >(this->GetRadius(), input, *fit);
+    bit.OverrideBoundaryCondition(&nbcInput);
+    bit.GoToBegin();
+
+    const NeighborhoodSpansType & spans = this->GetNeighborhoodSpans();
+    while (!bit.IsAtEnd())
+    {
+      if (bit.GetCenterPixel() != m_BackgroundPixel)
+      {
+        /*
+         * Gather once, order by the first component and store the sorted
+         * neighborhood for all tests.
+         */
+        gathered->Clear();
+        data.Order.clear();
+        for (size_t k = 0; k < spans.GetSpans().size(); k++)
+        {
+          const unsigned int spanBegin = spans.GetSpans()[k].Begin;
+          const unsigned int spanEnd = spanBegin + spans.GetSpans()[k].Length;
+          for (unsigned int i = spanBegin; i < spanEnd; i++)
+          {
+            const InputPixelType & p = bit.GetPixel(i);
+            if (p != m_BackgroundPixel)
+            {
+              NumericTraits< InputPixelType >::AssignToArray(p, mv);
+              data.Order.push_back(std::make_pair(static_cast< double >(mv[0]),
+                                                  gathered->Size()));
+              gathered->PushBack(mv);
+            }
+          }
+        }
+        std::sort(data.Order.begin(), data.Order.end());
+        pixels->Clear();
+        for (size_t j = 0; j < data.Order.size(); j++)
+        {
+          pixels->PushBack(gathered->GetMeasurementVector(data.Order[j].second));
+        }
+
+        for (unsigned int s = 0; s < numberOfStatistics; s++)
+        {
+          statistics[s] = static_cast< OutputInternalPixelType >(
+              m_Statistics[s]->Evaluate(m_RefrenceSample.GetPointer(), pixels,
+                                        data.Scratch[s]));
+        }
+        it.Set(statistics);
+      }
+      else
+      {
+        it.Set(zero);
+      }
+
+      ++bit;
+      ++it;
+      progress.CompletedPixel();
+    }
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ThreadedComputeRegionBatch(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId,
+    ProgressReporter & progress)
+{
+  typename InputImageType::ConstPointer input = this->GetInput();
+  typename OutputImageType::Pointer output = this->GetOutput();
+
+  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType > bC;
+  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
+      bC(input, outputRegionForThread, this->GetRadius());
+
+  ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
+
+  ThreadDataType & data = m_ThreadData[threadId];
+  std::vector< BatchValueType > & values = data.Values;
+  std::vector< SizeValueType > & offsets = data.Offsets;
+  InternalSampleType * pixels = data.Pixels;
+  MeasurementVectorType mv(1);
+
+  const SizeValueType referenceSize = m_BatchReferenceValues.size();
+  const BatchValueType * referenceValues =
+      referenceSize ? &m_BatchReferenceValues[0] : 0;
+  const StatisticsOutputType * referenceFrequencies =
+      referenceSize ? &m_BatchReferenceFrequencies[0] : 0;
+
+  const unsigned int numberOfStatistics = m_Statistics.size();
+  OutputPixelType statistics(numberOfStatistics);
+
+  for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
+      InputImageType >::FaceListType::iterator fit = faceList.begin();
+      fit != faceList.end(); ++fit)
+  {
+    ImageRegionIterator< OutputImageType > it = ImageRegionIterator<
+        OutputImageType >(output, *fit);
+
+    ConstNeighborhoodIterator< InputImageType > bit = ConstNeighborhoodIterator<
+        InputImageType >(this->GetRadius(), input, *fit);
+    bit.OverrideBoundaryCondition(&nbcInput);
+    bit.GoToBegin();
+
+    const NeighborhoodSpansType & spans = this->GetNeighborhoodSpans();
+    const IndexValueType lastInRow = fit->GetIndex()[0]
+        + static_cast< IndexValueType >(fit->GetSize()[0]) - 1;
+
+    /*
+     * The sorted neighborhoods of a scan line are kept in one buffer;
+     * background voxels get an empty neighborhood. Tests without a batch
+     * implementation are evaluated voxel by voxel from the same buffer.
+     */
+    values.clear();
+    offsets.clear();
+    offsets.push_back(0);
+    while (!bit.IsAtEnd())
+    {
+      const size_t begin = values.size();
+      if (bit.GetCenterPixel() != m_BackgroundPixel)
+      {
+        for (size_t k = 0; k < spans.GetSpans().size(); k++)
+        {
+          const unsigned int spanBegin = spans.GetSpans()[k].Begin;
+          const unsigned int spanEnd = spanBegin + spans.GetSpans()[k].Length;
+          for (unsigned int i = spanBegin; i < spanEnd; i++)
+          {
+            const InputPixelType & p = bit.GetPixel(i);
+            if (p != m_BackgroundPixel)
+            {
+              values.push_back(BatchTraitsType::Convert(p));
+            }
+          }
+        }
+        std::sort(values.begin() + begin, values.end());
+      }
+      offsets.push_back(values.size());
+
+      const SizeValueType voxel = offsets.size() - 2;
+      bool samplesReady = false;
+      for (unsigned int s = 0; s < numberOfStatistics; s++)
+      {
+        if (m_Statistics[s]->SupportsBatch())
+        {
+          continue;
+        }
+        data.Results[s].resize(voxel + 1);
+        if (begin == values.size())
+        {
+          data.Results[s][voxel] = 0;
+          continue;
+        }
+        if (!samplesReady)
+        {
+          pixels->Clear();
+          for (size_t j = begin; j < values.size(); j++)
+          {
+            mv[0] = static_cast< InputPixelType >(values[j]);
+            pixels->PushBack(mv);
+          }
+          samplesReady = true;
+        }
+        data.Results[s][voxel] = m_Statistics[s]->Evaluate(
+            m_RefrenceSample.GetPointer(), pixels, data.Scratch[s]);
+      }
+
+      if (bit.GetIndex()[0] == lastInRow)
+      {
+        const SizeValueType count = offsets.size() - 1;
+        for (unsigned int s = 0; s < numberOfStatistics; s++)
+        {
+          if (m_Statistics[s]->SupportsBatch())
+          {
+            data.Results[s].resize(count);
+            m_Statistics[s]->EvaluateBatch(referenceValues, referenceFrequencies,
+                                           referenceSize,
+                                           values.empty() ? 0 : &values[0],
+                                           &offsets[0], count,
+                                           &data.Results[s][0]);
+          }
+        }
+        for (SizeValueType k = 0; k < count; k++)
+        {
+          for (unsigned int s = 0; s < numberOfStatistics; s++)
+          {
+            statistics[s] = static_cast< OutputInternalPixelType >(
+                data.Results[s][k]);
+          }
+          it.Set(statistics);
+          ++it;
+          progress.CompletedPixel();
+        }
+        values.clear();
+        offsets.clear();
+        offsets.push_back(0);
+      }
+      ++bit;
+    }
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodMultiStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::PrintSelf(std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Number of statistics: " << m_Statistics.size() << std::endl;
+}
+} // end namespace itk
+
+#endif
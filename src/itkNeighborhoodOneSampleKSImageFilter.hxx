@@ -9,6 +9,7 @@
 #include "itkNeighborhoodAlgorithm.h"
 #include "itkOffset.h"
 #include "itkProgressReporter.h"
+#include "itkSeparableBoxSum.h"
 
 #include <vector>
 #include <algorithm>
@@ -21,12 +22,128 @@ NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, LabelType
 {
   m_KS = KSType::New();
   m_KS->SortedReferenceOn();
+  m_KS->SortedSampleOn();
+  m_UseCDFTransform = false;
 }
 
 template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
-void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::ThreadedGenerateData(
-    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId)
+void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::BeforeThreadedGenerateData()
 {
+  if (m_KS->GetComputePValue())
+  {
+    size_t neighborhoodSize = 1;
+    for (unsigned int d = 0; d < InputImageType::ImageDimension; d++)
+    {
+      neighborhoodSize *= 2 * this->GetRadius()[d] + 1;
+    }
+    m_KS->PreparePValues(neighborhoodSize, m_RefrenceDistribution.size());
+  }
+  if (!m_UseCDFTransform)
+  {
+    return;
+  }
+  itkAssertOrThrowMacro(!m_KS->GetComputePValue(),
+                        "P-values can not be computed from the mean CDF.");
+  itkAssertOrThrowMacro(!this->GetUseBallNeighborhood(),
+                        "The CDF transform only supports box neighborhoods.");
+
+  typename InputImageType::ConstPointer input = this->GetInput();
+  typename LabelImageType::ConstPointer mask = this->GetMask();
+  const InputImageRegionType region = input->GetBufferedRegion();
+
+  m_CDFSum = RealImageType::New();
+  m_CDFSum->CopyInformation(input);
+  m_CDFSum->SetRegions(region);
+  m_CDFSum->Allocate();
+  m_CountSum = RealImageType::New();
+  m_CountSum->CopyInformation(input);
+  m_CountSum->SetRegions(region);
+  m_CountSum->Allocate();
+
+  /*
+   * Reference CDF at x is the fraction of reference values strictly below x,
+   * as accumulated by KolmogorovSmirnovTest::Evaluate.
+   */
+  const double step = 1.0 / m_RefrenceDistribution.size();
+  ImageRegionConstIterator< InputImageType > iit(input, region);
+  ImageRegionConstIterator< LabelImageType > mit(mask, region);
+  ImageRegionIterator< RealImageType > cit(m_CDFSum, region);
+  ImageRegionIterator< RealImageType > nit(m_CountSum, region);
+  for (; !iit.IsAtEnd(); ++iit, ++mit, ++cit, ++nit)
+  {
+    if (mit.Get() > itk::NumericTraits< LabelType >::Zero)
+    {
+      const size_t below = std::lower_bound(m_RefrenceDistribution.begin(),
+                                            m_RefrenceDistribution.end(),
+                                            iit.Get())
+          - m_RefrenceDistribution.begin();
+      cit.Set(below * step);
+      nit.Set(1);
+    }
+    else
+    {
+      cit.Set(0);
+      nit.Set(0);
+    }
+  }
+
+  SeparableBoxSum(m_CDFSum.GetPointer(), this->GetRadius());
+  SeparableBoxSum(m_CountSum.GetPointer(), this->GetRadius());
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::AfterThreadedGenerateData()
+{
+  m_CDFSum = 0;
+  m_CountSum = 0;
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::ThreadedComputeRegionFromCDF(
+    const OutputImageRegionType & outputRegionForThread, ProgressReporter & progress)
+{
+  typename OutputImageType::Pointer output = this->GetOutput();
+  typename LabelImageType::ConstPointer mask = this->GetMask();
+
+  const bool positive = this->GetPositive();
+  ImageRegionIterator< OutputImageType > it(output, outputRegionForThread);
+  ImageRegionConstIterator< LabelImageType > mit(mask, outputRegionForThread);
+  ImageRegionConstIterator< RealImageType > cit(m_CDFSum, outputRegionForThread);
+  ImageRegionConstIterator< RealImageType > nit(m_CountSum, outputRegionForThread);
+  for (; !it.IsAtEnd(); ++it, ++mit, ++cit, ++nit)
+  {
+    if (mit.Get() > itk::NumericTraits< LabelType >::Zero)
+    {
+      const double meanCDF = cit.Get() / nit.Get();
+      it.Set(static_cast< OutputPixelType >(positive ? meanCDF : 1 - meanCDF));
+    }
+    else
+    {
+      it.Set(itk::NumericTraits< OutputPixelType >::ZeroValue());
+    }
+    progress.CompletedPixel();
+  }
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::ComputeActiveRuns(
+    const OutputImageRegionType & region)
+{
+  this->AddActiveRuns(this->GetMask(), region,
+                      Functor::ActiveIfPositive< LabelType >());
+}
+
+template< typename TInputImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, LabelType>::ThreadedComputeRegion(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType itkNotUsed(threadId),
+    ProgressReporter & progress)
+{
+  if (m_UseCDFTransform)
+  {
+    this->ThreadedComputeRegionFromCDF(outputRegionForThread, progress);
+    return;
+  }
+
   typename OutputImageType::Pointer output = this->GetOutput();
   typename InputImageType::ConstPointer input = this->GetInput();
   typename LabelImageType::ConstPointer mask = this->GetMask();
@@ -35,12 +152,13 @@ void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, Labe
   typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
       bC(input, outputRegionForThread, this->GetRadius());
 
-  ProgressReporter progress(this, threadId,
-                            outputRegionForThread.GetNumberOfPixels());
-
   ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
   ZeroFluxNeumannBoundaryCondition< LabelImageType > nbcLabel;
-  DistributionType pixels;
+  SortedSampleType pixels;
+
+  const size_t referenceSize = m_RefrenceDistribution.size();
+  const InputPixelType * referenceBegin =
+      referenceSize ? &m_RefrenceDistribution[0] : 0;
 
   for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
       InputImageType >::FaceListType::iterator fit = faceList.begin();
@@ -59,26 +177,26 @@ void NeighborhoodOneSampleKSImageFilter< TInputImage, ProbabilityPrecision, Labe
     maskIt.OverrideBoundaryCondition(&nbcLabel);
     maskIt.GoToBegin();
 
-    const unsigned int neighborhoodSize = bit.Size();
+    pixels.Reserve(this->GetNeighborhoodSpans().GetNumberOfIndices());
+    SlidingWindowType window(this->GetNeighborhoodSpans(), *fit);
+    MaskedWindow callbacks(bit, maskIt, pixels);
+
     while (!bit.IsAtEnd())
     {
       if (maskIt.GetCenterPixel() > itk::NumericTraits< LabelType >::Zero)
       {
-        pixels.clear();
-        for (size_t i = 0; i < neighborhoodSize; i++)
-        {
-          if (maskIt.GetPixel(i) > itk::NumericTraits< LabelType >::Zero)
-          {
-            pixels.push_back(bit.GetPixel(i));
-          }
-        }
-        const double st = m_KS->Evaluate(PairDistribution(m_RefrenceDistribution, pixels));
+        window.Enter(callbacks);
+        pixels.Update();
+        const double st = m_KS->Evaluate(referenceBegin, referenceSize,
+                                         &pixels.GetValues()[0], pixels.Size());
         it.Set(static_cast< OutputPixelType >(st));
       }
       else
       {
+        window.Invalidate();
         it.Set(itk::NumericTraits< OutputPixelType >::ZeroValue());
       }
+      window.Leave(bit.GetIndex(), callbacks);
 
       ++maskIt;
       ++bit;
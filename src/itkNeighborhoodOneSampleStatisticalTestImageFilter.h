@@ -3,23 +3,27 @@
 #define __itkNeighborhoodOneSampleStatisticalTestImageFilter_h
 
 #include "itkStatisticalTestBase.h"
-#include "itkListSample.h"
-#include "itkBoxImageFilter.h"
+#include "itkReusableListSample.h"
+#include "itkActiveVoxelBoxImageFilter.h"
 #include "itkImage.h"
+#include "itkConstNeighborhoodIterator.h"
 #include "itkArray.h"
 
+#include <vector>
+#include <algorithm>
+
 namespace itk
 {
 /** \class NeighborhoodOneSampleStatisticalTestImageFilter
  */
 template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
-class NeighborhoodOneSampleStatisticalTestImageFilter: public BoxImageFilter<TInputImage,TOutputImage >
+class NeighborhoodOneSampleStatisticalTestImageFilter: public ActiveVoxelBoxImageFilter<TInputImage,TOutputImage >
 {
 public:
 
   /** Standard class typedefs. */
   typedef NeighborhoodOneSampleStatisticalTestImageFilter Self;
-  typedef BoxImageFilter< TInputImage, TOutputImage > Superclass;
+  typedef ActiveVoxelBoxImageFilter< TInputImage, TOutputImage > Superclass;
   typedef SmartPointer< Self > Pointer;
   typedef SmartPointer< const Self > ConstPointer;
 
@@ -40,11 +44,17 @@ public:
   typedef typename OutputImageType::RegionType OutputImageRegionType;
 
   typedef typename InputImageType::SizeType InputSizeType;
+  typedef typename Superclass::NeighborhoodSpansType NeighborhoodSpansType;
+  typedef typename Superclass::SlidingWindowType SlidingWindowType;
 
   typedef TReferenceSample ReferenceSampleType;
   typedef Array< InputPixelType > MeasurementVectorType;
-  typedef Statistics::ListSample<MeasurementVectorType> InternalSampleType;
+  typedef Statistics::ReusableListSample<MeasurementVectorType> InternalSampleType;
   typedef Statistics::StatisticalTestBase<TReferenceSample, InternalSampleType> StatisticsTestType;
+  typedef typename StatisticsTestType::ScratchType StatisticsScratchType;
+  typedef typename StatisticsTestType::OutputType StatisticsOutputType;
+  typedef Statistics::ScalarBatchTraits< InputPixelType > BatchTraitsType;
+  typedef typename BatchTraitsType::ValueType BatchValueType;
 
   itkGetConstMacro(BackgroundPixel, InputPixelType);
   itkSetMacro(BackgroundPixel, InputPixelType);
@@ -55,6 +65,32 @@ public:
   itkGetObjectMacro(RefrenceSample,ReferenceSampleType);
   itkSetObjectMacro(RefrenceSample, ReferenceSampleType);
 
+  /** Map the image through the reference CDF once and take neighborhood
+   * means with separable box sums, and neighborhood maxima with separable box
+   * maxima. The cost per voxel does not depend on the radius. Only for scalar images, box neighborhoods and tests that
+   * SupportsMeanCDF(). */
+  itkGetConstMacro(UseCDFTransform, bool);
+  itkSetMacro(UseCDFTransform, bool);
+  itkBooleanMacro(UseCDFTransform);
+
+  /** Quantize the image into bins around the reference values and keep a
+   * running histogram of the neighborhood, updated by the slabs entering and
+   * leaving the window along a scan line. The test is evaluated from the two
+   * histograms, so its cost depends on the number of bins instead of the
+   * neighborhood size. A reference taken from a histogram gives its own bins.
+   * Only for scalar images and tests that SupportsHistogram(). */
+  itkGetConstMacro(UseHistogram, bool);
+  itkSetMacro(UseHistogram, bool);
+  itkBooleanMacro(UseHistogram);
+
+  /** Gather and sort the neighborhoods of a scan line into one buffer and
+   * evaluate them with a single EvaluateBatch() call. Used for float and
+   * double images when the test SupportsBatch(); otherwise every voxel is
+   * evaluated through Evaluate(). On by default. */
+  itkGetConstMacro(UseBatchEvaluation, bool);
+  itkSetMacro(UseBatchEvaluation, bool);
+  itkBooleanMacro(UseBatchEvaluation);
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   // Begin concept checking
   itkConceptMacro( InputLessThanComparableCheck,
@@ -68,8 +104,14 @@ protected:
   {
   }
 
-  void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
-                            ThreadIdType threadId);
+  void BeforeThreadedGenerateData();
+
+  void ThreadedComputeRegion(const OutputImageRegionType & outputRegionForThread,
+                             ThreadIdType threadId, ProgressReporter & progress);
+
+  void ComputeActiveRuns(const OutputImageRegionType & region);
+
+  void AfterThreadedGenerateData();
 
 private:
   NeighborhoodOneSampleStatisticalTestImageFilter(const Self &); //purposely not implemented
@@ -80,6 +122,85 @@ private:
 
   InputPixelType m_BackgroundPixel;
 
+  typedef Image< double, TInputImage::ImageDimension > RealImageType;
+  bool m_UseCDFTransform;
+  typename RealImageType::Pointer m_CDFSum;
+  typename RealImageType::Pointer m_CountSum;
+  typename RealImageType::Pointer m_Maximum;
+
+  /** Bin image holds the bin of each voxel plus one, zero for background. */
+  typedef Image< unsigned short, TInputImage::ImageDimension > BinImageType;
+  bool m_UseHistogram;
+  typename BinImageType::Pointer m_BinImage;
+  std::vector< double > m_ReferenceHistogram;
+  double m_ReferenceTotal;
+  std::vector< std::vector< double > > m_ThreadHistograms;
+
+  /** Window callbacks counting the bins of the non-background neighbors. */
+  struct HistogramWindow
+  {
+    HistogramWindow(const ConstNeighborhoodIterator< BinImageType > & bins,
+                    std::vector< double > & histogram, double & count):
+      Bins(bins), Histogram(histogram), Count(count)
+    {
+    }
+    void Clear()
+    {
+      std::fill(Histogram.begin(), Histogram.end(), 0.0);
+      Count = 0;
+    }
+    void Insert(unsigned int i)
+    {
+      const unsigned short b = Bins.GetPixel(i);
+      if (b)
+      {
+        Histogram[b - 1] += 1;
+        Count += 1;
+      }
+    }
+    void Remove(unsigned int i)
+    {
+      const unsigned short b = Bins.GetPixel(i);
+      if (b)
+      {
+        Histogram[b - 1] -= 1;
+        Count -= 1;
+      }
+    }
+    const ConstNeighborhoodIterator< BinImageType > & Bins;
+    std::vector< double > & Histogram;
+    double & Count;
+  };
+
+  /** Batch mode: sorted reference values with their frequencies, and per
+   * thread the concatenated samples of a scan line, their offsets and their
+   * results. */
+  bool m_UseBatchEvaluation;
+  bool m_BatchMode;
+  std::vector< BatchValueType > m_BatchReferenceValues;
+  std::vector< StatisticsOutputType > m_BatchReferenceFrequencies;
+  std::vector< std::vector< BatchValueType > > m_ThreadBatchValues;
+  std::vector< std::vector< SizeValueType > > m_ThreadBatchOffsets;
+  std::vector< std::vector< StatisticsOutputType > > m_ThreadBatchOutput;
+
+  /** Per-thread neighborhood sample and test scratch, kept across the runs a
+   * thread is handed. */
+  std::vector< typename InternalSampleType::Pointer > m_ThreadPixels;
+  std::vector< StatisticsScratchType > m_ThreadScratch;
+
+  void ThreadedComputeRegionFromCDF(const OutputImageRegionType & outputRegionForThread,
+                                    ProgressReporter & progress);
+
+  void BeforeThreadedGenerateDataFromHistogram();
+
+  void ThreadedComputeRegionBatch(const OutputImageRegionType & outputRegionForThread,
+                                  ThreadIdType threadId,
+                                  ProgressReporter & progress);
+
+  void ThreadedComputeRegionFromHistogram(const OutputImageRegionType & outputRegionForThread,
+                                          ThreadIdType threadId,
+                                          ProgressReporter & progress);
+
 };
 }
 // end namespace itk
@@ -9,6 +9,11 @@
 #include "itkNeighborhoodAlgorithm.h"
 #include "itkOffset.h"
 #include "itkProgressReporter.h"
+#include "itkSeparableBoxSum.h"
+
+#include <vector>
+#include <algorithm>
+#include <utility>
 
 namespace itk
 {
@@ -18,12 +23,338 @@ NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
 {
   m_Statistics=0;
   m_BackgroundPixel = NumericTraits< InputPixelType >::ZeroValue();
+  m_UseCDFTransform = false;
+  m_UseHistogram = false;
+  m_ReferenceTotal = 0;
+  m_UseBatchEvaluation = true;
+  m_BatchMode = false;
 }
 
 template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
 void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
-    TReferenceSample >::ThreadedGenerateData(
-    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId)
+    TReferenceSample >::BeforeThreadedGenerateData()
+{
+  SizeValueType neighborhoodSize = 1;
+  for (unsigned int d = 0; d < InputImageType::ImageDimension; d++)
+  {
+    neighborhoodSize *= 2 * this->GetRadius()[d] + 1;
+  }
+  m_Statistics->PrepareEvaluation(m_RefrenceSample.GetPointer(), neighborhoodSize);
+
+  m_BatchMode = false;
+  if (m_UseHistogram)
+  {
+    itkAssertOrThrowMacro(!m_UseCDFTransform,
+                          "Histogram and CDF transform modes are exclusive.");
+    this->BeforeThreadedGenerateDataFromHistogram();
+    return;
+  }
+  if (!m_UseCDFTransform)
+  {
+    /*
+     * Scratch reused for every voxel a thread computes: the neighborhood
+     * sample keeps its measurement vectors across Clear() and the
+     * statistical test keeps its subsamples, so the per-voxel loop does not
+     * allocate.
+     */
+    const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+    const unsigned int components =
+        this->GetInput()->GetNumberOfComponentsPerPixel();
+    if (m_UseBatchEvaluation && BatchTraitsType::Supported && components == 1
+        && m_Statistics->SupportsBatch())
+    {
+      std::vector< std::pair< BatchValueType, StatisticsOutputType > > ref;
+      for (typename ReferenceSampleType::ConstIterator rit = m_RefrenceSample->Begin();
+          rit != m_RefrenceSample->End(); ++rit)
+      {
+        ref.push_back(std::make_pair(
+            static_cast< BatchValueType >(rit.GetMeasurementVector()[0]),
+            static_cast< StatisticsOutputType >(rit.GetFrequency())));
+      }
+      std::sort(ref.begin(), ref.end());
+      m_BatchReferenceValues.resize(ref.size());
+      m_BatchReferenceFrequencies.resize(ref.size());
+      for (size_t i = 0; i < ref.size(); i++)
+      {
+        m_BatchReferenceValues[i] = ref[i].first;
+        m_BatchReferenceFrequencies[i] = ref[i].second;
+      }
+      m_ThreadBatchValues.assign(numberOfThreads, std::vector< BatchValueType >());
+      m_ThreadBatchOffsets.assign(numberOfThreads, std::vector< SizeValueType >());
+      m_ThreadBatchOutput.assign(numberOfThreads, std::vector< StatisticsOutputType >());
+      m_BatchMode = true;
+      return;
+    }
+    m_ThreadPixels.clear();
+    m_ThreadScratch.clear();
+    for (ThreadIdType t = 0; t < numberOfThreads; t++)
+    {
+      typename InternalSampleType::Pointer pixels = InternalSampleType::New();
+      pixels->SetMeasurementVectorSize(components);
+      m_ThreadPixels.push_back(pixels);
+      m_ThreadScratch.push_back(StatisticsScratchType());
+    }
+    return;
+  }
+  itkAssertOrThrowMacro(m_Statistics->SupportsMeanCDF(),
+                        "Statistical test can not be evaluated from the mean CDF.");
+  itkAssertOrThrowMacro(!this->GetUseBallNeighborhood(),
+                        "The CDF transform only supports box neighborhoods.");
+  m_Statistics->InitializeMeanCDF(m_RefrenceSample.GetPointer());
+
+  /*
+   * Reference CDF as sorted values and the cumulative frequency strictly
+   * below each of them.
+   */
+  std::vector< std::pair< double, double > > ref;
+  for (typename ReferenceSampleType::ConstIterator rit = m_RefrenceSample->Begin();
+      rit != m_RefrenceSample->End(); ++rit)
+  {
+    ref.push_back(std::make_pair(static_cast< double >(rit.GetMeasurementVector()[0]),
+                                 static_cast< double >(rit.GetFrequency())));
+  }
+  std::sort(ref.begin(), ref.end());
+  std::vector< double > refValues(ref.size());
+  std::vector< double > refCDF(ref.size() + 1);
+  refCDF[0] = 0;
+  for (size_t i = 0; i < ref.size(); i++)
+  {
+    refValues[i] = ref[i].first;
+    refCDF[i + 1] = refCDF[i] + ref[i].second;
+  }
+  const double step = 1.0 / refCDF.back();
+
+  typename InputImageType::ConstPointer input = this->GetInput();
+  const InputImageRegionType region = input->GetBufferedRegion();
+
+  m_CDFSum = RealImageType::New();
+  m_CDFSum->CopyInformation(input);
+  m_CDFSum->SetRegions(region);
+  m_CDFSum->Allocate();
+  m_CountSum = RealImageType::New();
+  m_CountSum->CopyInformation(input);
+  m_CountSum->SetRegions(region);
+  m_CountSum->Allocate();
+  m_Maximum = RealImageType::New();
+  m_Maximum->CopyInformation(input);
+  m_Maximum->SetRegions(region);
+  m_Maximum->Allocate();
+
+  ImageRegionConstIterator< InputImageType > iit(input, region);
+  ImageRegionIterator< RealImageType > cit(m_CDFSum, region);
+  ImageRegionIterator< RealImageType > nit(m_CountSum, region);
+  ImageRegionIterator< RealImageType > mit(m_Maximum, region);
+  MeasurementVectorType mv(input->GetNumberOfComponentsPerPixel());
+  for (; !iit.IsAtEnd(); ++iit, ++cit, ++nit, ++mit)
+  {
+    const InputPixelType & p = iit.Get();
+    if (p != m_BackgroundPixel)
+    {
+      NumericTraits< InputPixelType >::AssignToArray(p, mv);
+      const size_t below = std::lower_bound(refValues.begin(), refValues.end(),
+                                            static_cast< double >(mv[0]))
+          - refValues.begin();
+      cit.Set(refCDF[below] * step);
+      nit.Set(1);
+      mit.Set(mv[0]);
+    }
+    else
+    {
+      cit.Set(0);
+      nit.Set(0);
+      mit.Set(NumericTraits< double >::NonpositiveMin());
+    }
+  }
+
+  SeparableBoxSum(m_CDFSum.GetPointer(), this->GetRadius());
+  SeparableBoxSum(m_CountSum.GetPointer(), this->GetRadius());
+  SeparableBoxMaximum(m_Maximum.GetPointer(), this->GetRadius());
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::BeforeThreadedGenerateDataFromHistogram()
+{
+  itkAssertOrThrowMacro(m_Statistics->SupportsHistogram(),
+                        "Statistical test can not be evaluated from histograms.");
+
+  /*
+   * Bins are the distinct reference values; a value falls in the bin whose
+   * reference value is nearest, the bin edges being the midpoints.
+   */
+  std::vector< std::pair< double, double > > ref;
+  for (typename ReferenceSampleType::ConstIterator rit = m_RefrenceSample->Begin();
+      rit != m_RefrenceSample->End(); ++rit)
+  {
+    ref.push_back(std::make_pair(static_cast< double >(rit.GetMeasurementVector()[0]),
+                                 static_cast< double >(rit.GetFrequency())));
+  }
+  itkAssertOrThrowMacro(!ref.empty(), "Reference sample is empty.");
+  std::sort(ref.begin(), ref.end());
+  std::vector< double > binValues;
+  m_ReferenceHistogram.clear();
+  m_ReferenceTotal = 0;
+  for (size_t i = 0; i < ref.size(); i++)
+  {
+    if (binValues.empty() || ref[i].first != binValues.back())
+    {
+      binValues.push_back(ref[i].first);
+      m_ReferenceHistogram.push_back(0);
+    }
+    m_ReferenceHistogram.back() += ref[i].second;
+    m_ReferenceTotal += ref[i].second;
+  }
+  itkAssertOrThrowMacro(
+      binValues.size() < static_cast< size_t >(NumericTraits< unsigned short >::max()),
+      "Too many distinct reference values for histogram mode.");
+  std::vector< double > binEdges(binValues.size() - 1);
+  for (size_t b = 0; b + 1 < binValues.size(); b++)
+  {
+    binEdges[b] = 0.5 * (binValues[b] + binValues[b + 1]);
+  }
+
+  typename InputImageType::ConstPointer input = this->GetInput();
+  const InputImageRegionType region = input->GetBufferedRegion();
+
+  m_BinImage = BinImageType::New();
+  m_BinImage->CopyInformation(input);
+  m_BinImage->SetRegions(region);
+  m_BinImage->Allocate();
+
+  ImageRegionConstIterator< InputImageType > iit(input, region);
+  ImageRegionIterator< BinImageType > bit(m_BinImage, region);
+  MeasurementVectorType mv(input->GetNumberOfComponentsPerPixel());
+  for (; !iit.IsAtEnd(); ++iit, ++bit)
+  {
+    const InputPixelType & p = iit.Get();
+    if (p != m_BackgroundPixel)
+    {
+      NumericTraits< InputPixelType >::AssignToArray(p, mv);
+      const size_t bin = std::upper_bound(binEdges.begin(), binEdges.end(),
+                                          static_cast< double >(mv[0]))
+          - binEdges.begin();
+      bit.Set(static_cast< unsigned short >(bin + 1));
+    }
+    else
+    {
+      bit.Set(0);
+    }
+  }
+
+  m_ThreadHistograms.assign(this->GetNumberOfThreads(),
+                            std::vector< double >(binValues.size()));
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::AfterThreadedGenerateData()
+{
+  m_ThreadPixels.clear();
+  m_ThreadScratch.clear();
+  m_ThreadHistograms.clear();
+  m_BinImage = 0;
+  m_BatchReferenceValues.clear();
+  m_BatchReferenceFrequencies.clear();
+  m_ThreadBatchValues.clear();
+  m_ThreadBatchOffsets.clear();
+  m_ThreadBatchOutput.clear();
+  m_CDFSum = 0;
+  m_CountSum = 0;
+  m_Maximum = 0;
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ThreadedComputeRegionFromCDF(
+    const OutputImageRegionType & outputRegionForThread, ProgressReporter & progress)
+{
+  typename InputImageType::ConstPointer input = this->GetInput();
+  typename OutputImageType::Pointer output = this->GetOutput();
+
+  ImageRegionIterator< OutputImageType > it(output, outputRegionForThread);
+  ImageRegionConstIterator< InputImageType > iit(input, outputRegionForThread);
+  ImageRegionConstIterator< RealImageType > cit(m_CDFSum, outputRegionForThread);
+  ImageRegionConstIterator< RealImageType > nit(m_CountSum, outputRegionForThread);
+  ImageRegionConstIterator< RealImageType > mit(m_Maximum, outputRegionForThread);
+  for (; !it.IsAtEnd(); ++it, ++iit, ++cit, ++nit, ++mit)
+  {
+    if (iit.Get() != m_BackgroundPixel)
+    {
+      it.Set(m_Statistics->EvaluateMeanCDF(cit.Get() / nit.Get(), mit.Get()));
+    }
+    else
+    {
+      it.Set(itk::NumericTraits< OutputPixelType >::ZeroValue());
+    }
+    progress.CompletedPixel();
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ThreadedComputeRegionFromHistogram(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId,
+    ProgressReporter & progress)
+{
+  typename OutputImageType::Pointer output = this->GetOutput();
+
+  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< BinImageType > bC;
+  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< BinImageType >::FaceListType faceList =
+      bC(m_BinImage, outputRegionForThread, this->GetRadius());
+
+  ZeroFluxNeumannBoundaryCondition< BinImageType > nbcBin;
+
+  std::vector< double > & histogram = m_ThreadHistograms[threadId];
+  const unsigned int numberOfBins = histogram.size();
+  const double * referenceHistogram = &m_ReferenceHistogram[0];
+
+  for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
+      BinImageType >::FaceListType::iterator fit = faceList.begin();
+      fit != faceList.end(); ++fit)
+  {
+    ImageRegionIterator< OutputImageType > it = ImageRegionIterator<
+        OutputImageType >(output, *fit);
+
+    ConstNeighborhoodIterator< BinImageType > bit = ConstNeighborhoodIterator<
+        BinImageType >(this->GetRadius(), m_BinImage, *fit);
+    bit.OverrideBoundaryCondition(&nbcBin);
+    bit.GoToBegin();
+
+    /*
+     * The window histogram does not depend on the center voxel, so it slides
+     * over background voxels too and is only rebuilt at scan line starts.
+     */
+    double count = 0;
+    SlidingWindowType window(this->GetNeighborhoodSpans(), *fit);
+    HistogramWindow callbacks(bit, histogram, count);
+
+    while (!bit.IsAtEnd())
+    {
+      window.Enter(callbacks);
+      if (bit.GetCenterPixel())
+      {
+        it.Set(static_cast< OutputPixelType >(m_Statistics->EvaluateHistogram(
+            referenceHistogram, m_ReferenceTotal, &histogram[0], count,
+            numberOfBins)));
+      }
+      else
+      {
+        it.Set(itk::NumericTraits< OutputPixelType >::ZeroValue());
+      }
+      window.Leave(bit.GetIndex(), callbacks);
+
+      ++bit;
+      ++it;
+      progress.CompletedPixel();
+    }
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ThreadedComputeRegionBatch(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId,
+    ProgressReporter & progress)
 {
   typename InputImageType::ConstPointer input = this->GetInput();
   typename OutputImageType::Pointer output = this->GetOutput();
@@ -32,12 +363,127 @@ void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
   typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
       bC(input, outputRegionForThread, this->GetRadius());
 
-  ProgressReporter progress(this, threadId,
-                            outputRegionForThread.GetNumberOfPixels());
+  ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
+
+  std::vector< BatchValueType > & values = m_ThreadBatchValues[threadId];
+  std::vector< SizeValueType > & offsets = m_ThreadBatchOffsets[threadId];
+  std::vector< StatisticsOutputType > & results = m_ThreadBatchOutput[threadId];
+  const SizeValueType referenceSize = m_BatchReferenceValues.size();
+  const BatchValueType * referenceValues =
+      referenceSize ? &m_BatchReferenceValues[0] : 0;
+  const StatisticsOutputType * referenceFrequencies =
+      referenceSize ? &m_BatchReferenceFrequencies[0] : 0;
+
+  for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
+      InputImageType >::FaceListType::iterator fit = faceList.begin();
+      fit != faceList.end(); ++fit)
+  {
+    ImageRegionIterator< OutputImageType > it = ImageRegionIterator<
+        OutputImageType >(output, *fit);
+
+    ConstNeighborhoodIterator< InputImageType > bit = ConstNeighborhoodIterator<
+        InputImageType >(this->GetRadius(), input, *fit);
+    bit.OverrideBoundaryCondition(&nbcInput);
+    bit.GoToBegin();
+
+    const NeighborhoodSpansType & spans = this->GetNeighborhoodSpans();
+    const IndexValueType lastInRow = fit->GetIndex()[0]
+        + static_cast< IndexValueType >(fit->GetSize()[0]) - 1;
+
+    /*
+     * Background voxels get an empty sample, for which the batch gives 0, so
+     * the results can be written back in scan order.
+     */
+    values.clear();
+    offsets.clear();
+    offsets.push_back(0);
+    while (!bit.IsAtEnd())
+    {
+      if (bit.GetCenterPixel() != m_BackgroundPixel)
+      {
+        const size_t begin = values.size();
+        for (size_t k = 0; k < spans.GetSpans().size(); k++)
+        {
+          const unsigned int spanBegin = spans.GetSpans()[k].Begin;
+          const unsigned int spanEnd = spanBegin + spans.GetSpans()[k].Length;
+          for (unsigned int i = spanBegin; i < spanEnd; i++)
+          {
+            const InputPixelType & p = bit.GetPixel(i);
+            if (p != m_BackgroundPixel)
+            {
+              values.push_back(BatchTraitsType::Convert(p));
+            }
+          }
+        }
+        std::sort(values.begin() + begin, values.end());
+      }
+      offsets.push_back(values.size());
+
+      if (bit.GetIndex()[0] == lastInRow)
+      {
+        const SizeValueType count = offsets.size() - 1;
+        results.resize(count);
+        m_Statistics->EvaluateBatch(referenceValues, referenceFrequencies,
+                                    referenceSize,
+                                    values.empty() ? 0 : &values[0],
+                                    &offsets[0], count, &results[0]);
+        for (SizeValueType k = 0; k < count; k++)
+        {
+          it.Set(static_cast< OutputPixelType >(results[k]));
+          ++it;
+          progress.CompletedPixel();
+        }
+        values.clear();
+        offsets.clear();
+        offsets.push_back(0);
+      }
+      ++bit;
+    }
+  }
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ComputeActiveRuns(const OutputImageRegionType & region)
+{
+  this->AddActiveRuns(this->GetInput(), region,
+                      Functor::ActiveIfNotEqual< InputPixelType >(m_BackgroundPixel));
+}
+
+template< typename TInputImage, typename TOutputImage, typename TReferenceSample >
+void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
+    TReferenceSample >::ThreadedComputeRegion(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId,
+    ProgressReporter & progress)
+{
+  if (m_UseCDFTransform)
+  {
+    this->ThreadedComputeRegionFromCDF(outputRegionForThread, progress);
+    return;
+  }
+  if (m_UseHistogram)
+  {
+    this->ThreadedComputeRegionFromHistogram(outputRegionForThread, threadId,
+                                             progress);
+    return;
+  }
+  if (m_BatchMode)
+  {
+    this->ThreadedComputeRegionBatch(outputRegionForThread, threadId, progress);
+    return;
+  }
+
+  typename InputImageType::ConstPointer input = this->GetInput();
+  typename OutputImageType::Pointer output = this->GetOutput();
+
+  NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType > bC;
+  typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
+      bC(input, outputRegionForThread, this->GetRadius());
 
   ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
-  typename InternalSampleType::Pointer pixels = InternalSampleType::New();
-  pixels->SetMeasurementVectorSize(input->GetNumberOfComponentsPerPixel());
+
+  InternalSampleType * pixels = m_ThreadPixels[threadId];
+  StatisticsScratchType & scratch = m_ThreadScratch[threadId];
   MeasurementVectorType mv(input->GetNumberOfComponentsPerPixel());
 
   for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
@@ -52,22 +498,28 @@ void NeighborhoodOneSampleStatisticalTestImageFilter< TInputImage, TOutputImage,
     bit.OverrideBoundaryCondition(&nbcInput);
     bit.GoToBegin();
 
-    const unsigned int neighborhoodSize = bit.Size();
+    const NeighborhoodSpansType & spans = this->GetNeighborhoodSpans();
     while (!bit.IsAtEnd())
     {
       if (bit.GetCenterPixel() != m_BackgroundPixel)
       {
         pixels->Clear();
-        for (size_t i = 0; i < neighborhoodSize; i++)
+        for (size_t k = 0; k < spans.GetSpans().size(); k++)
         {
-          const InputPixelType & p = bit.GetPixel(i);
-          if (p != m_BackgroundPixel)
+          const unsigned int spanBegin = spans.GetSpans()[k].Begin;
+          const unsigned int spanEnd = spanBegin + spans.GetSpans()[k].Length;
+          for (unsigned int i = spanBegin; i < spanEnd; i++)
           {
-            NumericTraits< InputPixelType >::AssignToArray(p, mv);
-            pixels->PushBack(mv);
+            const InputPixelType & p = bit.GetPixel(i);
+            if (p != m_BackgroundPixel)
+            {
+              NumericTraits< InputPixelType >::AssignToArray(p, mv);
+              pixels->PushBack(mv);
+            }
           }
         }
-        const OutputPixelType st = m_Statistics->Evaluate(m_RefrenceSample.GetPointer(), pixels.GetPointer());
+        const OutputPixelType st = m_Statistics->Evaluate(
+            m_RefrenceSample.GetPointer(), pixels, scratch);
         it.Set(st);
       }
       else
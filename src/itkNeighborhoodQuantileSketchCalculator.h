@@ -0,0 +1,134 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodQuantileSketchCalculator_h
+#define __itkNeighborhoodQuantileSketchCalculator_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImage.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkQuantileSketch.h"
+
+#include <vector>
+
+namespace itk
+{
+/** \class NeighborhoodQuantileSketchCalculator
+ * \brief Reference distribution of the masked neighborhoods of a training
+ * mask, as a quantile sketch per image.
+ *
+ * The reference of the neighborhood tests pools, for every voxel of the mask,
+ * the masked voxels of its box neighborhood. A voxel therefore enters the pool
+ * once per mask voxel whose box contains it; that count is a box sum of the
+ * mask, so every masked voxel is inserted once with it as weight.
+ *
+ * The mask is split into slices along the last dimension which threads take
+ * in turn. Every slice fills its own sketches, seeded from the seed and the
+ * slice number, and the slices are merged in order: the result does not depend
+ * on the number of threads.
+ */
+template< typename TImage, typename TMaskImage >
+class NeighborhoodQuantileSketchCalculator: public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef NeighborhoodQuantileSketchCalculator Self;
+  typedef Object Superclass;
+  typedef SmartPointer< Self > Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(NeighborhoodQuantileSketchCalculator, Object);
+
+  itkStaticConstMacro(ImageDimension, unsigned int, TImage::ImageDimension);
+
+  typedef TImage ImageType;
+  typedef typename ImageType::PixelType PixelType;
+  typedef TMaskImage MaskImageType;
+  typedef typename MaskImageType::PixelType MaskPixelType;
+  typedef typename ImageType::SizeType RadiusType;
+  typedef typename ImageType::RegionType RegionType;
+
+  typedef Statistics::QuantileSketch< PixelType > SketchType;
+  typedef typename SketchType::DistributionType DistributionType;
+
+  itkSetConstObjectMacro(Mask, MaskImageType);
+  itkGetConstObjectMacro(Mask, MaskImageType);
+
+  /** Neighborhood radius in voxels; zero pools the masked voxels once. */
+  itkSetMacro(Radius, RadiusType);
+  itkGetConstMacro(Radius, RadiusType);
+
+  itkSetMacro(SketchSize, unsigned int);
+  itkGetConstMacro(SketchSize, unsigned int);
+
+  itkSetMacro(Seed, unsigned int);
+  itkGetConstMacro(Seed, unsigned int);
+
+  itkSetMacro(NumberOfThreads, ThreadIdType);
+  itkGetConstMacro(NumberOfThreads, ThreadIdType);
+
+  /** Images sampled with the same mask and weights, one sketch each. */
+  void AddImage(const ImageType * image);
+  void ClearImages();
+  unsigned int GetNumberOfImages() const
+  {
+    return m_Images.size();
+  }
+
+  void Compute();
+
+  const SketchType & GetSketch(unsigned int i = 0) const
+  {
+    return m_Sketches[i];
+  }
+
+  /** Shortcut for GetSketch(i).GetDistribution(numberOfValues). */
+  DistributionType GetDistribution(unsigned int numberOfValues,
+                                   unsigned int i = 0) const
+  {
+    return m_Sketches[i].GetDistribution(numberOfValues);
+  }
+
+protected:
+  NeighborhoodQuantileSketchCalculator();
+  virtual ~NeighborhoodQuantileSketchCalculator()
+  {
+  }
+
+  void PrintSelf(std::ostream & os, Indent indent) const;
+
+private:
+  NeighborhoodQuantileSketchCalculator(const Self &); //purposely not implemented
+  void operator=(const Self &); //purposely not implemented
+
+  typedef Image< unsigned int, ImageDimension > WeightImageType;
+
+  static ITK_THREAD_RETURN_TYPE ThreaderCallback(void *arg);
+  void ThreadedComputeSlices();
+  void ComputeSlice(SizeValueType slice);
+
+  typename MaskImageType::ConstPointer m_Mask;
+  std::vector< typename ImageType::ConstPointer > m_Images;
+  RadiusType m_Radius;
+  unsigned int m_SketchSize;
+  unsigned int m_Seed;
+  ThreadIdType m_NumberOfThreads;
+
+  typename WeightImageType::Pointer m_Weights;
+  RegionType m_Region;
+  /** Sketches of slice s are at s * number of images. */
+  std::vector< SketchType > m_SliceSketches;
+  std::vector< SketchType > m_Sketches;
+  SizeValueType m_NextSlice;
+  SimpleFastMutexLock m_SliceLock;
+};
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkNeighborhoodQuantileSketchCalculator.hxx"
+#endif
+
+#endif
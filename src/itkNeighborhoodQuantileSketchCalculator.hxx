@@ -0,0 +1,167 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodQuantileSketchCalculator_hxx
+#define __itkNeighborhoodQuantileSketchCalculator_hxx
+#include "itkNeighborhoodQuantileSketchCalculator.h"
+
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkMultiThreader.h"
+#include "itkSeparableBoxSum.h"
+
+namespace itk
+{
+template< typename TImage, typename TMaskImage >
+NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::NeighborhoodQuantileSketchCalculator()
+{
+  m_Radius.Fill(0);
+  m_SketchSize = 512;
+  m_Seed = 0;
+  m_NumberOfThreads = MultiThreader::GetGlobalDefaultNumberOfThreads();
+  m_NextSlice = 0;
+}
+
+template< typename TImage, typename TMaskImage >
+void NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::AddImage(
+    const ImageType * image)
+{
+  itkAssertOrThrowMacro(image != 0, "Image is null.");
+  m_Images.push_back(image);
+  this->Modified();
+}
+
+template< typename TImage, typename TMaskImage >
+void NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::ClearImages()
+{
+  m_Images.clear();
+  this->Modified();
+}
+
+template< typename TImage, typename TMaskImage >
+void NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::Compute()
+{
+  itkAssertOrThrowMacro(m_Mask, "Mask is not set.");
+  itkAssertOrThrowMacro(!m_Images.empty(), "No image is set.");
+
+  m_Region = m_Mask->GetBufferedRegion();
+  for (size_t i = 0; i < m_Images.size(); i++)
+  {
+    itkAssertOrThrowMacro(m_Images[i]->GetBufferedRegion().IsInside(m_Region),
+                          "Image does not cover the mask.");
+  }
+
+  /*
+   * Weight of a voxel: number of mask voxels whose box contains it.
+   */
+  m_Weights = WeightImageType::New();
+  m_Weights->CopyInformation(m_Mask);
+  m_Weights->SetRegions(m_Region);
+  m_Weights->Allocate();
+  {
+    ImageRegionConstIterator< MaskImageType > mit(m_Mask, m_Region);
+    ImageRegionIterator< WeightImageType > wit(m_Weights, m_Region);
+    for (; !mit.IsAtEnd(); ++mit, ++wit)
+    {
+      wit.Set(mit.Get() > NumericTraits< MaskPixelType >::ZeroValue() ? 1 : 0);
+    }
+  }
+  SeparableBoxSum(m_Weights.GetPointer(), m_Radius);
+
+  const SizeValueType numberOfSlices = m_Region.GetSize()[ImageDimension - 1];
+  const unsigned int numberOfImages = m_Images.size();
+  m_SliceSketches.clear();
+  for (SizeValueType s = 0; s < numberOfSlices; s++)
+  {
+    for (unsigned int i = 0; i < numberOfImages; i++)
+    {
+      m_SliceSketches.push_back(SketchType(m_SketchSize,
+          static_cast< uint64_t >(m_Seed) + s * numberOfImages + i));
+    }
+  }
+  m_NextSlice = 0;
+
+  MultiThreader::Pointer threader = MultiThreader::New();
+  threader->SetNumberOfThreads(m_NumberOfThreads);
+  threader->SetSingleMethod(this->ThreaderCallback, this);
+  threader->SingleMethodExecute();
+
+  m_Sketches.clear();
+  for (unsigned int i = 0; i < numberOfImages; i++)
+  {
+    m_Sketches.push_back(SketchType(m_SketchSize,
+                                    static_cast< uint64_t >(m_Seed) + i));
+    for (SizeValueType s = 0; s < numberOfSlices; s++)
+    {
+      m_Sketches[i].Merge(m_SliceSketches[s * numberOfImages + i]);
+    }
+  }
+  m_SliceSketches.clear();
+  m_Weights = 0;
+}
+
+template< typename TImage, typename TMaskImage >
+ITK_THREAD_RETURN_TYPE NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::ThreaderCallback(
+    void *arg)
+{
+  MultiThreader::ThreadInfoStruct * info =
+      static_cast< MultiThreader::ThreadInfoStruct * >(arg);
+  Self * calculator = static_cast< Self * >(info->UserData);
+  calculator->ThreadedComputeSlices();
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template< typename TImage, typename TMaskImage >
+void NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::ThreadedComputeSlices()
+{
+  const SizeValueType numberOfSlices = m_Region.GetSize()[ImageDimension - 1];
+  while (true)
+  {
+    m_SliceLock.Lock();
+    const SizeValueType slice = m_NextSlice++;
+    m_SliceLock.Unlock();
+    if (slice >= numberOfSlices)
+    {
+      break;
+    }
+    this->ComputeSlice(slice);
+  }
+}
+
+template< typename TImage, typename TMaskImage >
+void NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::ComputeSlice(
+    SizeValueType slice)
+{
+  RegionType region = m_Region;
+  region.SetIndex(ImageDimension - 1,
+                  m_Region.GetIndex()[ImageDimension - 1] + slice);
+  region.SetSize(ImageDimension - 1, 1);
+
+  const unsigned int numberOfImages = m_Images.size();
+  SketchType * sketches = &m_SliceSketches[slice * numberOfImages];
+  for (unsigned int i = 0; i < numberOfImages; i++)
+  {
+    ImageRegionConstIterator< WeightImageType > wit(m_Weights, region);
+    ImageRegionConstIterator< MaskImageType > mit(m_Mask, region);
+    ImageRegionConstIterator< ImageType > it(m_Images[i], region);
+    for (; !wit.IsAtEnd(); ++wit, ++mit, ++it)
+    {
+      if (mit.Get() > NumericTraits< MaskPixelType >::ZeroValue())
+      {
+        sketches[i].Insert(it.Get(), wit.Get());
+      }
+    }
+  }
+}
+
+template< typename TImage, typename TMaskImage >
+void NeighborhoodQuantileSketchCalculator< TImage, TMaskImage >::PrintSelf(
+    std::ostream & os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Radius: " << m_Radius << std::endl;
+  os << indent << "Sketch size: " << m_SketchSize << std::endl;
+  os << indent << "Seed: " << m_Seed << std::endl;
+  os << indent << "Number of images: " << m_Images.size() << std::endl;
+}
+} // end namespace itk
+
+#endif
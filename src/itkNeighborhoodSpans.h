@@ -0,0 +1,264 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkNeighborhoodSpans_h
+#define __itkNeighborhoodSpans_h
+
+#include "itkSize.h"
+#include "itkImageRegion.h"
+#include "itkFixedArray.h"
+#include "itkMacro.h"
+#include "vcl_cmath.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace itk
+{
+/** \class NeighborhoodSpans
+ * \brief Neighbors of a box neighborhood iterator as runs along the first
+ * dimension.
+ *
+ * Each span is a run of consecutive neighborhood indices, which are
+ * consecutive voxels of an image row. A box gives one full row per span; a
+ * ball keeps, for every row crossing it, the run of voxels inside the
+ * ellipsoid. Gathering span by span reads the image row by row whatever the
+ * shape.
+ *
+ * Every span is centered on the first dimension, so when the neighborhood
+ * moves one voxel along it the voxel entering a row is the last of its span
+ * and the one leaving is the first: GetLeadingIndices() and
+ * GetTrailingIndices() are the slabs of a sliding window.
+ */
+template< unsigned int VDimension >
+class NeighborhoodSpans
+{
+public:
+  typedef Size< VDimension > RadiusType;
+  typedef FixedArray< double, VDimension > BallRadiusType;
+
+  struct Span
+  {
+    unsigned int Begin;
+    unsigned int Length;
+  };
+  typedef std::vector< Span > SpanListType;
+  typedef std::vector< unsigned int > IndexListType;
+
+  NeighborhoodSpans()
+  {
+    RadiusType radius;
+    radius.Fill(0);
+    this->SetBox(radius);
+  }
+
+  void SetBox(const RadiusType & radius)
+  {
+    m_Radius = radius;
+    m_Spans.clear();
+    this->AddBoxSpans();
+    this->UpdateSlabs();
+  }
+
+  /** Ellipsoid with the given semi-axes in voxels, usually a physical radius
+   * divided by the spacing. The box radius is the floor of each axis. */
+  void SetBall(const BallRadiusType & radius)
+  {
+    for (unsigned int d = 0; d < VDimension; d++)
+    {
+      itkAssertOrThrowMacro(radius[d] >= 0, "Ball radius must not be negative.");
+      m_Radius[d] = static_cast< SizeValueType >(vcl_floor(radius[d] + 1e-9));
+    }
+    m_Spans.clear();
+    this->AddBallSpans(radius, VDimension - 1, 0, 0);
+    this->UpdateSlabs();
+  }
+
+  /** Box radius of the iterator the indices refer to. */
+  const RadiusType & GetRadius() const
+  {
+    return m_Radius;
+  }
+
+  const SpanListType & GetSpans() const
+  {
+    return m_Spans;
+  }
+
+  const IndexListType & GetLeadingIndices() const
+  {
+    return m_Leading;
+  }
+
+  const IndexListType & GetTrailingIndices() const
+  {
+    return m_Trailing;
+  }
+
+  /** Number of neighbors in all spans. */
+  unsigned int GetNumberOfIndices() const
+  {
+    return m_NumberOfIndices;
+  }
+
+private:
+  /** Full rows of the box, in index order. */
+  void AddBoxSpans()
+  {
+    const unsigned int rowLength = 2 * m_Radius[0] + 1;
+    unsigned int rows = 1;
+    for (unsigned int d = 1; d < VDimension; d++)
+    {
+      rows *= 2 * m_Radius[d] + 1;
+    }
+    for (unsigned int r = 0; r < rows; r++)
+    {
+      Span span;
+      span.Begin = r * rowLength;
+      span.Length = rowLength;
+      m_Spans.push_back(span);
+    }
+  }
+
+  /** Rows within dimensions d and below; base is the index of the row start
+   * so far and sum holds the squared normalized offsets of the dimensions
+   * above d. Rows are added in index order. */
+  void AddBallSpans(const BallRadiusType & radius, unsigned int d,
+                    unsigned int base, double sum)
+  {
+    if (d == 0)
+    {
+      const double remaining = 1 - sum;
+      const long half = static_cast< long >(vcl_floor(
+          radius[0] * vcl_sqrt(remaining > 0 ? remaining : 0) + 1e-9));
+      const long width = std::min(half, static_cast< long >(m_Radius[0]));
+      Span span;
+      span.Begin = base + static_cast< unsigned int >(m_Radius[0] - width);
+      span.Length = static_cast< unsigned int >(2 * width + 1);
+      m_Spans.push_back(span);
+      return;
+    }
+    unsigned int stride = 1;
+    for (unsigned int k = 0; k < d; k++)
+    {
+      stride *= 2 * m_Radius[k] + 1;
+    }
+    const long r = static_cast< long >(m_Radius[d]);
+    for (long o = -r; o <= r; o++)
+    {
+      const double t = radius[d] > 0 ? o / radius[d] : 0;
+      if (sum + t * t > 1 + 1e-9)
+      {
+        continue;
+      }
+      this->AddBallSpans(radius, d - 1,
+                         base + static_cast< unsigned int >(o + r) * stride,
+                         sum + t * t);
+    }
+  }
+
+  void UpdateSlabs()
+  {
+    m_Leading.clear();
+    m_Trailing.clear();
+    m_NumberOfIndices = 0;
+    for (size_t s = 0; s < m_Spans.size(); s++)
+    {
+      m_Trailing.push_back(m_Spans[s].Begin);
+      m_Leading.push_back(m_Spans[s].Begin + m_Spans[s].Length - 1);
+      m_NumberOfIndices += m_Spans[s].Length;
+    }
+  }
+
+  RadiusType m_Radius;
+  SpanListType m_Spans;
+  IndexListType m_Leading;
+  IndexListType m_Trailing;
+  unsigned int m_NumberOfIndices;
+};
+
+/** \class SlidingNeighborhoodWindow
+ * \brief Keeps the neighbors of a window up to date while a neighborhood
+ * iterator walks a region in scan line order.
+ *
+ * The window is given as callbacks, an object with Clear(), Insert(i) and
+ * Remove(i) taking neighborhood indices; the callbacks decide which neighbors
+ * count, e.g. only those inside a mask. Enter() brings the window to the
+ * current voxel: when the window of the previous voxel carries over only the
+ * leading slab is inserted, otherwise it is cleared and every span gathered.
+ * Leave() removes the trailing slab before the iterator moves on, unless the
+ * next voxel starts a new scan line in which case the window is rebuilt.
+ * Invalidate() is for voxels the iterator passes without calling Enter().
+ */
+template< unsigned int VDimension >
+class SlidingNeighborhoodWindow
+{
+public:
+  typedef NeighborhoodSpans< VDimension > SpansType;
+  typedef ImageRegion< VDimension > RegionType;
+  typedef Index< VDimension > IndexType;
+
+  SlidingNeighborhoodWindow(const SpansType & spans, const RegionType & region):
+    m_Spans(spans),
+    m_LastInRow(region.GetIndex()[0]
+                + static_cast< IndexValueType >(region.GetSize()[0]) - 1),
+    m_IsValid(false)
+  {
+  }
+
+  template< typename TCallbacks >
+  void Enter(TCallbacks & callbacks)
+  {
+    if (m_IsValid)
+    {
+      const typename SpansType::IndexListType & leading = m_Spans.GetLeadingIndices();
+      for (size_t s = 0; s < leading.size(); s++)
+      {
+        callbacks.Insert(leading[s]);
+      }
+      return;
+    }
+    callbacks.Clear();
+    const typename SpansType::SpanListType & spanList = m_Spans.GetSpans();
+    for (size_t k = 0; k < spanList.size(); k++)
+    {
+      const unsigned int spanEnd = spanList[k].Begin + spanList[k].Length;
+      for (unsigned int i = spanList[k].Begin; i < spanEnd; i++)
+      {
+        callbacks.Insert(i);
+      }
+    }
+    m_IsValid = true;
+  }
+
+  /** Call with the index of the current voxel before moving on. */
+  template< typename TCallbacks >
+  void Leave(const IndexType & index, TCallbacks & callbacks)
+  {
+    if (!m_IsValid)
+    {
+      return;
+    }
+    if (index[0] == m_LastInRow)
+    {
+      m_IsValid = false;
+      return;
+    }
+    const typename SpansType::IndexListType & trailing = m_Spans.GetTrailingIndices();
+    for (size_t s = 0; s < trailing.size(); s++)
+    {
+      callbacks.Remove(trailing[s]);
+    }
+  }
+
+  void Invalidate()
+  {
+    m_IsValid = false;
+  }
+
+private:
+  const SpansType & m_Spans;
+  const IndexValueType m_LastInRow;
+  bool m_IsValid;
+};
+} // end namespace itk
+
+#endif
@@ -2,18 +2,24 @@
 #ifndef __itkNeighborhoodTwoSampleKSImageFilter_h
 #define __itkNeighborhoodTwoSampleKSImageFilter_h
 
-#include "itkBoxImageFilter.h"
+#include "itkActiveVoxelBoxImageFilter.h"
 #include "itkImage.h"
+#include "itkConstNeighborhoodIterator.h"
 
 #include "itkKolmogorovSmirnovTest.h"
+#include "itkSortedNeighborhoodSample.h"
 
 namespace itk
 {
 /** \class NeighborhoodTwoSampleKSImageFilter
+ *
+ * Both the masked test neighborhood and the non-zero reference components
+ * over it are kept sorted while the iterators slide along a scan line; only
+ * the trailing and leading slabs are removed and inserted.
  */
 template< typename TInputImage, typename TReferenceImage, typename ProbabilityPrecision = double,
     typename LabelType = unsigned char >
-class NeighborhoodTwoSampleKSImageFilter: public BoxImageFilter< TInputImage,
+class NeighborhoodTwoSampleKSImageFilter: public ActiveVoxelBoxImageFilter< TInputImage,
     Image< ProbabilityPrecision, TInputImage::ImageDimension > >
 {
 public:
@@ -31,7 +37,7 @@ public:
 
       /** Standard class typedefs. */
       typedef NeighborhoodTwoSampleKSImageFilter Self;
-      typedef ImageToImageFilter< InputImageType, OutputImageType > Superclass;
+      typedef ActiveVoxelBoxImageFilter< InputImageType, OutputImageType > Superclass;
       typedef SmartPointer< Self > Pointer;
       typedef SmartPointer< const Self > ConstPointer;
 
@@ -52,6 +58,8 @@ public:
       typedef typename ReferenceImageType::RegionType ReferenceImageRegionType;
 
       typedef typename InputImageType::SizeType InputSizeType;
+      typedef typename Superclass::NeighborhoodSpansType NeighborhoodSpansType;
+      typedef typename Superclass::SlidingWindowType SlidingWindowType;
 
       typedef Statistics::KolmogorovSmirnovTest< InputPixelType > KSType;
       typedef typename KSType::DistributionType DistributionType;
@@ -99,15 +107,74 @@ public:
     virtual ~NeighborhoodTwoSampleKSImageFilter()
     {}
 
-    void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread,
-        ThreadIdType threadId);
+    void ThreadedComputeRegion(const OutputImageRegionType & outputRegionForThread,
+        ThreadIdType threadId, ProgressReporter & progress);
+
+    void ComputeActiveRuns(const OutputImageRegionType & region);
 
   private:
     NeighborhoodTwoSampleKSImageFilter(const Self &); //purposely not implemented
     void operator=(const Self &);//purposely not implemented
 
     typedef typename KSType::PairDistribution PairDistribution;
+    typedef Statistics::SortedNeighborhoodSample< InputPixelType > SortedSampleType;
     typename KSType::Pointer m_KS;
+
+    /** Window callbacks keeping, for the neighbors inside the mask, the input
+     * values and the non-zero components of the reference pixels. */
+    struct MaskedWindow
+    {
+      MaskedWindow(const ConstNeighborhoodIterator< InputImageType > & input,
+                   const ConstNeighborhoodIterator< ReferenceImageType > & reference,
+                   const ConstNeighborhoodIterator< LabelImageType > & mask,
+                   size_t length, SortedSampleType & pixels,
+                   SortedSampleType & refDist):
+        Input(input), Reference(reference), Mask(mask), Length(length),
+        Pixels(pixels), RefDist(refDist)
+      {
+      }
+      void Clear()
+      {
+        Pixels.Clear();
+        RefDist.Clear();
+      }
+      void Insert(unsigned int i)
+      {
+        if (Mask.GetPixel(i) > NumericTraits< LabelType >::Zero)
+        {
+          Pixels.Insert(Input.GetPixel(i));
+          const ReferenceImagePixelType & r = Reference.GetPixel(i);
+          for (size_t j = 0; j < Length; j++)
+          {
+            if (r[j] != NumericTraits< ReferenceImageInternalPixelType >::Zero)
+            {
+              RefDist.Insert(static_cast< InputPixelType >(r[j]));
+            }
+          }
+        }
+      }
+      void Remove(unsigned int i)
+      {
+        if (Mask.GetPixel(i) > NumericTraits< LabelType >::Zero)
+        {
+          Pixels.Remove(Input.GetPixel(i));
+          const ReferenceImagePixelType & r = Reference.GetPixel(i);
+          for (size_t j = 0; j < Length; j++)
+          {
+            if (r[j] != NumericTraits< ReferenceImageInternalPixelType >::Zero)
+            {
+              RefDist.Remove(static_cast< InputPixelType >(r[j]));
+            }
+          }
+        }
+      }
+      const ConstNeighborhoodIterator< InputImageType > & Input;
+      const ConstNeighborhoodIterator< ReferenceImageType > & Reference;
+      const ConstNeighborhoodIterator< LabelImageType > & Mask;
+      const size_t Length;
+      SortedSampleType & Pixels;
+      SortedSampleType & RefDist;
+    };
   };
 }
 // end namespace itk
@@ -11,6 +11,7 @@
 #include "itkProgressReporter.h"
 
 #include <vector>
+#include <algorithm>
 
 
 namespace itk
@@ -19,12 +20,22 @@ template< typename TInputImage, typename TReferenceImage, typename ProbabilityPr
 NeighborhoodTwoSampleKSImageFilter< TInputImage, TReferenceImage, ProbabilityPrecision, LabelType>::NeighborhoodTwoSampleKSImageFilter()
 {
   m_KS = KSType::New();
-  m_KS->SortedReferenceOff();
+  m_KS->SortedReferenceOn();
+  m_KS->SortedSampleOn();
 }
 
 template< typename TInputImage, typename TReferenceImage, typename ProbabilityPrecision,typename LabelType>
-void NeighborhoodTwoSampleKSImageFilter< TInputImage, TReferenceImage, ProbabilityPrecision, LabelType>::ThreadedGenerateData(
-    const OutputImageRegionType & outputRegionForThread, ThreadIdType threadId)
+void NeighborhoodTwoSampleKSImageFilter< TInputImage, TReferenceImage, ProbabilityPrecision, LabelType>::ComputeActiveRuns(
+    const OutputImageRegionType & region)
+{
+  this->AddActiveRuns(this->GetMask(), region,
+                      Functor::ActiveIfPositive< LabelType >());
+}
+
+template< typename TInputImage, typename TReferenceImage, typename ProbabilityPrecision,typename LabelType>
+void NeighborhoodTwoSampleKSImageFilter< TInputImage, TReferenceImage, ProbabilityPrecision, LabelType>::ThreadedComputeRegion(
+    const OutputImageRegionType & outputRegionForThread, ThreadIdType itkNotUsed(threadId),
+    ProgressReporter & progress)
 {
   typename OutputImageType::Pointer output = this->GetOutput();
   typename InputImageType::ConstPointer input = this->GetInput();
@@ -35,16 +46,13 @@ void NeighborhoodTwoSampleKSImageFilter< TInputImage, TReferenceImage, Probabili
   typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator< InputImageType >::FaceListType faceList =
       bC(input, outputRegionForThread, this->GetRadius());
 
-  ProgressReporter progress(this, threadId,
-                            outputRegionForThread.GetNumberOfPixels());
-
   ZeroFluxNeumannBoundaryCondition< InputImageType > nbcInput;
   ZeroFluxNeumannBoundaryCondition< LabelImageType > nbcLabel;
   ZeroFluxNeumannBoundaryCondition< ReferenceImageType > nbcRef;
 
-  DistributionType pixels;
-  DistributionType refDist;
-  size_t len = referece->GetNumberOfComponentsPerPixel();
+  SortedSampleType pixels;
+  SortedSampleType refDist;
+  const size_t len = referece->GetNumberOfComponentsPerPixel();
   for (typename NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<
       InputImageType >::FaceListType::iterator fit = faceList.begin();
       fit != faceList.end(); ++fit)
@@ -67,35 +75,29 @@ void NeighborhoodTwoSampleKSImageFilter< TInputImage, TReferenceImage, Probabili
     maskIt.OverrideBoundaryCondition(&nbcLabel);
     maskIt.GoToBegin();
 
-    const unsigned int neighborhoodSize = bit.Size();
+    pixels.Reserve(this->GetNeighborhoodSpans().GetNumberOfIndices());
+    refDist.Reserve(this->GetNeighborhoodSpans().GetNumberOfIndices() * len);
+    SlidingWindowType window(this->GetNeighborhoodSpans(), *fit);
+    MaskedWindow callbacks(bit, rit, maskIt, len, pixels, refDist);
+
     while (!bit.IsAtEnd())
     {
       if (maskIt.GetCenterPixel() > itk::NumericTraits< LabelType >::Zero)
       {
-        pixels.clear();
-        refDist.clear();
-        for (size_t i = 0; i < neighborhoodSize; i++)
-        {
-          if (maskIt.GetPixel(i) > itk::NumericTraits< LabelType >::Zero)
-          {
-            pixels.push_back(bit.GetPixel(i));
-            for(size_t j=0;j<len;j++)
-            {
-              ReferenceImageInternalPixelType r = rit.GetPixel(i)[j];
-              if (r != itk::NumericTraits< ReferenceImageInternalPixelType >::Zero)
-              {
-                refDist.push_back(r);
-              }
-            }
-          }
-        }
-        const double st = m_KS->Evaluate(PairDistribution(refDist, pixels));
+        window.Enter(callbacks);
+        pixels.Update();
+        refDist.Update();
+        const double st = m_KS->Evaluate(
+            refDist.Empty() ? 0 : &refDist.GetValues()[0], refDist.Size(),
+            &pixels.GetValues()[0], pixels.Size());
         it.Set(static_cast< OutputPixelType >(st));
       }
       else
       {
+        window.Invalidate();
         it.Set(itk::NumericTraits< OutputPixelType >::ZeroValue());
       }
+      window.Leave(bit.GetIndex(), callbacks);
 
       ++maskIt;
       ++bit;
@@ -0,0 +1,271 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkQuantileSketch_h
+#define __itkQuantileSketch_h
+
+#include "itkIntTypes.h"
+#include "itkMacro.h"
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class QuantileSketch
+ * \brief Mergeable streaming summary of a weighted sample for CDF and
+ * quantile queries.
+ *
+ * Values are kept in levels; a value at level l stands for 2^l samples. When
+ * a level holds more than the sketch size it is sorted and every other value,
+ * starting at a random offset, moves one level up. A weight is inserted as its
+ * binary digits, one value per set bit, so weighted insertion costs no more
+ * than a few plain ones. Sketches of the same size merge level by level, so a
+ * sample can be summarized in parts and combined.
+ *
+ * The random offsets come from a generator seeded with SetSeed(): the same
+ * values inserted and merged in the same order always give the same sketch.
+ * The rank error is of the order of log(N / SketchSize) / SketchSize.
+ */
+template< typename TValue >
+class QuantileSketch
+{
+public:
+  typedef TValue ValueType;
+  typedef std::vector< TValue > DistributionType;
+
+  explicit QuantileSketch(unsigned int sketchSize = 256, uint64_t seed = 0)
+  {
+    m_SketchSize = std::max(2u, sketchSize);
+    m_TotalWeight = 0;
+    this->SetSeed(seed);
+  }
+
+  void SetSeed(uint64_t seed)
+  {
+    /* Any seed, zero included, gives a non-zero xorshift state. */
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    m_State = (z ^ (z >> 31)) | 1;
+    m_RandomBits = 0;
+    m_RandomBitsLeft = 0;
+  }
+
+  unsigned int GetSketchSize() const
+  {
+    return m_SketchSize;
+  }
+
+  /** Sum of the weights inserted and merged so far. */
+  uint64_t GetTotalWeight() const
+  {
+    return m_TotalWeight;
+  }
+
+  /** Number of values held in all levels. */
+  SizeValueType GetNumberOfRetainedValues() const
+  {
+    SizeValueType n = 0;
+    for (size_t l = 0; l < m_Levels.size(); l++)
+    {
+      n += m_Levels[l].size();
+    }
+    return n;
+  }
+
+  bool IsEmpty() const
+  {
+    return m_TotalWeight == 0;
+  }
+
+  void Clear()
+  {
+    m_Levels.clear();
+    m_TotalWeight = 0;
+  }
+
+  void Insert(const TValue & v, uint64_t weight = 1)
+  {
+    if (weight == 0)
+    {
+      return;
+    }
+    m_TotalWeight += weight;
+    for (unsigned int l = 0; weight; l++, weight >>= 1)
+    {
+      if (weight & 1)
+      {
+        this->Level(l).push_back(v);
+      }
+    }
+    this->Compress();
+  }
+
+  /** Add the values of another sketch of the same size. */
+  void Merge(const QuantileSketch & other)
+  {
+    itkAssertOrThrowMacro(other.m_SketchSize == m_SketchSize,
+                          "Only sketches of the same size can be merged.");
+    for (unsigned int l = 0; l < other.m_Levels.size(); l++)
+    {
+      if (!other.m_Levels[l].empty())
+      {
+        std::vector< TValue > & level = this->Level(l);
+        level.insert(level.end(), other.m_Levels[l].begin(),
+                     other.m_Levels[l].end());
+      }
+    }
+    m_TotalWeight += other.m_TotalWeight;
+    this->Compress();
+  }
+
+  /** Fraction of the weight at or below v. */
+  double EvaluateCDF(const TValue & v) const
+  {
+    if (m_TotalWeight == 0)
+    {
+      return 0;
+    }
+    uint64_t below = 0;
+    for (unsigned int l = 0; l < m_Levels.size(); l++)
+    {
+      for (size_t i = 0; i < m_Levels[l].size(); i++)
+      {
+        if (!(v < m_Levels[l][i]))
+        {
+          below += static_cast< uint64_t >(1) << l;
+        }
+      }
+    }
+    return static_cast< double >(below) / m_TotalWeight;
+  }
+
+  /** Smallest retained value whose CDF reaches p. */
+  TValue GetQuantile(double p) const
+  {
+    itkAssertOrThrowMacro(m_TotalWeight > 0, "Quantile of an empty sketch.");
+    std::vector< TValue > q;
+    std::vector< double > ps(1, p);
+    this->GetQuantiles(ps, q);
+    return q[0];
+  }
+
+  /** Sorted sample of numberOfValues values, the quantiles at
+   * (i + 0.5) / numberOfValues. Its empirical CDF follows the sketch, so it
+   * can be used wherever a sorted reference sample is expected. */
+  DistributionType GetDistribution(unsigned int numberOfValues) const
+  {
+    DistributionType distribution;
+    if (m_TotalWeight == 0 || numberOfValues == 0)
+    {
+      return distribution;
+    }
+    std::vector< double > ps(numberOfValues);
+    for (unsigned int i = 0; i < numberOfValues; i++)
+    {
+      ps[i] = (i + 0.5) / numberOfValues;
+    }
+    this->GetQuantiles(ps, distribution);
+    return distribution;
+  }
+
+private:
+  typedef std::pair< TValue, uint64_t > WeightedValueType;
+
+  std::vector< TValue > & Level(unsigned int l)
+  {
+    if (m_Levels.size() <= l)
+    {
+      m_Levels.resize(l + 1);
+    }
+    return m_Levels[l];
+  }
+
+  bool NextRandomBit()
+  {
+    if (m_RandomBitsLeft == 0)
+    {
+      m_State ^= m_State << 13;
+      m_State ^= m_State >> 7;
+      m_State ^= m_State << 17;
+      m_RandomBits = m_State;
+      m_RandomBitsLeft = 64;
+    }
+    const bool bit = m_RandomBits & 1;
+    m_RandomBits >>= 1;
+    --m_RandomBitsLeft;
+    return bit;
+  }
+
+  /** Halve every level above the sketch size into the next one. An odd
+   * value out stays behind so no weight is lost. */
+  void Compress()
+  {
+    for (unsigned int l = 0; l < m_Levels.size(); l++)
+    {
+      if (m_Levels[l].size() <= m_SketchSize)
+      {
+        continue;
+      }
+      std::vector< TValue > level;
+      level.swap(m_Levels[l]);
+      std::sort(level.begin(), level.end());
+      const size_t even = level.size() & ~static_cast< size_t >(1);
+      if (even != level.size())
+      {
+        m_Levels[l].push_back(level.back());
+      }
+      std::vector< TValue > & up = this->Level(l + 1);
+      for (size_t i = this->NextRandomBit() ? 1 : 0; i < even; i += 2)
+      {
+        up.push_back(level[i]);
+      }
+    }
+  }
+
+  /** Quantiles for increasing probabilities. */
+  void GetQuantiles(const std::vector< double > & ps,
+                    std::vector< TValue > & quantiles) const
+  {
+    std::vector< WeightedValueType > values;
+    values.reserve(this->GetNumberOfRetainedValues());
+    for (unsigned int l = 0; l < m_Levels.size(); l++)
+    {
+      for (size_t i = 0; i < m_Levels[l].size(); i++)
+      {
+        values.push_back(WeightedValueType(m_Levels[l][i],
+                                           static_cast< uint64_t >(1) << l));
+      }
+    }
+    std::sort(values.begin(), values.end());
+
+    quantiles.resize(ps.size());
+    uint64_t cumulative = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < ps.size(); i++)
+    {
+      const double target = ps[i] * m_TotalWeight;
+      while (j + 1 < values.size()
+          && cumulative + values[j].second < target)
+      {
+        cumulative += values[j].second;
+        ++j;
+      }
+      quantiles[i] = values[j].first;
+    }
+  }
+
+  unsigned int m_SketchSize;
+  uint64_t m_TotalWeight;
+  std::vector< std::vector< TValue > > m_Levels;
+
+  uint64_t m_State;
+  uint64_t m_RandomBits;
+  unsigned int m_RandomBitsLeft;
+};
+} // end namespace Statistics
+} // end namespace itk
+
+#endif
@@ -0,0 +1,300 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkReferenceDistributionCache_h
+#define __itkReferenceDistributionCache_h
+
+#include "itkIntTypes.h"
+#include "itkMacro.h"
+#include "itksys/SystemTools.hxx"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class ReferenceDistributionKey
+ * \brief 64 bit FNV-1a hash of everything a reference distribution is built
+ * from: image files, image geometry, and parameters.
+ *
+ * Keying on the pixels would cost a pass over the images, about as much as
+ * building the reference. An image file is instead keyed by its full path,
+ * length and modification time, so a cached entry goes stale when a file is
+ * rewritten, moved or renamed, or when the geometry or any parameter added to
+ * the key changes. Touching a file with the same content also invalidates the
+ * entry; editing it in place within the same second with the same length
+ * does not.
+ */
+class ReferenceDistributionKey
+{
+public:
+  ReferenceDistributionKey()
+  {
+    m_Hash = 14695981039346656037ULL;
+  }
+
+  void AddBytes(const void * data, size_t length)
+  {
+    const unsigned char * p = static_cast< const unsigned char * >(data);
+    for (size_t i = 0; i < length; i++)
+    {
+      m_Hash ^= p[i];
+      m_Hash *= 1099511628211ULL;
+    }
+  }
+
+  template< typename T >
+  void Add(const T & value)
+  {
+    this->AddBytes(&value, sizeof(T));
+  }
+
+  void AddString(const std::string & s)
+  {
+    this->Add< uint64_t >(s.size());
+    this->AddBytes(s.data(), s.size());
+  }
+
+  /** Full path, length and modification time of a file. */
+  void AddFile(const std::string & filename)
+  {
+    this->AddString(itksys::SystemTools::CollapseFullPath(filename.c_str()));
+    this->Add< uint64_t >(itksys::SystemTools::FileLength(filename.c_str()));
+    this->Add< int64_t >(itksys::SystemTools::ModifiedTime(filename.c_str()));
+  }
+
+  /** Geometry and number of components of the buffered region; not the
+   * pixels. */
+  template< typename TImage >
+  void AddImageInformation(const TImage * image)
+  {
+    const unsigned int dimension = TImage::ImageDimension;
+    for (unsigned int d = 0; d < dimension; d++)
+    {
+      this->Add< int64_t >(image->GetBufferedRegion().GetIndex()[d]);
+      this->Add< uint64_t >(image->GetBufferedRegion().GetSize()[d]);
+      this->Add< double >(image->GetSpacing()[d]);
+      this->Add< double >(image->GetOrigin()[d]);
+      for (unsigned int e = 0; e < dimension; e++)
+      {
+        this->Add< double >(image->GetDirection()[d][e]);
+      }
+    }
+    this->Add< uint32_t >(image->GetNumberOfComponentsPerPixel());
+  }
+
+  uint64_t GetDigest() const
+  {
+    return m_Hash;
+  }
+
+  /** Digest as 16 hex digits, e.g. for a cache file name. */
+  std::string GetHexDigest() const
+  {
+    std::ostringstream os;
+    os << std::hex << std::setw(16) << std::setfill('0') << m_Hash;
+    return os.str();
+  }
+
+private:
+  uint64_t m_Hash;
+};
+
+/** \class ReferenceDistributionCache
+ * \brief Binary file holding a reference distribution and the key it was
+ * built with.
+ *
+ * A file holds either a sorted reference sample or a histogram. The header
+ * records the kind, the size of a stored value and the key; Read() fails
+ * unless they match, so a stale or foreign file is rebuilt rather than
+ * used. Read with a zero key to take a file as an input whatever it was built
+ * from. Values are stored in native byte order.
+ */
+class ReferenceDistributionCache
+{
+public:
+  /** Sorted reference sample, e.g. KolmogorovSmirnovTest::DistributionType. */
+  template< typename TValue >
+  static bool WriteDistribution(const std::string & filename, uint64_t key,
+                                const std::vector< TValue > & distribution)
+  {
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+      return false;
+    }
+    WriteHeader(file, DistributionKind, sizeof(TValue), key);
+    Write< uint64_t >(file, distribution.size());
+    if (!distribution.empty())
+    {
+      file.write(reinterpret_cast< const char * >(&distribution[0]),
+                 distribution.size() * sizeof(TValue));
+    }
+    return static_cast< bool >(file);
+  }
+
+  template< typename TValue >
+  static bool ReadDistribution(const std::string & filename, uint64_t key,
+                               std::vector< TValue > & distribution)
+  {
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file || !ReadHeader(file, DistributionKind, sizeof(TValue), key))
+    {
+      return false;
+    }
+    uint64_t size = 0;
+    Read(file, size);
+    std::vector< TValue > values(size);
+    if (size)
+    {
+      file.read(reinterpret_cast< char * >(&values[0]), size * sizeof(TValue));
+    }
+    if (!file)
+    {
+      return false;
+    }
+    distribution.swap(values);
+    return true;
+  }
+
+  /** Bin bounds and frequencies of every dimension of a histogram. */
+  template< typename THistogram >
+  static bool WriteHistogram(const std::string & filename, uint64_t key,
+                             const THistogram * histogram)
+  {
+    typedef typename THistogram::MeasurementType MeasurementType;
+    std::ofstream file(filename.c_str(), std::ios::binary);
+    if (!file)
+    {
+      return false;
+    }
+    WriteHeader(file, HistogramKind, sizeof(MeasurementType), key);
+    const unsigned int dimension = histogram->GetMeasurementVectorSize();
+    Write< uint32_t >(file, dimension);
+    for (unsigned int d = 0; d < dimension; d++)
+    {
+      Write< uint64_t >(file, histogram->GetSize(d));
+    }
+    for (unsigned int d = 0; d < dimension; d++)
+    {
+      for (unsigned int n = 0; n < histogram->GetSize(d); n++)
+      {
+        Write< MeasurementType >(file, histogram->GetBinMin(d, n));
+        Write< MeasurementType >(file, histogram->GetBinMax(d, n));
+      }
+    }
+    for (unsigned int i = 0; i < histogram->Size(); i++)
+    {
+      Write< double >(file, static_cast< double >(histogram->GetFrequency(i)));
+    }
+    return static_cast< bool >(file);
+  }
+
+  /** The histogram is initialized to the stored bins. */
+  template< typename THistogram >
+  static bool ReadHistogram(const std::string & filename, uint64_t key,
+                            THistogram * histogram)
+  {
+    typedef typename THistogram::MeasurementType MeasurementType;
+    typedef typename THistogram::AbsoluteFrequencyType FrequencyType;
+    std::ifstream file(filename.c_str(), std::ios::binary);
+    if (!file || !ReadHeader(file, HistogramKind, sizeof(MeasurementType), key))
+    {
+      return false;
+    }
+    uint32_t dimension = 0;
+    Read(file, dimension);
+    if (!file || dimension == 0)
+    {
+      return false;
+    }
+    typename THistogram::SizeType size(dimension);
+    for (unsigned int d = 0; d < dimension; d++)
+    {
+      uint64_t s = 0;
+      Read(file, s);
+      size[d] = s;
+    }
+    if (!file)
+    {
+      return false;
+    }
+    histogram->SetMeasurementVectorSize(dimension);
+    histogram->Initialize(size);
+    for (unsigned int d = 0; d < dimension; d++)
+    {
+      for (unsigned int n = 0; n < size[d]; n++)
+      {
+        MeasurementType binMin = 0;
+        MeasurementType binMax = 0;
+        Read(file, binMin);
+        Read(file, binMax);
+        histogram->SetBinMin(d, n, binMin);
+        histogram->SetBinMax(d, n, binMax);
+      }
+    }
+    for (unsigned int i = 0; i < histogram->Size(); i++)
+    {
+      double frequency = 0;
+      Read(file, frequency);
+      histogram->SetFrequency(i, static_cast< FrequencyType >(frequency));
+    }
+    return static_cast< bool >(file);
+  }
+
+private:
+  enum
+  {
+    DistributionKind = 1,
+    HistogramKind = 2
+  };
+
+  static const char * Magic()
+  {
+    return "CASCREF1";
+  }
+
+  template< typename T >
+  static void Write(std::ostream & os, const T & value)
+  {
+    os.write(reinterpret_cast< const char * >(&value), sizeof(T));
+  }
+
+  template< typename T >
+  static void Read(std::istream & is, T & value)
+  {
+    is.read(reinterpret_cast< char * >(&value), sizeof(T));
+  }
+
+  static void WriteHeader(std::ostream & os, uint32_t kind,
+                          uint32_t valueSize, uint64_t key)
+  {
+    os.write(Magic(), 8);
+    Write(os, kind);
+    Write(os, valueSize);
+    Write(os, key);
+  }
+
+  static bool ReadHeader(std::istream & is, uint32_t kind,
+                         uint32_t valueSize, uint64_t key)
+  {
+    char magic[8];
+    is.read(magic, 8);
+    uint32_t fileKind = 0;
+    uint32_t fileValueSize = 0;
+    uint64_t fileKey = 0;
+    Read(is, fileKind);
+    Read(is, fileValueSize);
+    Read(is, fileKey);
+    return is && std::memcmp(magic, Magic(), 8) == 0 && fileKind == kind
+        && fileValueSize == valueSize && (key == 0 || fileKey == key);
+  }
+};
+} // end namespace Statistics
+} // end namespace itk
+
+#endif
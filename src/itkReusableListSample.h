@@ -0,0 +1,195 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkReusableListSample_h
+#define __itkReusableListSample_h
+
+#include "itkSample.h"
+
+#include <vector>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class ReusableListSample
+ * \brief List sample whose Clear() keeps the stored measurement vectors.
+ *
+ * ListSample::Clear() destroys its measurement vectors, so refilling it with
+ * PushBack() allocates every vector again. This sample only resets its size
+ * and PushBack() overwrites the existing vectors in place, so a sample that
+ * is cleared and refilled for every voxel stops allocating once it has grown
+ * to the largest neighborhood.
+ */
+template< typename TMeasurementVector >
+class ReusableListSample: public Sample< TMeasurementVector >
+{
+public:
+  /** Standard typedefs */
+  typedef ReusableListSample Self;
+  typedef Sample< TMeasurementVector > Superclass;
+  typedef SmartPointer< Self > Pointer;
+  typedef SmartPointer< const Self > ConstPointer;
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(ReusableListSample, Sample)
+  ;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro (Self);
+
+  typedef typename Superclass::MeasurementVectorType MeasurementVectorType;
+  typedef typename Superclass::InstanceIdentifier InstanceIdentifier;
+  typedef typename Superclass::AbsoluteFrequencyType AbsoluteFrequencyType;
+  typedef typename Superclass::TotalAbsoluteFrequencyType TotalAbsoluteFrequencyType;
+
+  void Clear()
+  {
+    m_Size = 0;
+  }
+
+  void PushBack(const MeasurementVectorType & mv)
+  {
+    if (m_Size < m_InternalContainer.size())
+    {
+      m_InternalContainer[m_Size] = mv;
+    }
+    else
+    {
+      m_InternalContainer.push_back(mv);
+    }
+    ++m_Size;
+  }
+
+  InstanceIdentifier Size() const
+  {
+    return m_Size;
+  }
+
+  const MeasurementVectorType & GetMeasurementVector(InstanceIdentifier id) const
+  {
+    if (id < m_Size)
+    {
+      return m_InternalContainer[id];
+    }
+    itkExceptionMacro("MeasurementVector " << id << " does not exist");
+  }
+
+  AbsoluteFrequencyType GetFrequency(InstanceIdentifier id) const
+  {
+    if (id < m_Size)
+    {
+      return 1;
+    }
+    return 0;
+  }
+
+  TotalAbsoluteFrequencyType GetTotalFrequency() const
+  {
+    return static_cast< TotalAbsoluteFrequencyType >(m_Size);
+  }
+
+  /** \class ConstIterator
+   * \brief Iterates over the stored measurement vectors, as
+   * ListSample::ConstIterator does. */
+  class ConstIterator
+  {
+    friend class ReusableListSample;
+  public:
+    ConstIterator(const ReusableListSample * sample)
+    {
+      *this = sample->Begin();
+    }
+
+    ConstIterator(const ConstIterator & iter)
+    {
+      m_Sample = iter.m_Sample;
+      m_InstanceIdentifier = iter.m_InstanceIdentifier;
+    }
+
+    ConstIterator & operator=(const ConstIterator & iter)
+    {
+      m_Sample = iter.m_Sample;
+      m_InstanceIdentifier = iter.m_InstanceIdentifier;
+      return *this;
+    }
+
+    AbsoluteFrequencyType GetFrequency() const
+    {
+      return 1;
+    }
+
+    const MeasurementVectorType & GetMeasurementVector() const
+    {
+      return m_Sample->m_InternalContainer[m_InstanceIdentifier];
+    }
+
+    InstanceIdentifier GetInstanceIdentifier() const
+    {
+      return m_InstanceIdentifier;
+    }
+
+    ConstIterator & operator++()
+    {
+      ++m_InstanceIdentifier;
+      return *this;
+    }
+
+    bool operator!=(const ConstIterator & it) const
+    {
+      return m_InstanceIdentifier != it.m_InstanceIdentifier;
+    }
+
+    bool operator==(const ConstIterator & it) const
+    {
+      return m_InstanceIdentifier == it.m_InstanceIdentifier;
+    }
+
+  protected:
+    ConstIterator(const ReusableListSample * sample, InstanceIdentifier iid)
+    {
+      m_Sample = sample;
+      m_InstanceIdentifier = iid;
+    }
+
+  private:
+    ConstIterator(); //purposely not implemented
+    const ReusableListSample * m_Sample;
+    InstanceIdentifier m_InstanceIdentifier;
+  };
+
+  ConstIterator Begin() const
+  {
+    return ConstIterator(this, 0);
+  }
+
+  ConstIterator End() const
+  {
+    return ConstIterator(this, m_Size);
+  }
+
+protected:
+  ReusableListSample()
+  {
+    m_Size = 0;
+  }
+  virtual ~ReusableListSample()
+  {
+  }
+  void PrintSelf(std::ostream & os, Indent indent) const
+  {
+    Superclass::PrintSelf(os, indent);
+    os << indent << "Size: " << m_Size << std::endl;
+    os << indent << "Capacity: " << m_InternalContainer.size() << std::endl;
+  }
+
+private:
+  ReusableListSample(const Self &); //purposely not implemented
+  void operator=(const Self &); //purposely not implemented
+
+  std::vector< MeasurementVectorType > m_InternalContainer;
+  InstanceIdentifier m_Size;
+};
+// end of class
+} // end of namespace Statistics
+} // end of namespace itk
+
+#endif
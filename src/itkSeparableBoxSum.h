@@ -0,0 +1,146 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkSeparableBoxSum_h
+#define __itkSeparableBoxSum_h
+
+#include "itkImage.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace itk
+{
+/**
+ * Replace every pixel in the buffered region of a scalar image by the sum of
+ * its box neighborhood with the given radius. Neighbors outside the buffer
+ * take the value of the nearest buffered pixel, as with
+ * ZeroFluxNeumannBoundaryCondition, which keeps the box sum separable: one
+ * prefix-sum pass per dimension, whatever the radius.
+ */
+template< typename TImage >
+void SeparableBoxSum(TImage * image, const typename TImage::SizeType & radius)
+{
+  typedef typename TImage::PixelType PixelType;
+  const unsigned int Dimension = TImage::ImageDimension;
+
+  const typename TImage::SizeType size = image->GetBufferedRegion().GetSize();
+  const size_t total = image->GetBufferedRegion().GetNumberOfPixels();
+  PixelType * buffer = image->GetBufferPointer();
+
+  std::vector< PixelType > line;
+  std::vector< PixelType > prefix;
+
+  size_t stride = 1;
+  for (unsigned int d = 0; d < Dimension; d++)
+  {
+    const long length = static_cast< long >(size[d]);
+    const long r = static_cast< long >(radius[d]);
+    const size_t lineStep = stride * length;
+    if (r > 0 && length > 0)
+    {
+      line.resize(length);
+      prefix.resize(length + 1);
+      const long last = length - 1;
+      for (size_t outer = 0; outer < total; outer += lineStep)
+      {
+        for (size_t inner = 0; inner < stride; inner++)
+        {
+          PixelType * p = buffer + outer + inner;
+          prefix[0] = NumericTraits< PixelType >::ZeroValue();
+          for (long i = 0; i < length; i++)
+          {
+            line[i] = p[i * stride];
+            prefix[i + 1] = prefix[i] + line[i];
+          }
+          for (long i = 0; i < length; i++)
+          {
+            const long lo = i - r;
+            const long hi = i + r;
+            PixelType sum = prefix[std::min(hi, last) + 1]
+                - prefix[std::max(lo, 0L)];
+            if (lo < 0)
+            {
+              sum += static_cast< PixelType >(-lo) * line[0];
+            }
+            if (hi > last)
+            {
+              sum += static_cast< PixelType >(hi - last) * line[last];
+            }
+            p[i * stride] = sum;
+          }
+        }
+      }
+    }
+    stride = lineStep;
+  }
+}
+
+/**
+ * Replace every pixel in the buffered region of a scalar image by the maximum
+ * of its box neighborhood with the given radius. Neighbors outside the buffer
+ * take the value of the nearest buffered pixel, as in SeparableBoxSum; that
+ * pixel is already in the box, so the box is only clipped. Each line keeps the
+ * candidates of its window in a monotonic queue: one pass per dimension,
+ * whatever the radius.
+ */
+template< typename TImage >
+void SeparableBoxMaximum(TImage * image, const typename TImage::SizeType & radius)
+{
+  typedef typename TImage::PixelType PixelType;
+  const unsigned int Dimension = TImage::ImageDimension;
+
+  const typename TImage::SizeType size = image->GetBufferedRegion().GetSize();
+  const size_t total = image->GetBufferedRegion().GetNumberOfPixels();
+  PixelType * buffer = image->GetBufferPointer();
+
+  std::vector< PixelType > line;
+  std::vector< long > queue;
+
+  size_t stride = 1;
+  for (unsigned int d = 0; d < Dimension; d++)
+  {
+    const long length = static_cast< long >(size[d]);
+    const long r = static_cast< long >(radius[d]);
+    const size_t lineStep = stride * length;
+    if (r > 0 && length > 0)
+    {
+      line.resize(length);
+      queue.resize(length);
+      const long last = length - 1;
+      for (size_t outer = 0; outer < total; outer += lineStep)
+      {
+        for (size_t inner = 0; inner < stride; inner++)
+        {
+          PixelType * p = buffer + outer + inner;
+          for (long i = 0; i < length; i++)
+          {
+            line[i] = p[i * stride];
+          }
+          /* queue[head..tail) holds indices with decreasing values. */
+          long head = 0;
+          long tail = 0;
+          long next = 0;
+          for (long i = 0; i < length; i++)
+          {
+            for (; next <= std::min(i + r, last); next++)
+            {
+              while (tail > head && !(line[next] < line[queue[tail - 1]]))
+              {
+                --tail;
+              }
+              queue[tail++] = next;
+            }
+            while (queue[head] < i - r)
+            {
+              ++head;
+            }
+            p[i * stride] = line[queue[head]];
+          }
+        }
+      }
+    }
+    stride = lineStep;
+  }
+}
+} // end namespace itk
+
+#endif
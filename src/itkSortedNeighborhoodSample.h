@@ -0,0 +1,143 @@
+/* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
+#ifndef __itkSortedNeighborhoodSample_h
+#define __itkSortedNeighborhoodSample_h
+
+#include <vector>
+#include <algorithm>
+
+namespace itk
+{
+namespace Statistics
+{
+/** \class SortedNeighborhoodSample
+ * \brief Sorted multiset of neighborhood values which can slide along a scan
+ * line.
+ *
+ * Values leaving and entering the window are queued with Remove() and
+ * Insert(); Update() then applies both queues with a single linear merge. A
+ * neighborhood iterator moving one voxel along a scan line only has to queue
+ * its trailing and leading slabs, so the window is never gathered and sorted
+ * from scratch.
+ */
+template< typename TMeasurement >
+class SortedNeighborhoodSample
+{
+public:
+  typedef TMeasurement MeasurementType;
+  typedef std::vector< TMeasurement > ContainerType;
+  typedef typename ContainerType::const_iterator ConstIterator;
+
+  SortedNeighborhoodSample()
+  {
+  }
+
+  void Reserve(size_t n)
+  {
+    m_Values.reserve(n);
+    m_Buffer.reserve(n);
+    m_Incoming.reserve(n);
+    m_Outgoing.reserve(n);
+  }
+
+  void Clear()
+  {
+    m_Values.clear();
+    m_Incoming.clear();
+    m_Outgoing.clear();
+  }
+
+  /** Queue a value to be added by the next Update(). */
+  void Insert(const TMeasurement & v)
+  {
+    m_Incoming.push_back(v);
+  }
+
+  /** Queue a value to be removed by the next Update(). The value must be in
+   * the sample. */
+  void Remove(const TMeasurement & v)
+  {
+    m_Outgoing.push_back(v);
+  }
+
+  /** Apply all queued insertions and removals. */
+  void Update()
+  {
+    if (m_Incoming.empty() && m_Outgoing.empty())
+    {
+      return;
+    }
+    std::sort(m_Incoming.begin(), m_Incoming.end());
+    std::sort(m_Outgoing.begin(), m_Outgoing.end());
+
+    m_Buffer.clear();
+    ConstIterator it = m_Values.begin();
+    ConstIterator itEnd = m_Values.end();
+    ConstIterator in = m_Incoming.begin();
+    ConstIterator inEnd = m_Incoming.end();
+    ConstIterator out = m_Outgoing.begin();
+    ConstIterator outEnd = m_Outgoing.end();
+
+    while (it != itEnd)
+    {
+      while (in != inEnd && *in < *it)
+      {
+        m_Buffer.push_back(*in);
+        ++in;
+      }
+      while (out != outEnd && *out < *it)
+      {
+        ++out;
+      }
+      if (out != outEnd && !(*it < *out))
+      {
+        ++out;
+      }
+      else
+      {
+        m_Buffer.push_back(*it);
+      }
+      ++it;
+    }
+    m_Buffer.insert(m_Buffer.end(), in, inEnd);
+
+    m_Values.swap(m_Buffer);
+    m_Incoming.clear();
+    m_Outgoing.clear();
+  }
+
+  const ContainerType & GetValues() const
+  {
+    return m_Values;
+  }
+
+  ConstIterator Begin() const
+  {
+    return m_Values.begin();
+  }
+
+  ConstIterator End() const
+  {
+    return m_Values.end();
+  }
+
+  size_t Size() const
+  {
+    return m_Values.size();
+  }
+
+  bool Empty() const
+  {
+    return m_Values.empty();
+  }
+
+private:
+  ContainerType m_Values;
+  ContainerType m_Buffer;
+  ContainerType m_Incoming;
+  ContainerType m_Outgoing;
+};
+// end of class
+} // end of namespace Statistics
+} // end of namespace itk
+
+#endif
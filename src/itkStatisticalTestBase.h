@@ -7,11 +7,73 @@
 #include "itkMeasurementVectorTraits.h"
 #include "itkSample.h"
 #include "itkSubsample.h"
+#include "itkStatisticsAlgorithm.h"
 
 namespace itk
 {
 namespace Statistics
 {
+/** \class ScalarBatchTraits
+ * Pixel types for which the batch interface of StatisticalTestBase is
+ * compiled. Convert() is only meaningful when Supported is true; for other
+ * types it exists so that generic callers compile. */
+template< typename TPixel >
+struct ScalarBatchTraits
+{
+  static const bool Supported = false;
+  typedef double ValueType;
+  static ValueType Convert(const TPixel &)
+  {
+    return 0;
+  }
+};
+
+template< >
+struct ScalarBatchTraits< float >
+{
+  static const bool Supported = true;
+  typedef float ValueType;
+  static ValueType Convert(const float & p)
+  {
+    return p;
+  }
+};
+
+template< >
+struct ScalarBatchTraits< double >
+{
+  static const bool Supported = true;
+  typedef double ValueType;
+  static ValueType Convert(const double & p)
+  {
+    return p;
+  }
+};
+
+/** 16 bit scanner data is batched as double, which holds it exactly and
+ * compares it with the reference as the double pipeline did. */
+template< >
+struct ScalarBatchTraits< short >
+{
+  static const bool Supported = true;
+  typedef double ValueType;
+  static ValueType Convert(const short & p)
+  {
+    return p;
+  }
+};
+
+template< >
+struct ScalarBatchTraits< unsigned short >
+{
+  static const bool Supported = true;
+  typedef double ValueType;
+  static ValueType Convert(const unsigned short & p)
+  {
+    return p;
+  }
+};
+
 template< typename SampleT1, typename SampleT2=SampleT1, typename TRealValueType = double >
 class StatisticalTestBase: public Object
 {
@@ -31,8 +93,151 @@ public:
   typedef SampleT1 SampleType1;
   typedef SampleT2 SampleType2;
 
+  typedef Subsample< SampleType1 > SubsampleType1;
+  typedef Subsample< SampleType2 > SubsampleType2;
+
+  /** \class Scratch
+   * Per-thread working memory for Evaluate(). A thread passing the same
+   * scratch to consecutive calls lets the test reuse its subsamples instead
+   * of creating them on every call, and the first sample is only indexed and
+   * sorted again when it changes. A scratch must not be shared by threads.
+   */
+  class Scratch
+  {
+  public:
+    Scratch()
+    {
+      Subsample1 = SubsampleType1::New();
+      Subsample2 = SubsampleType2::New();
+      Sample1 = 0;
+      Sample1Time = 0;
+      Sample2 = 0;
+      Sample1Summary = 0;
+    }
+    typename SubsampleType1::Pointer Subsample1;
+    typename SubsampleType2::Pointer Subsample2;
+    const SampleType1 * Sample1;
+    unsigned long Sample1Time;
+    const SampleType2 * Sample2;
+    /** Value a test derives from the first sample alone, set by
+     * SummarizeFirstSample() whenever the first sample changes. */
+    TRealValueType Sample1Summary;
+  };
+  typedef Scratch ScratchType;
+
   virtual TRealValueType Evaluate(const SampleType1 * x1, const SampleType2 * x2) const = 0;
 
+  /** Evaluate using preallocated per-thread memory. Tests that do not
+   * override it fall back to the allocating Evaluate(). */
+  virtual TRealValueType Evaluate(const SampleType1 * x1, const SampleType2 * x2,
+                                  ScratchType & itkNotUsed(scratch)) const
+  {
+    return this->Evaluate(x1, x2);
+  }
+
+  /** Called once, before several threads evaluate second samples of at most
+   * maximumSize2 values against x1, so that a test can build what it shares
+   * between threads up front instead of under a lock. */
+  virtual void PrepareEvaluation(const SampleType1 * itkNotUsed(x1),
+                                 SizeValueType itkNotUsed(maximumSize2))
+  {
+  }
+
+  /** Tests whose statistic depends on the second sample only through the
+   * mean of the first sample's CDF over it and its largest value return true
+   * and implement InitializeMeanCDF() and EvaluateMeanCDF(). Neighborhood
+   * filters can then compute both with box sums and box maxima instead of
+   * sorting each neighborhood. */
+  virtual bool SupportsMeanCDF() const
+  {
+    return false;
+  }
+
+  /** Precompute everything that only depends on the first sample. */
+  virtual void InitializeMeanCDF(const SampleType1 * itkNotUsed(x1))
+  {
+    itkExceptionMacro("Test can not be evaluated from the mean CDF.");
+  }
+
+  /** Evaluate from the mean of the first sample's CDF over the second
+   * sample and the largest value of the second sample. InitializeMeanCDF()
+   * must have been called. */
+  virtual TRealValueType EvaluateMeanCDF(const TRealValueType & itkNotUsed(meanCDF),
+                                         const TRealValueType & itkNotUsed(maximum)) const
+  {
+    itkExceptionMacro("Test can not be evaluated from the mean CDF.");
+  }
+
+  /** Tests that can be evaluated from the frequencies of both samples over
+   * common bins return true and implement EvaluateHistogram(). The cost is
+   * then linear in the number of bins, whatever the sample sizes. */
+  virtual bool SupportsHistogram() const
+  {
+    return false;
+  }
+
+  /** Evaluate from bin frequencies of the first and the second sample over
+   * the same ascending bins. Values within a bin are taken as equal. */
+  virtual TRealValueType EvaluateHistogram(const TRealValueType * itkNotUsed(frequency1),
+                                           const TRealValueType & itkNotUsed(total1),
+                                           const TRealValueType * itkNotUsed(frequency2),
+                                           const TRealValueType & itkNotUsed(total2),
+                                           unsigned int itkNotUsed(numberOfBins)) const
+  {
+    itkExceptionMacro("Test can not be evaluated from histograms.");
+  }
+
+  /** Tests that return true implement EvaluateBatch() for float and double
+   * values. The whole batch costs one virtual call and the merge runs on
+   * plain arrays, so it can be inlined and vectorized by the compiler. */
+  virtual bool SupportsBatch() const
+  {
+    return false;
+  }
+
+  /** Evaluate count second samples against one first sample, all given as
+   * ascending scalar values. The first sample has size1 values with their
+   * frequencies; second sample k is values2[offsets2[k]] up to
+   * values2[offsets2[k + 1]], with unit frequencies. An empty second sample
+   * gives 0. Results match Evaluate() on the same samples. */
+  virtual void EvaluateBatch(const float * itkNotUsed(values1),
+                             const TRealValueType * itkNotUsed(frequencies1),
+                             SizeValueType itkNotUsed(size1),
+                             const float * itkNotUsed(values2),
+                             const SizeValueType * itkNotUsed(offsets2),
+                             SizeValueType itkNotUsed(count),
+                             TRealValueType * itkNotUsed(output)) const
+  {
+    itkExceptionMacro("Test can not be evaluated in batches.");
+  }
+  virtual void EvaluateBatch(const double * itkNotUsed(values1),
+                             const TRealValueType * itkNotUsed(frequencies1),
+                             SizeValueType itkNotUsed(size1),
+                             const double * itkNotUsed(values2),
+                             const SizeValueType * itkNotUsed(offsets2),
+                             SizeValueType itkNotUsed(count),
+                             TRealValueType * itkNotUsed(output)) const
+  {
+    itkExceptionMacro("Test can not be evaluated in batches.");
+  }
+
+  /** In a decision mode the test only has to tell whether its statistic
+   * reaches DecisionThreshold, and stops merging the CDFs as soon as the
+   * outcome can no longer change.
+   * BinaryDecision returns 1 when the threshold is reached and 0 otherwise.
+   * ClampedDecision returns the statistic when the threshold is reached and
+   * 0 otherwise; only voxels below the threshold can stop early. */
+  typedef enum
+  {
+    NoDecision = 0, BinaryDecision, ClampedDecision
+  } DecisionModeType;
+
+  itkGetConstMacro(DecisionMode, DecisionModeType);
+  itkSetMacro(DecisionMode, DecisionModeType);
+
+  itkGetConstMacro(DecisionThreshold, TRealValueType);
+  itkSetMacro(DecisionThreshold, TRealValueType);
+
   itkGetConstMacro(TwoTail, bool);
   itkBooleanMacro (TwoTail);
 
@@ -90,13 +295,93 @@ protected:
     m_TwoTail = true;
     m_RightTail = false;
     m_LeftTail = false;
+    m_DecisionMode = NoDecision;
+    m_DecisionThreshold = 0;
   }
   virtual ~StatisticalTestBase()
   {
   }
+  /** Index both samples in the scratch subsamples and sort those not
+   * flagged as sorted. No memory is allocated once the scratch has grown to
+   * the largest sample size. */
+  void PrepareScratch(const SampleType1 * x1, const SampleType2 * x2,
+                      bool sorted1, bool sorted2, ScratchType & scratch) const
+  {
+    if (scratch.Sample1 != x1 || scratch.Sample1Time != x1->GetMTime())
+    {
+      scratch.Subsample1->SetSample(x1);
+      scratch.Subsample1->InitializeWithAllInstances();
+      if (!sorted1)
+      {
+        Algorithm::HeapSort< SubsampleType1 >(scratch.Subsample1, 0, 0,
+                                              scratch.Subsample1->Size());
+      }
+      scratch.Sample1 = x1;
+      scratch.Sample1Time = x1->GetMTime();
+      this->SummarizeFirstSample(scratch);
+    }
+    if (scratch.Sample2 != x2)
+    {
+      scratch.Subsample2->SetSample(x2);
+      scratch.Sample2 = x2;
+    }
+    scratch.Subsample2->InitializeWithAllInstances();
+    if (!sorted2)
+    {
+      Algorithm::HeapSort< SubsampleType2 >(scratch.Subsample2, 0, 0,
+                                            scratch.Subsample2->Size());
+    }
+  }
+
+  /** Called by PrepareScratch() once the first sample is indexed and
+   * sorted, to fill scratch.Sample1Summary. */
+  virtual void SummarizeFirstSample(ScratchType & itkNotUsed(scratch)) const
+  {
+  }
+
+  /** True when the decision mode is on and a statistic known to end up in
+   * [lower, upper] can no longer change the outcome; output is then set to
+   * the decided value. */
+  bool Decide(const TRealValueType & lower, const TRealValueType & upper,
+              TRealValueType & output) const
+  {
+    if (m_DecisionMode == NoDecision)
+    {
+      return false;
+    }
+    if (upper < m_DecisionThreshold)
+    {
+      output = 0;
+      return true;
+    }
+    if (m_DecisionMode == BinaryDecision && lower >= m_DecisionThreshold)
+    {
+      output = 1;
+      return true;
+    }
+    return false;
+  }
+
+  /** Output for a fully evaluated statistic. */
+  TRealValueType DecisionOutput(const TRealValueType & statistic) const
+  {
+    switch (m_DecisionMode)
+    {
+    case BinaryDecision:
+      return statistic >= m_DecisionThreshold ? 1 : 0;
+    case ClampedDecision:
+      return statistic >= m_DecisionThreshold ? statistic : 0;
+    default:
+      return statistic;
+    }
+  }
+
   void PrintSelf(std::ostream & os, Indent indent) const
   {
     Superclass::PrintSelf(os, indent);
+    os << indent << "Decision mode: " << m_DecisionMode << std::endl;
+    os << indent << "Decision threshold: " << m_DecisionThreshold
+       << std::endl;
     os << indent << "Two tail test: " << (m_TwoTail ? "Yes" : "No")
        << std::endl;
     os << indent << "Right tail test: " << (m_RightTail ? "Yes" : "No")
@@ -110,6 +395,8 @@ private:
   bool m_TwoTail;
   bool m_RightTail;
   bool m_LeftTail;
+  DecisionModeType m_DecisionMode;
+  TRealValueType m_DecisionThreshold;
 };
 // end of class
 }// end of namespace Statistics
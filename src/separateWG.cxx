@@ -1,5 +1,6 @@
 /* Copyright (C) 2013-2014 Soheil Damangir - All Rights Reserved */
 #include "itkImageToWeightedHistogramFilter.h"
+#include "itkMultiClassWeightedHistogramCalculator.h"
 #include "itkEmpiricalDensityMembershipFunction.h"
 #include "itkIterativeBayesianImageFilter.h"
 #include "itkFloodFilledImageFunctionConditionalIterator.h"
@@ -148,30 +149,25 @@ int main(int argc, char *argv[])
    * Calculate intensity distribution for each class
    */
   {
-    WeightedHistogramType::Pointer hist = WeightedHistogramType::New();
-    hist->SetAutoMinimumMaximum(true);
-    hist->SetHistogramSize(size);
+    /*
+     * One pass over the subject for the four classes, with the bins of
+     * WeightedHistogramType.
+     */
+    typedef itk::Statistics::MultiClassWeightedHistogramCalculator<
+        VectorImageType, Probability > HistogramCalculatorType;
+    HistogramCalculatorType::Pointer hist = HistogramCalculatorType::New();
     hist->SetInput(subjectImg);
-    // Create WMGM membership
-    hist->SetWeightImage(CU::Cast< PriorImageType >(WMGMMask.GetPointer()));
-    hist->Update();
-    wmgmDist = hist->GetOutput();
-    wmgmDist->DisconnectPipeline();
-    // Create CSF membership
-    hist->SetWeightImage(CU::Cast< PriorImageType >(CSFMask.GetPointer()));
-    hist->Update();
-    csfDist = hist->GetOutput();
-    csfDist->DisconnectPipeline();
-    // Create GM membership
-    hist->SetWeightImage(gmPriorImg);
-    hist->Update();
-    gmDist = hist->GetOutput();
-    gmDist->DisconnectPipeline();
-    // Create WM membership
-    hist->SetWeightImage(wmPriorImg);
-    hist->Update();
-    wmDist = hist->GetOutput();
-    wmDist->DisconnectPipeline();
+    hist->SetHistogramSize(size);
+    // WMGM, CSF, GM and WM memberships
+    hist->AddWeightImage(CU::Cast< PriorImageType >(WMGMMask.GetPointer()));
+    hist->AddWeightImage(CU::Cast< PriorImageType >(CSFMask.GetPointer()));
+    hist->AddWeightImage(gmPriorImg);
+    hist->AddWeightImage(wmPriorImg);
+    hist->Compute();
+    wmgmDist = hist->GetHistogram(0);
+    csfDist = hist->GetHistogram(1);
+    gmDist = hist->GetHistogram(2);
+    wmDist = hist->GetHistogram(3);
 
     wmgmMembership->SetDistribution(wmgmDist);
     csfMembership->SetDistribution(csfDist);